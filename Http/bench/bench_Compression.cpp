@@ -0,0 +1,142 @@
+/**
+ * Ticket body size and latency, with and without compression
+ *
+ *    ./bin/bench_Compression [requests]
+ *
+ * Reports, for tickets of 10 to 10000 urls, as /reads/<id> answers them
+ *    -- body bytes, identity and per content coding
+ *    -- median time to compress, per coding
+ *    -- median request latency over loopback, keep-alive, to last byte
+ *       of body, with no Accept-Encoding and with each coding accepted
+ */
+#include "asio.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Compression.h"
+#include "Server.h"
+
+using namespace Http;
+using ClockType = std::chrono::steady_clock;
+
+/**
+ * @brief   Ticket as Ticket::to_json() makes it, n urls of 1MB ranges
+ */
+auto ticket(int n) -> json_type {
+  json_type urls;
+  for (int i = 0; i < n; ++i) {
+    auto first = std::to_string(std::uint64_t(i) << 20);
+    auto last = std::to_string((std::uint64_t(i + 1) << 20) - 1);
+    urls.push_back(json_type{
+        {"url", "https://127.0.0.1:8888/data/"
+                "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08"},
+        {"headers", {{"Range", "bytes=" + first + "-" + last}}}});
+  }
+  return {{"format", "BAM"},
+          {"urls", urls},
+          {"sha256", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"}};
+}
+
+double median(std::vector<double> &v) {
+  std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+  return v[v.size() / 2];
+}
+
+double us(ClockType::duration d) {
+  return std::chrono::duration<double, std::micro>(d).count();
+}
+
+/**
+ * @brief   Median latency of requests for /ticket/<n>, one connection
+ */
+double latency(int port, int n, const std::string &accept_encoding,
+               int requests) {
+  asio::io_service io_service;
+  asio::ip::tcp::socket socket(io_service);
+  socket.connect({asio::ip::address::from_string("127.0.0.1"),
+                  static_cast<unsigned short>(port)});
+  socket.set_option(asio::ip::tcp::no_delay(true));
+
+  std::string request = "GET /ticket/" + std::to_string(n) + " HTTP/1.1\r\n";
+  if (!accept_encoding.empty())
+    request += "Accept-Encoding: " + accept_encoding + "\r\n";
+  request += "\r\n";
+
+  std::vector<double> times;
+  std::string buffer;
+  std::array<char, 65536> chunk;
+  for (int i = 0; i < requests; ++i) {
+    auto start = ClockType::now();
+    asio::write(socket, asio::buffer(request));
+
+    buffer.clear();
+    std::size_t head_end = std::string::npos, length = 0;
+    while (head_end == std::string::npos ||
+           buffer.size() < head_end + 4 + length) {
+      auto bytes = socket.read_some(asio::buffer(chunk));
+      buffer.append(chunk.data(), bytes);
+      if (head_end == std::string::npos &&
+          (head_end = buffer.find("\r\n\r\n")) != std::string::npos) {
+        auto at = buffer.find("Content-Length: ");
+        length = std::strtoul(buffer.c_str() + at + 16, nullptr, 10);
+      }
+    }
+    times.push_back(us(ClockType::now() - start));
+  }
+  return median(times);
+}
+
+int main(int argc, char **argv) {
+  int requests = argc > 1 ? std::atoi(argv[1]) : 200;
+  int port = 9970;
+
+  auto app = std::make_unique<HttpServer>(std::make_pair("127.0.0.1", port));
+  app->thread_count(1);
+  app->connection_options_.max_requests = requests * 16;
+  app->router_.get("/ticket/");
+  app->router_.get("/ticket/<n>", Handler([](Context &ctx) {
+                     ctx.res_.write_json(ticket(std::stoi(ctx.param_["n"])));
+                     ctx.res_.compress(
+                         ctx.req_.get_header("Accept-Encoding").first);
+                   }));
+  std::thread runner([&app] { app->run(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  std::vector<ContentCoding> codings{ContentCoding::gzip,
+                                     ContentCoding::deflate};
+  if (coding_available(ContentCoding::zstd))
+    codings.push_back(ContentCoding::zstd);
+
+  std::cout << "urls\tcoding\tbytes\tcompress us\tlatency us" << std::endl;
+  for (int n : {10, 100, 1000, 10000}) {
+    auto body = ticket(n).dump();
+    std::cout << n << "\tidentity\t" << body.size() << "\t0\t"
+              << latency(port, n, "", requests) << std::endl;
+
+    for (auto coding : codings) {
+      std::string compressed;
+      std::vector<double> times;
+      for (int i = 0; i < 20; ++i) {
+        auto start = ClockType::now();
+        compress(coding, body, compressed);
+        times.push_back(us(ClockType::now() - start));
+      }
+      std::cout << n << "\t" << coding_to_string(coding) << "\t"
+                << compressed.size() << "\t" << median(times) << "\t"
+                << latency(port, n, coding_to_string(coding), requests)
+                << std::endl;
+    }
+  }
+
+  app->stop();
+  runner.join();
+  return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * Heap allocations per request, with and without connection reuse
+ *
+ *    ./bin/bench_ConnectionPool [requests]
+ *
+ * Counts operator new calls made by server threads only, for
+ *    -- parse, one request parsed, its query made and cleared,
+ *       into a fresh Request, a reused one, and a reused one in an Arena
+ *    -- connection per request, connection_pool_size 0 and default
+ *    -- keep-alive, requests back to back on one connection
+ */
+#include "asio.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+
+#include "Server.h"
+
+using namespace Http;
+
+static std::atomic<std::size_t> allocations{0};
+static thread_local bool counted = false; // thread serves requests
+
+void *operator new(std::size_t size) {
+  if (counted)
+    ++allocations;
+  if (auto p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+static const std::string request =
+    "GET /reads/bamtest?format=BAM&referenceName=1&start=10145&end=10150 "
+    "HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9971\r\n"
+    "User-Agent: bench_ConnectionPool/1.0 (htsget client benchmark)\r\n"
+    "Accept: application/vnd.ga4gh.htsget.v0.2rc+json\r\n"
+    "\r\n";
+
+/**
+ * @brief   Allocations of parsing request into Request n times
+ */
+template <typename Parse> double parse_allocations(int n, Parse parse) {
+  counted = true;
+  auto before = allocations.load();
+  for (int i = 0; i < n; ++i)
+    parse();
+  counted = false;
+  return double(allocations - before) / n;
+}
+
+/**
+ * @brief   Reads one response, by Content-Length
+ */
+void read_response(asio::ip::tcp::socket &socket, std::string &buffer) {
+  std::array<char, 4096> chunk;
+  buffer.clear();
+  std::size_t head_end = std::string::npos, length = 0;
+  while (head_end == std::string::npos || buffer.size() < head_end + 4 + length) {
+    buffer.append(chunk.data(), socket.read_some(asio::buffer(chunk)));
+    if (head_end == std::string::npos &&
+        (head_end = buffer.find("\r\n\r\n")) != std::string::npos) {
+      auto at = buffer.find("Content-Length: ");
+      length = std::strtoul(buffer.c_str() + at + 16, nullptr, 10);
+    }
+  }
+}
+
+/**
+ * @brief   Allocations per request of n requests served by app
+ */
+double serve_allocations(int port, int n, bool keep_alive) {
+  asio::io_service io_service;
+  asio::ip::tcp::endpoint endpoint(asio::ip::address::from_string("127.0.0.1"),
+                                   static_cast<unsigned short>(port));
+  std::string buffer;
+  asio::ip::tcp::socket socket(io_service);
+
+  auto before = allocations.load();
+  for (int i = 0; i < n; ++i) {
+    if (!keep_alive || !i) {
+      asio::error_code ignored_ec;
+      socket.close(ignored_ec);
+      socket.connect(endpoint);
+    }
+    asio::write(socket, asio::buffer(request));
+    read_response(socket, buffer);
+  }
+  socket.close();
+  // last connection is released once the server sees it closed
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  return double(allocations - before) / n;
+}
+
+int main(int argc, char **argv) {
+  int n = argc > 1 ? std::atoi(argv[1]) : 10000;
+  int port = 9971;
+
+  {
+    Request reused;
+    Request in_arena;
+    Arena arena;
+    in_arena.use_arena(arena);
+    RequestParser parser;
+
+    auto parse_into = [&](Request &req) {
+      parser.reset();
+      parser.parse(req, request.begin(), request.end());
+      Uri::make_query(req.uri_.query_, req.query_);
+    };
+
+    std::cout << "parse\tallocations/request" << std::endl;
+    std::cout << "fresh\t" << parse_allocations(n, [&] {
+      Request req;
+      parse_into(req);
+    }) << std::endl;
+    std::cout << "reused\t" << parse_allocations(n, [&] {
+      parse_into(reused);
+      reused.clear();
+    }) << std::endl;
+    std::cout << "arena\t" << parse_allocations(n, [&] {
+      parse_into(in_arena);
+      in_arena.clear();
+      arena.reset();
+    }) << std::endl;
+  }
+
+  std::cout << std::endl << "pool size\tmode\tallocations/request" << std::endl;
+  for (std::size_t pool_size : {std::size_t(0), ConnectionOptions().connection_pool_size}) {
+    auto app = std::make_unique<HttpServer>(std::make_pair("127.0.0.1", port));
+    app->thread_count(1);
+    app->connection_options_.max_requests = n + 1;
+    app->connection_options_.connection_pool_size = pool_size;
+    app->router_.get("/reads/");
+    app->router_.get("/reads/<id>", Handler([](Context &ctx) {
+                       ctx.res_.write_json({{"format", ctx.query_["format"]},
+                                            {"id", ctx.param_["id"]}});
+                     }));
+    std::thread runner([&app] {
+      counted = true;
+      app->run();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    // first connections grow the pool and buffers, not counted
+    serve_allocations(port, 100, false);
+    std::cout << pool_size << "\tconnection\t"
+              << serve_allocations(port, n, false) << std::endl;
+    std::cout << pool_size << "\tkeep-alive\t"
+              << serve_allocations(port, n, true) << std::endl;
+
+    app->stop();
+    runner.join();
+  }
+  return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * Per-request overhead of callback and coroutine handlers
+ *
+ *    ./bin/bench_Coroutine [requests] [awaits_per_request]
+ *
+ * Every handler awaits awaits_per_request operations, each completed by a
+ * post to the event loop, then writes a small body. Reports ns/request for
+ *    -- sync,       plain handler, no await (baseline)
+ *    -- callback,   Context::defer() + hand-written completion chain
+ *    -- coroutine,  make_coroutine() + reenter/yield
+ */
+#include "asio.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "Coroutine.h"
+#include "Router.h"
+#include "asio/yield.hpp"
+
+using namespace Http;
+
+static int awaits = 1;
+
+struct AwaitState {
+  int count = 0;
+};
+
+/**
+ * @brief   Runs requests through handler, returns ns/request
+ */
+double measure(Handler handler, int requests, bool deferred = true) {
+  asio::io_service io_service;
+  int completed = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < requests; ++i) {
+    Request req;
+    Response res;
+    Context ctx(req, res);
+    ctx.io_service_ = &io_service;
+    ctx.make_completion_ = [&completed] { return [&completed] { ++completed; }; };
+
+    handler(ctx);
+    io_service.run();
+    io_service.reset();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  if (deferred && completed != requests)
+    std::cerr << "only " << completed << " of " << requests << " completed"
+              << std::endl;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / requests;
+}
+
+/**
+ * @brief   Callback style, each await is a continuation
+ */
+void await_then(asio::io_service &io_service, Context &ctx, int remaining,
+                Context::Completion done) {
+  if (remaining == 0) {
+    ctx.res_.write_text("done");
+    return done();
+  }
+  io_service.post([&io_service, &ctx, remaining, done] {
+    await_then(io_service, ctx, remaining - 1, done);
+  });
+}
+
+int main(int argc, char **argv) {
+  int requests = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  awaits = argc > 2 ? std::atoi(argv[2]) : 1;
+
+  auto sync = Handler([](Context &ctx) { ctx.res_.write_text("done"); });
+
+  auto callback = Handler([](Context &ctx) {
+    await_then(*ctx.io_service_, ctx, awaits, ctx.defer());
+  });
+
+  auto coroutine = Handler(make_coroutine<AwaitState>(
+      [](CoroutineFrame<AwaitState> &co, Context &ctx) {
+        reenter(co) {
+          while (co.state_.count++ < awaits) {
+            yield co.io_service().post([resume = co.resume()]() mutable {
+              resume(std::error_code());
+            });
+          }
+          ctx.res_.write_text("done");
+        }
+      }));
+
+  std::cout << "handler\tns/request" << std::endl;
+  std::cout << "sync\t" << measure(sync, requests, false) << std::endl;
+  std::cout << "callback\t" << measure(callback, requests) << std::endl;
+  std::cout << "coroutine\t" << measure(coroutine, requests) << std::endl;
+  return 0;
+}
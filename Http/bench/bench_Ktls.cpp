@@ -0,0 +1,164 @@
+/**
+ * HTTPS throughput of file bodies, userspace OpenSSL vs kernel TLS
+ *
+ *    ./bin/bench_Ktls [seconds] [clients] [range_bytes] [threads]
+ *
+ * Serves byte ranges of a scratch file with Response::write_file_ranges(),
+ * as htsgetserver's /data does, to keep-alive HTTPS clients and reports
+ * MB/s of response bodies for
+ *    -- userspace,   records encrypted by OpenSSL, file read in chunks
+ *    -- ktls,        records encrypted by kernel, file sent by sendfile(2)
+ * Run from repository root, for Http/ssl. Without the tls kernel module,
+ * ktls falls back to userspace, which is reported.
+ */
+#include "asio.hpp"
+#include "asio/ssl.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "Server.h"
+
+using namespace Http;
+
+static const std::string data_file = "/tmp/bench_Ktls.data";
+
+void make_data_file(std::size_t size) {
+  std::ofstream os(data_file, std::ios::out | std::ios::binary);
+  std::string block(4096, 'A');
+  for (std::size_t written = 0; written < size; written += block.size())
+    os << block;
+}
+
+asio::ip::tcp::endpoint endpoint(int port) {
+  return {asio::ip::address::from_string("127.0.0.1"),
+          static_cast<unsigned short>(port)};
+}
+
+/**
+ * @brief   Whether kernel accepts the tls upper layer protocol
+ */
+bool kernel_tls_loaded(int port) {
+  asio::io_service io_service;
+  asio::ip::tcp::acceptor acceptor(io_service, endpoint(port));
+  asio::ip::tcp::socket client(io_service), server(io_service);
+  client.connect(acceptor.local_endpoint());
+  acceptor.accept(server);
+  return ::setsockopt(server.native_handle(), SOL_TCP, TCP_ULP, "tls",
+                      sizeof("tls")) == 0;
+}
+
+/**
+ * @brief   Requests on one connection until done, returns body bytes read
+ */
+long long fetch_keepalive(int port, const std::string &request,
+                          std::atomic<bool> &done) {
+  long long received = 0;
+  try {
+    asio::io_service io_service;
+    asio::ssl::context context(asio::ssl::context::sslv23);
+    asio::ssl::stream<asio::ip::tcp::socket> stream(io_service, context);
+    stream.lowest_layer().connect(endpoint(port));
+    stream.handshake(asio::ssl::stream_base::client);
+
+    asio::streambuf buf;
+    while (!done) {
+      asio::write(stream, asio::buffer(request));
+
+      auto header_bytes = asio::read_until(stream, buf, "\r\n\r\n");
+      std::string header(asio::buffers_begin(buf.data()),
+                         asio::buffers_begin(buf.data()) + header_bytes);
+      buf.consume(header_bytes);
+
+      auto pos = header.find("Content-Length: ");
+      std::size_t length =
+          pos == std::string::npos ? 0 : std::stoul(header.substr(pos + 16));
+      if (buf.size() < length)
+        asio::read(stream, buf, asio::transfer_exactly(length - buf.size()));
+      buf.consume(length);
+      received += length;
+
+      if (header.find("Connection: close") != std::string::npos)
+        break;
+    }
+  } catch (const std::exception &) {
+  }
+  return received;
+}
+
+double run_once(bool ktls, int port, int seconds, int clients,
+                int range_bytes, std::size_t threads) {
+  auto app = std::make_unique<HttpsServer>(std::make_pair("127.0.0.1", port));
+  app->thread_count(threads);
+  app->connection_options_.ktls = ktls;
+  app->connection_options_.max_requests = 1 << 30;
+  app->router_.get("/data/");
+  app->router_.get("/data/<filename>", Handler([range_bytes](Context &ctx) {
+                     ctx.res_.write_file_ranges(
+                         data_file, {{0, std::uint64_t(range_bytes) - 1}});
+                   }));
+
+  std::thread server([&app] { app->run(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  std::string request = "GET /data/bench HTTP/1.1\r\n"
+                        "Host: 127.0.0.1\r\n"
+                        "Range: bytes=0-" + std::to_string(range_bytes - 1) +
+                        "\r\n\r\n";
+
+  std::atomic<bool> done{false};
+  std::atomic<long long> received{0};
+  std::vector<std::thread> workers;
+  for (int i = 0; i < clients; ++i) {
+    workers.emplace_back([&] {
+      while (!done)
+        received += fetch_keepalive(port, request, done);
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  done = true;
+  for (auto &worker : workers)
+    worker.join();
+
+  app->stop();
+  server.join();
+
+  return static_cast<double>(received) / seconds / (1 << 20);
+}
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? std::atoi(argv[1]) : 3;
+  int clients = argc > 2 ? std::atoi(argv[2]) : 4;
+  int range_bytes = argc > 3 ? std::atoi(argv[3]) : 16 << 20;
+  std::size_t threads =
+      argc > 4 ? std::atoi(argv[4]) : std::thread::hardware_concurrency();
+
+  make_data_file(range_bytes + 4096);
+
+  int port = 9950;
+  if (!kernel_tls_loaded(port++))
+    std::cout << "tls kernel module not loaded, ktls falls back to userspace"
+              << std::endl;
+
+  std::cout << "mode\tMB/s" << std::endl;
+  std::cout << "userspace\t"
+            << run_once(false, port++, seconds, clients, range_bytes, threads)
+            << std::endl;
+  std::cout << "ktls\t"
+            << run_once(true, port++, seconds, clients, range_bytes, threads)
+            << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,122 @@
+/**
+ * Memory held by unsent response bytes, with slow and stalled readers
+ *
+ *    ./bin/bench_SendWindow [clients] [body_bytes] [seconds]
+ *
+ * A blocking handler streams body_bytes in 64KB chunks, parking on
+ * wait_writable() between them. Half the clients read 4KB every 10ms, the
+ * other half never read. Reports, for send_window 0 and default,
+ *    -- peak unsent MB, of AdmissionControl::unsent_bytes_, sampled every 10ms
+ *    -- stalled closed, stalled clients the server closed, as they fell
+ *       below min_send_rate past a write_timeout of 2s
+ */
+#include "asio.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Server.h"
+
+using namespace Http;
+
+static const std::size_t chunk_size = 64 * 1024;
+
+/**
+ * @brief   Requests the body, reads it slowly, or not at all if stalled,
+ *          for up to seconds, true if the server closed the connection
+ */
+bool slow_read(int port, bool stalled, int seconds) {
+  try {
+    asio::io_service io_service;
+    asio::ip::tcp::socket socket(io_service);
+    socket.connect({asio::ip::address::from_string("127.0.0.1"),
+                    static_cast<unsigned short>(port)});
+    // small receive buffer, so that the server feels the reader's pace
+    socket.set_option(asio::socket_base::receive_buffer_size(16 * 1024));
+    asio::write(socket, asio::buffer(std::string("GET /body HTTP/1.1\r\n"
+                                                 "Host: 127.0.0.1\r\n\r\n")));
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    std::array<char, 4096> buf;
+    while (std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      if (stalled)
+        continue;
+      asio::error_code ec;
+      socket.read_some(asio::buffer(buf), ec);
+      if (ec)
+        return true;
+    }
+    if (!stalled)
+      return false;
+    // a closed connection reads what was buffered, then EOF
+    socket.non_blocking(true);
+    asio::error_code ec;
+    while (!ec)
+      socket.read_some(asio::buffer(buf), ec);
+    return ec != asio::error::would_block;
+  } catch (const std::exception &) {
+    return true;
+  }
+}
+
+int main(int argc, char **argv) {
+  int clients = argc > 1 ? std::atoi(argv[1]) : 16;
+  std::size_t body_bytes = argc > 2 ? std::atoi(argv[2]) : 16 << 20;
+  int seconds = argc > 3 ? std::atoi(argv[3]) : 5;
+  int port = 9974;
+
+  std::cout << "send_window\tpeak unsent MB\tstalled closed" << std::endl;
+  for (std::size_t window : {std::size_t(0), ConnectionOptions().send_window}) {
+    auto app = std::make_unique<HttpServer>(std::make_pair("127.0.0.1", port++));
+    app->thread_count(2);
+    app->blocking_thread_count(clients);
+    app->connection_options_.send_window = window;
+    app->connection_options_.write_timeout = std::chrono::seconds(2);
+    app->router_.get("/body", Handler([body_bytes](Context &ctx) {
+                       auto stream = ctx.stream();
+                       std::string chunk(chunk_size, 'A');
+                       for (std::size_t sent = 0; sent < body_bytes;
+                            sent += chunk.size()) {
+                         stream->wait_writable();
+                         stream->write(chunk);
+                       }
+                     }).blocking());
+    std::thread server([&app] { app->run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::atomic<int> stalled_closed{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < clients; ++i)
+      readers.emplace_back([&, i] {
+        bool stalled = i % 2;
+        if (slow_read(port - 1, stalled, seconds) && stalled)
+          ++stalled_closed;
+      });
+
+    std::size_t peak = 0;
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    while (std::chrono::steady_clock::now() < end) {
+      peak = std::max<std::size_t>(peak, app->admission_.unsent_bytes_);
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    for (auto &reader : readers)
+      reader.join();
+    // producers parked on closed connections resume, and return
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::cout << window << "\t" << double(peak) / (1 << 20) << "\t"
+              << stalled_closed << "/" << clients / 2 << std::endl;
+    app->stop();
+    server.join();
+  }
+  return 0;
+}
@@ -0,0 +1,203 @@
+/**
+ * Throughput of GenericServer::run as the io_service thread pool grows
+ *
+ *    ./bin/bench_Server [max_threads] [seconds] [clients] [range_bytes] [modes]
+ *
+ * Serves byte ranges of a scratch file on /data/<filename>, the same way
+ * htsgetserver does, and reports requests/s for 1, 2, 4, ..., max_threads
+ * modes is a comma separated list of
+ *    -- sharded,    also reports connections accepted by each shard
+ *    -- keepalive,  clients send requests back to back on one connection
+ *    -- pipeline,   as keepalive, with 8 requests in flight per connection
+ */
+#include "asio.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Server.h"
+
+using namespace Http;
+
+static const std::string data_file = "/tmp/bench_Server.data";
+
+void make_data_file(std::size_t size) {
+  std::ofstream os(data_file, std::ios::out | std::ios::binary);
+  std::string block(4096, 'A');
+  for (std::size_t written = 0; written < size; written += block.size())
+    os << block;
+}
+
+void serve_range(Context &ctx) {
+  std::string range;
+  bool range_exists;
+  std::tie(range, range_exists) = ctx.req_.get_header("Range");
+  if (!range_exists)
+    return ctx.res_.status_code(StatusCode::Bad_Request);
+
+  range = range.substr(range.find('=') + 1);
+  int start = std::stoi(range.substr(0, range.find('-')));
+  int end = std::stoi(range.substr(range.find('-') + 1));
+
+  std::ifstream is(data_file, std::ifstream::in | std::ifstream::binary);
+  is.seekg(0, is.end);
+  int total = is.tellg();
+  is.seekg(start, is.beg);
+
+  std::vector<char> buffer(end - start);
+  is.read(buffer.data(), end - start);
+  ctx.res_.write_range(buffer.data(), start, end, total);
+}
+
+asio::ip::tcp::endpoint endpoint(int port) {
+  return {asio::ip::address::from_string("127.0.0.1"),
+          static_cast<unsigned short>(port)};
+}
+
+/**
+ * @brief   One request per connection, read until server closes
+ */
+bool fetch(int port, const std::string &request) {
+  try {
+    asio::io_service io_service;
+    asio::ip::tcp::socket socket(io_service);
+    socket.connect(endpoint(port));
+    asio::write(socket, asio::buffer(request));
+
+    std::array<char, 65536> buf;
+    asio::error_code ec;
+    std::size_t total = 0;
+    while (!ec)
+      total += socket.read_some(asio::buffer(buf), ec);
+    return total > 0;
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+
+/**
+ * @brief   Requests on one connection until done or server closes it,
+ *          depth requests are written at once, then their responses read,
+ *          response is delimited by Content-Length, returns responses read
+ */
+long fetch_keepalive(int port, const std::string &request, int depth,
+                     std::atomic<bool> &done) {
+  long completed = 0;
+  try {
+    asio::io_service io_service;
+    asio::ip::tcp::socket socket(io_service);
+    socket.connect(endpoint(port));
+
+    std::string requests;
+    for (int i = 0; i < depth; ++i)
+      requests += request;
+
+    asio::streambuf buf;
+    while (!done) {
+      asio::write(socket, asio::buffer(requests));
+
+      for (int i = 0; i < depth; ++i) {
+        auto header_bytes = asio::read_until(socket, buf, "\r\n\r\n");
+        std::string header(asio::buffers_begin(buf.data()),
+                           asio::buffers_begin(buf.data()) + header_bytes);
+        buf.consume(header_bytes);
+
+        auto pos = header.find("Content-Length: ");
+        std::size_t length =
+            pos == std::string::npos ? 0 : std::stoul(header.substr(pos + 16));
+        if (buf.size() < length)
+          asio::read(socket, buf, asio::transfer_exactly(length - buf.size()));
+        buf.consume(length);
+        ++completed;
+
+        if (header.find("Connection: close") != std::string::npos)
+          return completed;
+      }
+    }
+  } catch (const std::exception &) {
+  }
+  return completed;
+}
+
+double run_once(std::size_t threads, int port, int seconds, int clients,
+                int range_bytes, bool sharded, int depth) {
+  auto app = std::make_unique<HttpServer>(std::make_pair("127.0.0.1", port));
+  app->thread_count(threads);
+  app->sharded(sharded);
+  app->router_.get("/data/");
+  app->router_.get("/data/<filename>", Handler(serve_range));
+
+  std::thread server([&app] { app->run(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  std::string request = "GET /data/bench HTTP/1.1\r\n"
+                        "Host: 127.0.0.1\r\n" +
+                        std::string(depth ? "" : "Connection: close\r\n") +
+                        "Range: bytes=0-" + std::to_string(range_bytes) +
+                        "\r\n\r\n";
+
+  std::atomic<bool> done{false};
+  std::atomic<long> completed{0};
+  std::vector<std::thread> workers;
+  for (int i = 0; i < clients; ++i) {
+    workers.emplace_back([&] {
+      while (!done) {
+        if (depth)
+          completed += fetch_keepalive(port, request, depth, done);
+        else if (fetch(port, request))
+          ++completed;
+      }
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  done = true;
+  for (auto &worker : workers)
+    worker.join();
+
+  app->stop();
+  server.join();
+
+  if (sharded) {
+    std::cout << "\tshard connections:";
+    for (auto count : app->connection_counts())
+      std::cout << " " << count;
+    std::cout << std::endl;
+  }
+  return static_cast<double>(completed) / seconds;
+}
+
+int main(int argc, char **argv) {
+  std::size_t max_threads =
+      argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+  int seconds = argc > 2 ? std::atoi(argv[2]) : 3;
+  int clients = argc > 3 ? std::atoi(argv[3]) : 32;
+  int range_bytes = argc > 4 ? std::atoi(argv[4]) : 1 << 20;
+  std::string modes = argc > 5 ? argv[5] : "";
+  bool sharded = modes.find("sharded") != std::string::npos;
+  int depth = modes.find("pipeline") != std::string::npos    ? 8
+              : modes.find("keepalive") != std::string::npos ? 1
+                                                             : 0;
+
+  make_data_file(range_bytes + 4096);
+
+  std::cout << "threads\trequests/s" << std::endl;
+  int port = 9900;
+  for (std::size_t threads = 1;; threads = std::min(threads * 2, max_threads)) {
+    auto throughput =
+        run_once(threads, port++, seconds, clients, range_bytes, sharded,
+                 depth);
+    std::cout << threads << "\t" << throughput << std::endl;
+    if (threads >= max_threads)
+      break;
+  }
+
+  return 0;
+}
@@ -0,0 +1,153 @@
+/**
+ * Latency of small ticket requests under each socket option
+ *
+ *    ./bin/bench_SocketOptions [requests] [clients]
+ *
+ * Each request is a new connection, as a client fetching one ticket makes,
+ * timed from socket() to the server closing it. Reports median and p99 in
+ * microseconds for
+ *    -- default,      no option set
+ *    -- defer_accept, TCP_DEFER_ACCEPT, acceptor woken by request bytes
+ *    -- fastopen,     TCP_FASTOPEN, request sent in the SYN, from the
+ *                     second connection on; the server side needs
+ *                     net.ipv4.tcp_fastopen to have bit 2 set, e.g. 3
+ *    -- cork,         TCP_CORK while flushing
+ *    -- buffers,      SO_SNDBUF and SO_RCVBUF of 256KB
+ *    -- backlog,      listen queue of 16, felt with many clients
+ */
+#include "asio.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Server.h"
+
+using namespace Http;
+using ClockType = std::chrono::steady_clock;
+
+static const std::string request = "GET /ticket HTTP/1.1\r\n"
+                                   "Host: 127.0.0.1\r\n"
+                                   "Connection: close\r\n\r\n";
+
+/**
+ * @brief   Microseconds to fetch a ticket on a new connection, -1 on error
+ */
+double fetch(const sockaddr_in &address, bool fastopen) {
+  auto start = ClockType::now();
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  auto addr = reinterpret_cast<const sockaddr *>(&address);
+  ssize_t sent = -1;
+#ifdef MSG_FASTOPEN
+  if (fastopen)
+    sent = ::sendto(fd, request.data(), request.size(), MSG_FASTOPEN, addr,
+                    sizeof(address));
+  else
+#endif
+  if (::connect(fd, addr, sizeof(address)) == 0)
+    sent = ::send(fd, request.data(), request.size(), 0);
+
+  char buffer[4096];
+  ssize_t n = 0, total = 0;
+  while (sent > 0 && (n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0)
+    total += n;
+  ::close(fd);
+  if (total == 0)
+    return -1;
+  return std::chrono::duration<double, std::micro>(ClockType::now() - start)
+      .count();
+}
+
+double percentile(std::vector<double> &v, double p) {
+  auto at = std::min(v.size() - 1, static_cast<std::size_t>(p * v.size()));
+  std::nth_element(v.begin(), v.begin() + at, v.end());
+  return v[at];
+}
+
+int main(int argc, char **argv) {
+  int requests = argc > 1 ? std::atoi(argv[1]) : 2000;
+  int clients = argc > 2 ? std::atoi(argv[2]) : 4;
+  int port = 9972;
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  ::inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+
+  using Tune = std::function<void(ConnectionOptions &)>;
+  std::vector<std::pair<std::string, Tune>> runs{
+      {"default", [](ConnectionOptions &) {}},
+      {"defer_accept",
+       [](ConnectionOptions &o) { o.defer_accept = std::chrono::seconds(5); }},
+      {"fastopen", [](ConnectionOptions &o) { o.fastopen_queue = 256; }},
+      {"cork", [](ConnectionOptions &o) { o.cork = true; }},
+      {"buffers",
+       [](ConnectionOptions &o) { o.send_buffer = o.receive_buffer = 256 * 1024; }},
+      {"backlog", [](ConnectionOptions &o) { o.backlog = 16; }}};
+
+  std::cout << "option\tmedian us\tp99 us\terrors" << std::endl;
+  for (auto &run : runs) {
+    auto app = std::make_unique<HttpServer>(std::make_pair("127.0.0.1", port));
+    app->thread_count(1);
+    run.second(app->connection_options_);
+    app->router_.get("/ticket", Handler([](Context &ctx) {
+                       ctx.res_.content_type(
+                           "application/vnd.ga4gh.htsget.v0.2rc+json; charset=utf-8");
+                       ctx.res_.write_json(
+                           {{"htsget",
+                             {{"format", "BAM"},
+                              {"urls",
+                               {{{"url", "https://127.0.0.1:8888/data/bamtest"},
+                                 {"headers", {{"Range", "bytes=0-1048575"}}}}}}}}});
+                     }));
+    std::thread runner([&app] { app->run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    bool fastopen = run.first == "fastopen";
+    // warms up, and gets a fast open cookie
+    fetch(address, fastopen);
+
+    std::vector<std::vector<double>> times(clients);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; ++c)
+      threads.emplace_back([&, c] {
+        for (int i = 0; i < requests / clients; ++i)
+          times[c].push_back(fetch(address, fastopen));
+      });
+    for (auto &thread : threads)
+      thread.join();
+
+    std::vector<double> all;
+    int errors = 0;
+    for (auto &client : times)
+      for (auto t : client) {
+        if (t < 0)
+          ++errors;
+        else
+          all.push_back(t);
+      }
+    std::cout << run.first << "\t" << (all.empty() ? 0 : percentile(all, 0.5))
+              << "\t" << (all.empty() ? 0 : percentile(all, 0.99)) << "\t"
+              << errors << std::endl;
+
+    app->stop();
+    runner.join();
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * Cost of connection deadlines, per-connection timer vs shared TimerWheel
+ *
+ *    ./bin/bench_TimerWheel [connections] [rounds]
+ *
+ * Keeps connections deadlines armed at once, as many idle or slow
+ * connections would, then re-arms each once per round, as Connection does
+ * on every read, and cancels half of them, as on every accepted request.
+ * Reports ns per re-arm and per cancel for
+ *    -- waitable_timer,  asio::basic_waitable_timer per connection
+ *    -- wheel,           one TimerWheel for the io_service
+ */
+#include "asio.hpp"
+#include "asio/basic_waitable_timer.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "TimerWheel.h"
+
+using namespace Http;
+using ClockType = std::chrono::steady_clock;
+
+struct Result {
+  double arm;
+  double cancel;
+};
+
+template <typename Arm, typename Cancel>
+Result measure(int connections, int rounds, Arm arm, Cancel cancel) {
+  for (int i = 0; i < connections; ++i)
+    arm(i, i);
+
+  auto start = ClockType::now();
+  for (int round = 1; round <= rounds; ++round)
+    for (int i = 0; i < connections; ++i)
+      arm(i, i + round);
+  auto armed = ClockType::now();
+
+  for (int i = 0; i < connections; i += 2)
+    cancel(i);
+  auto cancelled = ClockType::now();
+
+  auto ns = [](ClockType::duration d) {
+    return std::chrono::duration<double, std::nano>(d).count();
+  };
+  return {ns(armed - start) / (double(connections) * rounds),
+          ns(cancelled - armed) / (connections / 2)};
+}
+
+int main(int argc, char **argv) {
+  int connections = argc > 1 ? std::atoi(argv[1]) : 50000;
+  int rounds = argc > 2 ? std::atoi(argv[2]) : 20;
+
+  // spread deadlines over 5s to 15s, like read and idle timeouts
+  auto timeout = [connections](int i) {
+    return std::chrono::seconds(5) +
+           std::chrono::milliseconds(i % connections * 10000 / connections);
+  };
+
+  std::cout << "deadline\tns/arm\tns/cancel" << std::endl;
+  {
+    asio::io_service io;
+    std::vector<std::unique_ptr<asio::basic_waitable_timer<ClockType>>> timers;
+    for (int i = 0; i < connections; ++i)
+      timers.push_back(
+          std::make_unique<asio::basic_waitable_timer<ClockType>>(io));
+
+    auto result = measure(connections, rounds,
+                          [&](int i, int j) {
+                            timers[i]->expires_from_now(timeout(j));
+                            timers[i]->async_wait([](std::error_code) {});
+                          },
+                          [&](int i) { timers[i]->cancel(); });
+    std::cout << "waitable_timer\t" << result.arm << "\t" << result.cancel
+              << std::endl;
+  }
+  {
+    asio::io_service io;
+    auto &wheel = asio::use_service<TimerWheel>(io);
+    std::vector<TimerWheel::Timer> timers(connections);
+
+    auto result =
+        measure(connections, rounds,
+                [&](int i, int j) { wheel.arm(timers[i], timeout(j), [] {}); },
+                [&](int i) { wheel.cancel(timers[i]); });
+    std::cout << "wheel\t" << result.arm << "\t" << result.cancel << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,189 @@
+/**
+ * HttpsServer handshake rate and time to first byte
+ *
+ *    ./bin/bench_Tls [seconds] [clients] [body_bytes]
+ *
+ * Reports
+ *    -- handshakes/s, full and resumed, clients connect, handshake, close
+ *    -- time to first byte of body and to last byte, for a 2KB ticket like
+ *       JSON body and a body_bytes one, with records sized dynamically and
+ *       with 16KB records throughout
+ * Run from repository root, for Http/ssl.
+ */
+#include "asio.hpp"
+#include "asio/ssl.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Server.h"
+
+using namespace Http;
+using ClockType = std::chrono::steady_clock;
+
+asio::ip::tcp::endpoint endpoint(int port) {
+  return {asio::ip::address::from_string("127.0.0.1"),
+          static_cast<unsigned short>(port)};
+}
+
+/**
+ * @brief   Server with /body/<n> answering n bytes
+ */
+std::unique_ptr<HttpsServer> start(int port, bool small_records,
+                                   std::thread &runner) {
+  auto app = std::make_unique<HttpsServer>(std::make_pair("127.0.0.1", port));
+  app->thread_count(1);
+  if (!small_records)
+    app->connection_options_.tls_small_record_bytes = 0;
+  app->router_.get("/body/");
+  app->router_.get("/body/<n>", Handler([](Context &ctx) {
+                     ctx.res_.write_text(
+                         std::string(std::stoul(ctx.param_["n"]), 'A'));
+                   }));
+  runner = std::thread([&app] { app->run(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  return app;
+}
+
+double handshakes_per_second(int port, int seconds, int clients, bool resume) {
+  std::thread runner;
+  auto app = start(port, true, runner);
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> workers;
+  for (int i = 0; i < clients; ++i) {
+    workers.emplace_back([&] {
+      asio::io_service io_service;
+      asio::ssl::context context(asio::ssl::context::sslv23);
+      SSL_SESSION *session = nullptr;
+      while (!done) {
+        try {
+          asio::ssl::stream<asio::ip::tcp::socket> stream(io_service, context);
+          stream.lowest_layer().connect(endpoint(port));
+          stream.lowest_layer().set_option(asio::ip::tcp::no_delay(true));
+          if (resume && session)
+            SSL_set_session(stream.native_handle(), session);
+          stream.handshake(asio::ssl::stream_base::client);
+          // a request lets TLS 1.3 session tickets arrive
+          asio::write(stream, asio::buffer(std::string(
+                                  "GET /body/1 HTTP/1.1\r\n"
+                                  "Connection: close\r\n\r\n")));
+          asio::error_code ec;
+          std::array<char, 1024> buf;
+          while (!ec)
+            stream.read_some(asio::buffer(buf), ec);
+          SSL_set_shutdown(stream.native_handle(),
+                           SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+          if (resume) {
+            if (session)
+              SSL_SESSION_free(session);
+            session = SSL_get1_session(stream.native_handle());
+          }
+        } catch (const std::exception &) {
+        }
+      }
+      if (session)
+        SSL_SESSION_free(session);
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  done = true;
+  for (auto &worker : workers)
+    worker.join();
+
+  app->stop();
+  runner.join();
+  auto &sessions = app->tls_sessions_;
+  return static_cast<double>(resume ? sessions.resumed_handshakes_
+                                    : sessions.full_handshakes_) /
+         seconds;
+}
+
+struct Timing {
+  double first_byte_us;
+  double last_byte_us;
+};
+
+/**
+ * @brief   Median over requests on fresh connections, after handshake
+ */
+Timing time_to_bytes(int port, bool small_records, std::size_t body_bytes,
+                     int requests) {
+  std::thread runner;
+  auto app = start(port, small_records, runner);
+  std::string request = "GET /body/" + std::to_string(body_bytes) +
+                        " HTTP/1.1\r\nConnection: close\r\n\r\n";
+
+  std::vector<double> first, last;
+  asio::io_service io_service;
+  asio::ssl::context context(asio::ssl::context::sslv23);
+  for (int i = 0; i < requests; ++i) {
+    asio::ssl::stream<asio::ip::tcp::socket> stream(io_service, context);
+    stream.lowest_layer().connect(endpoint(port));
+    stream.lowest_layer().set_option(asio::ip::tcp::no_delay(true));
+    stream.handshake(asio::ssl::stream_base::client);
+
+    auto sent = ClockType::now();
+    asio::write(stream, asio::buffer(request));
+
+    asio::error_code ec;
+    std::array<char, 65536> buf;
+    std::size_t received = 0;
+    ClockType::time_point first_at;
+    while (!ec) {
+      auto n = stream.read_some(asio::buffer(buf), ec);
+      if (!received && n)
+        first_at = ClockType::now();
+      received += n;
+    }
+    auto last_at = ClockType::now();
+
+    auto us = [](ClockType::duration d) {
+      return std::chrono::duration<double, std::micro>(d).count();
+    };
+    first.push_back(us(first_at - sent));
+    last.push_back(us(last_at - sent));
+  }
+
+  app->stop();
+  runner.join();
+
+  auto median = [](std::vector<double> &v) {
+    std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+    return v[v.size() / 2];
+  };
+  return {median(first), median(last)};
+}
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? std::atoi(argv[1]) : 3;
+  int clients = argc > 2 ? std::atoi(argv[2]) : 4;
+  std::size_t body_bytes = argc > 3 ? std::atoi(argv[3]) : 1 << 20;
+
+  int port = 9960;
+  std::cout << "handshake\tper second" << std::endl;
+  std::cout << "full\t" << handshakes_per_second(port++, seconds, clients, false)
+            << std::endl;
+  std::cout << "resumed\t" << handshakes_per_second(port++, seconds, clients, true)
+            << std::endl;
+
+  std::cout << "body\trecords\tfirst byte us\tlast byte us" << std::endl;
+  for (std::size_t bytes : {std::size_t(2048), body_bytes}) {
+    for (bool small_records : {true, false}) {
+      auto timing = time_to_bytes(port++, small_records, bytes, 50);
+      std::cout << bytes << "\t" << (small_records ? "dynamic" : "16KB")
+                << "\t" << timing.first_byte_us << "\t" << timing.last_byte_us
+                << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,156 @@
+/**
+ * Request rates over loopback TCP and a Unix socket, as a local proxy sees
+ *
+ *    ./bin/bench_UnixSocket [seconds] [clients] [body_bytes]
+ *
+ * One server listens on both, routes serving a body of body_bytes, and
+ * reports requests/s for each of
+ *    -- connection, one request per connection, read until server closes
+ *    -- keepalive,  requests back to back on one connection, as a proxy
+ *                   keeping upstream connections open does
+ */
+#include "asio.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Server.h"
+
+using namespace Http;
+
+static const std::string unix_path = "/tmp/bench_UnixSocket.sock";
+
+/**
+ * @brief   One request per connection, read until server closes
+ */
+template <typename Protocol>
+bool fetch(const typename Protocol::endpoint &endpoint,
+           const std::string &request) {
+  try {
+    asio::io_service io_service;
+    typename Protocol::socket socket(io_service);
+    socket.connect(endpoint);
+    asio::write(socket, asio::buffer(request));
+
+    std::array<char, 65536> buf;
+    asio::error_code ec;
+    std::size_t total = 0;
+    while (!ec)
+      total += socket.read_some(asio::buffer(buf), ec);
+    return total > 0;
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+
+/**
+ * @brief   Requests on one connection until done or server closes it,
+ *          response is delimited by Content-Length, returns responses read
+ */
+template <typename Protocol>
+long fetch_keepalive(const typename Protocol::endpoint &endpoint,
+                     const std::string &request, std::atomic<bool> &done) {
+  long completed = 0;
+  try {
+    asio::io_service io_service;
+    typename Protocol::socket socket(io_service);
+    socket.connect(endpoint);
+
+    asio::streambuf buf;
+    while (!done) {
+      asio::write(socket, asio::buffer(request));
+
+      auto header_bytes = asio::read_until(socket, buf, "\r\n\r\n");
+      std::string header(asio::buffers_begin(buf.data()),
+                         asio::buffers_begin(buf.data()) + header_bytes);
+      buf.consume(header_bytes);
+
+      auto pos = header.find("Content-Length: ");
+      std::size_t length =
+          pos == std::string::npos ? 0 : std::stoul(header.substr(pos + 16));
+      if (buf.size() < length)
+        asio::read(socket, buf, asio::transfer_exactly(length - buf.size()));
+      buf.consume(length);
+      ++completed;
+
+      if (header.find("Connection: close") != std::string::npos)
+        return completed;
+    }
+  } catch (const std::exception &) {
+  }
+  return completed;
+}
+
+/**
+ * @brief   Requests/s of clients fetching from endpoint for seconds
+ */
+template <typename Protocol>
+double run_once(const typename Protocol::endpoint &endpoint, int seconds,
+                int clients, bool keepalive) {
+  std::string request = "GET /body HTTP/1.1\r\n"
+                        "Host: 127.0.0.1\r\n" +
+                        std::string(keepalive ? "" : "Connection: close\r\n") +
+                        "\r\n";
+
+  std::atomic<bool> done{false};
+  std::atomic<long> completed{0};
+  std::vector<std::thread> workers;
+  for (int i = 0; i < clients; ++i) {
+    workers.emplace_back([&] {
+      while (!done) {
+        if (keepalive)
+          completed += fetch_keepalive<Protocol>(endpoint, request, done);
+        else if (fetch<Protocol>(endpoint, request))
+          ++completed;
+      }
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  done = true;
+  for (auto &worker : workers)
+    worker.join();
+  return static_cast<double>(completed) / seconds;
+}
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? std::atoi(argv[1]) : 3;
+  int clients = argc > 2 ? std::atoi(argv[2]) : 8;
+  std::size_t body_bytes = argc > 3 ? std::atoi(argv[3]) : 1024;
+  int port = 9973;
+
+  auto app = std::make_unique<HttpServer>(std::make_pair("127.0.0.1", port));
+  app->thread_count(std::thread::hardware_concurrency());
+  app->unix_path(unix_path);
+  app->connection_options_.max_requests = 1 << 30;
+  std::string body(body_bytes, 'A');
+  app->router_.get("/body", Handler([&body](Context &ctx) {
+                     ctx.res_.write_text(body);
+                   }));
+  std::thread server([&app] { app->run(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  asio::ip::tcp::endpoint tcp(asio::ip::address::from_string("127.0.0.1"),
+                              static_cast<unsigned short>(port));
+  asio::local::stream_protocol::endpoint uds(unix_path);
+
+  std::cout << "mode\ttcp requests/s\tunix requests/s" << std::endl;
+  for (bool keepalive : {false, true}) {
+    auto tcp_rate = run_once<asio::ip::tcp>(tcp, seconds, clients, keepalive);
+    auto uds_rate = run_once<asio::local::stream_protocol>(uds, seconds,
+                                                           clients, keepalive);
+    std::cout << (keepalive ? "keepalive" : "connection") << "\t" << tcp_rate
+              << "\t" << uds_rate << std::endl;
+  }
+
+  app->stop();
+  server.join();
+  return 0;
+}
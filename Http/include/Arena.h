@@ -0,0 +1,142 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace Http {
+
+/**
+ * @brief   Monotonic allocator of a connection's per-request data
+ *
+ *  Allocations bump a pointer through a chain of blocks and are never
+ *  freed one by one. reset() rewinds to the first block in O(1), keeping
+ *  every block, so a connection stops allocating once its arena has grown
+ *  to fit its largest request
+ *
+ *    Arena arena;
+ *    auto p = arena.allocate(64);
+ *    arena.reset(); // p, and all else allocated, is gone
+ */
+class Arena {
+public:
+  static constexpr std::size_t block_size = 4096; // of the first block
+
+public:
+  /* non-copy-constructible */
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  explicit Arena(std::size_t first_block_size = block_size)
+      : first_block_size_(std::max<std::size_t>(first_block_size, 64)){};
+
+  /**
+   * @brief   Storage of bytes aligned to align, a power of two,
+   *          valid until reset() or destruction
+   */
+  auto allocate(std::size_t bytes, std::size_t align = alignof(std::max_align_t))
+      -> void * {
+    for (;;) {
+      if (current_ < blocks_.size()) {
+        auto &block = blocks_[current_];
+        auto offset = (offset_ + align - 1) & ~(align - 1);
+        if (offset + bytes <= block.size_) {
+          offset_ = offset + bytes;
+          return block.data_.get() + offset;
+        }
+        if (current_ + 1 < blocks_.size()) {
+          ++current_;
+          offset_ = 0;
+          continue;
+        }
+      }
+      // doubles, at least fits bytes at any alignment
+      auto size = blocks_.empty() ? first_block_size_ : 2 * blocks_.back().size_;
+      size = std::max(size, bytes + align);
+      blocks_.push_back({std::unique_ptr<char[]>(new char[size]), size});
+      current_ = blocks_.size() - 1;
+      offset_ = 0;
+    }
+  }
+
+  /**
+   * @brief   Frees everything allocated, blocks are kept for reuse
+   */
+  void reset() {
+    current_ = 0;
+    offset_ = 0;
+  }
+
+  /**
+   * @brief   Number of blocks, and bytes in them
+   */
+  std::size_t block_count() const { return blocks_.size(); }
+  std::size_t capacity() const {
+    std::size_t bytes = 0;
+    for (const auto &block : blocks_)
+      bytes += block.size_;
+    return bytes;
+  }
+
+private:
+  struct Block {
+    std::unique_ptr<char[]> data_;
+    std::size_t size_;
+  };
+
+  std::vector<Block> blocks_;
+  std::size_t current_ = 0; // block allocated from
+  std::size_t offset_ = 0;  // into current block
+  std::size_t first_block_size_;
+};
+
+/**
+ * @brief   Standard allocator drawing from an Arena, deallocate is a no-op
+ *          Default constructed, or copied along with a container,
+ *          falls back to the heap, so copies never share an arena
+ *          Moved or swapped containers take their arena with them
+ */
+template <typename T> class ArenaAllocator {
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::false_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  ArenaAllocator() = default;
+  explicit ArenaAllocator(Arena *arena) : arena_(arena){};
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena_){};
+
+  auto allocate(std::size_t n) -> T * {
+    if (!arena_)
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+    return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *p, std::size_t) {
+    if (!arena_)
+      ::operator delete(p);
+  }
+
+  auto select_on_container_copy_construction() const -> ArenaAllocator {
+    return {};
+  }
+
+  Arena *arena_ = nullptr; // heap if null
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return a.arena_ == b.arena_;
+}
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return !(a == b);
+}
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <string>
+
+namespace Http {
+
+/**
+ * @brief   Content codings a response body may be compressed with
+ *          zstd only if built with libzstd, i.e. HTTP_ZSTD defined
+ */
+enum class ContentCoding { identity, gzip, deflate, zstd };
+
+/**
+ * @brief   Token of coding, as in Content-Encoding
+ */
+auto coding_to_string(ContentCoding coding) -> const char *;
+
+/**
+ * @brief   Whether coding can be produced by this build
+ */
+bool coding_available(ContentCoding coding);
+
+/**
+ * @brief   Coding of highest q-value in accept_encoding, an Accept-Encoding
+ *          value, among those available, zstd, gzip then deflate on ties
+ *          identity if none is acceptable, or the header is empty
+ */
+auto negotiate_coding(const std::string &accept_encoding) -> ContentCoding;
+
+/**
+ * @brief   Compresses in with coding into out, at level of its codec,
+ *          negative for its default
+ *          false if coding is unavailable or compression fails
+ *          Codec state is kept per thread, reused across calls
+ */
+bool compress(ContentCoding coding, const std::string &in, std::string &out,
+              int level = -1);
+}
+
+#endif
@@ -3,60 +3,162 @@
 
 #include "asio.hpp"
 #include "asio/ssl.hpp"
-#include "asio/basic_waitable_timer.hpp"
 
 
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <type_traits>
 #include <chrono>
 #include <utility>
 #include <iostream>
+#include <vector>
 
+#include "HandlerMemory.h"
+#include "Ktls.h"
 #include "Request.h"
 #include "RequestParser.h"
 #include "Response.h"
 #include "Router.h"
+#include "ThreadPool.h"
+#include "TimerWheel.h"
 
 namespace Http {
 
 using TcpSocket = asio::ip::tcp::socket;
 using SslSocket = asio::ssl::stream<asio::ip::tcp::socket>;
+using UnixSocket = asio::local::stream_protocol::socket;
 using ClockType = std::chrono::steady_clock;
 
+/**
+ * @brief   Socket under any TLS, written to directly when zero_copy_
+ */
+inline auto tcp_layer(TcpSocket &socket) -> TcpSocket & { return socket; }
+inline auto tcp_layer(SslSocket &socket) -> TcpSocket & { return socket.next_layer(); }
+inline auto tcp_layer(UnixSocket &socket) -> UnixSocket & { return socket; }
+
+/**
+ * @brief   Limits applied to every connection of a server
+ */
+struct ConnectionOptions {
+  ClockType::duration read_timeout = std::chrono::seconds(2);  // reading a request
+  ClockType::duration idle_timeout = std::chrono::seconds(5);  // awaiting next request
+  ClockType::duration write_timeout = std::chrono::seconds(30); // writing responses, without progress
+  std::size_t max_requests = 100; // served on one connection before closing it
+  std::size_t max_pipeline_depth = 16;       // responses queued before writing
+  std::size_t write_batch_bytes = 64 * 1024; // bytes queued before writing
+  std::size_t send_window = 256 * 1024; // bytes per write, and streamed bytes queued before producers park, 0 for no limit
+  std::size_t min_send_rate = 1024; // bytes/s, below which writing closes once past write_timeout, 0 for none
+  std::size_t max_connections = 0;    // open at once, 0 for no limit
+  bool shed_tls_before_handshake = false; // TLS connections over max_connections closed, rather than sent a 503 after the handshake
+  std::size_t max_blocking_queue = 0; // blocking handlers awaiting a thread, 0 for no limit
+  std::chrono::seconds retry_after = std::chrono::seconds(1); // sent with 503
+  bool ktls = false; // HTTPS responses encrypted by kernel TLS, when loaded
+  std::size_t tls_small_record = 1360;          // TLS payload fitting one TCP segment
+  std::size_t tls_small_record_bytes = 64 * 1024; // sent in small records, then 16KB, 0 for none
+  ClockType::duration tls_record_reset = std::chrono::seconds(1); // idle before records shrink again
+  bool http2 = true; // h2 by ALPN over TLS, h2c with prior knowledge over TCP
+  std::size_t http2_max_streams = 100; // concurrent streams of an HTTP/2 connection
+  std::size_t connection_pool_size = 256; // closed connections kept for reuse per io_service, 0 for none
+  /* of the listening socket, accepted sockets inherit them */
+  int backlog = asio::socket_base::max_connections; // listen queue length
+  std::chrono::seconds defer_accept = std::chrono::seconds(0); // TCP_DEFER_ACCEPT, accept once request bytes arrive, 0 for off
+  int fastopen_queue = 0; // TCP_FASTOPEN, pending data-carrying SYNs, 0 for off
+  int send_buffer = 0;    // SO_SNDBUF bytes, 0 for kernel default
+  int receive_buffer = 0; // SO_RCVBUF bytes, 0 for kernel default
+  bool cork = false; // TCP_CORK while flushing, responses leave in full segments
+};
+
+/**
+ * @brief   Load shedding state shared by connections of a server
+ *          A connection or request over a limit gets overloaded_, 
+ *          a prepared 503, instead of running handlers
+ *          A TLS connection over max_connections costs a full handshake
+ *          for its 503, a client told to retry later; with
+ *          shed_tls_before_handshake it is closed instead, sparing the
+ *          handshake when that is what overloads the server, the client
+ *          seeing only a reset
+ */
+struct AdmissionControl {
+  /**
+   * @brief   Prepares the 503 sent when shedding
+   */
+  void prepare(const ConnectionOptions &options) {
+    overloaded_ = Response();
+    overloaded_.status_code(StatusCode::Service_Unavailable);
+    overloaded_.set_header({"Retry-After", std::to_string(options.retry_after.count())});
+    overloaded_.content_length(0);
+    overloaded_.set_header({"Connection", "close"});
+    overloaded_payload_ = std::make_shared<const std::string>(overloaded_.to_payload());
+  }
+
+  Response overloaded_; // for HTTP/2 streams, which encode headers each
+  std::shared_ptr<const std::string> overloaded_payload_; // HTTP/1.x, sent as is
+  std::atomic<std::size_t> open_connections_{0};
+  std::atomic<std::size_t> shed_connections_{0}; // over max_connections
+  std::atomic<std::size_t> shed_requests_{0};    // over a handler's max_in_flight
+  std::atomic<std::size_t> shed_blocking_{0};    // over max_blocking_queue
+  std::atomic<std::size_t> unsent_bytes_{0}; // of queued response bodies and chunks
+  std::atomic<bool> draining_{false}; // listeners handed off, no keep-alive
+};
+
+template <typename SocketType> class Http2Session;
+template <typename SocketType> class ConnectionPool;
 
 template <typename SocketType>
 class Connection : public std::enable_shared_from_this<Connection<SocketType>> {
 
 public:
-  using DeadlineTimer = asio::basic_waitable_timer<ClockType>;
-  static constexpr auto max_time = ClockType::duration::max();
-  static constexpr auto read_timeout = std::chrono::seconds(2);
+  static constexpr std::size_t file_chunk_size = 64 * 1024;
 
-public:
-  explicit Connection(asio::io_service& io_service, Router<Handler> &router)
+  explicit Connection(asio::io_service& io_service, Router<Handler> &router,
+                      ThreadPool &blocking_executor,
+                      const ConnectionOptions &options,
+                      AdmissionControl &admission)
       : socket_(io_service),
-        read_deadline_(io_service),
-        router_(router){
-          read_deadline_.expires_from_now(max_time);
+        strand_(io_service),
+        timer_wheel_(asio::use_service<TimerWheel>(io_service)),
+        router_(router),
+        blocking_executor_(blocking_executor),
+        options_(options),
+        admission_(admission){
+          context_.io_service_ = &io_service;
+          request_.use_arena(arena_);
         };
 
   explicit Connection(
-    asio::io_service& io_service, asio::ssl::context& context, Router<Handler> &router)
+    asio::io_service& io_service, asio::ssl::context& context, Router<Handler> &router,
+    ThreadPool &blocking_executor, const ConnectionOptions &options,
+    AdmissionControl &admission)
       : socket_(io_service, context),
-        read_deadline_(io_service),
-        router_(router){
-          read_deadline_.expires_from_now(max_time);
+        strand_(io_service),
+        timer_wheel_(asio::use_service<TimerWheel>(io_service)),
+        router_(router),
+        blocking_executor_(blocking_executor),
+        options_(options),
+        admission_(admission){
+          context_.io_service_ = &io_service;
+          request_.use_arena(arena_);
+          if (options_.ktls)
+            ktls_session(socket_.native_handle());
         };
 
+  ~Connection() {
+    if (counted_)
+      --admission_.open_connections_;
+    admission_.unsent_bytes_ -= outgoing_bytes_ + chunk_bytes_;
+  }
 
 public:
   /**
    * @brief   Starts reading asynchronously
    *          For TLS, do handshake first
+   *          Binds context_ to this connection
    */
   void start();
 
   /**
-   * @brief   Stops timer 
+   * @brief   Stops timer, for good
    */
   void stop();
 
@@ -65,39 +167,354 @@ public:
    */
   void terminate();
 
+  /**
+   * @brief   Closes socket and resets state, for the connection to be
+   *          accepted into again, called by ConnectionPool on release
+   *          false if it cannot be, i.e. a TLS stream, or pooling is off
+   */
+  bool recycle();
+
 
   /**
    * @brief   Read some from socket and save to buffer
-   *          Parses request and executes handlers
+   *          Then parse_buffered()
    */
   void read();
 
   /**
-   * @brief   Write buffer to socket 
-   *          Call terminate()
+   * @brief   Parses bytes left in buffer_ into request_
+   *          Once buffer_ is used up, flush() queued responses, then read()
+   *          A follow-up request not arriving within idle_timeout closes
+   *          the connection
+   */
+  void parse_buffered();
+
+  /**
+   * @brief   Resolves handlers for an accepted request and runs them
+   *          Sheds request if connection or any handler is over its limit
+   */
+  void handle();
+
+  /**
+   * @brief   Counts connection as open, shed_ if over max_connections
+   */
+  void admit();
+
+  /**
+   * @brief   Takes an in-flight slot of every capped handler in handlers_,
+   *          false, with none taken, if one is full
+   */
+  bool admit_handlers();
+
+  /**
+   * @brief   Queues prepared 503 and closes after writing it
+   */
+  void send_overloaded();
+
+  /**
+   * @brief   Resets request/response state for the next request,
+   *          gives back in-flight slots taken by admit_handlers(),
+   *          rewinds arena_
+   */
+  void reset();
+
+  /**
+   * @brief   Runs handlers_ from i-th onwards, then write()
+   *          A blocking handler runs on blocking_executor_, 
+   *          the remaining handlers resume on strand_ once it returns
+   */
+  void run_handlers(std::size_t i);
+
+  /**
+   * @brief   Backs Context::defer() for the handler being run
+   *          Completion resumes run_handlers() on strand_ with the next handler
+   */
+  auto defer() -> Context::Completion;
+
+  /**
+   * @brief   Called once a handler returns,
+   *          true if it deferred and its completion has not been called yet
+   */
+  bool suspended();
+
+  /**
+   * @brief   Queues response_ and resets request/response state
+   *          Pipelined requests in buffer_ are handled before flush(),
+   *          up to max_pipeline_depth responses or write_batch_bytes
+   *          If streaming_, end_stream() instead
    */
   void write();
 
+  /**
+   * @brief   Writes queued responses in order, in one gathered write,
+   *          save for file bodies, each sent right after its head
+   *          Then parse_buffered() if keep_alive_, otherwise terminate()
+   */
+  void flush();
+
+  /**
+   * @brief   Writes outgoing_ from i-th response onwards
+   */
+  void send_queued(std::size_t i);
+
+  /**
+   * @brief   Sends file body of i-th response, range by range with
+   *          next_part(), then send_queued(i + 1)
+   *          If zero_copy_, by sendfile(2), data never leaves the kernel
+   *          Otherwise copy_file()
+   */
+  void send_file(std::size_t i);
+
+  /**
+   * @brief   Sends file body of i-th response through file_buffer_
+   */
+  void copy_file(std::size_t i);
+
+  /**
+   * @brief   Writes text before the next range of i-th response's file
+   *          body, or after the last one, then send_file(i)
+   *          false if nothing is left to write
+   */
+  bool next_part(std::size_t i);
+
+  /**
+   * @brief   Holds back partial frames while head and file body are sent,
+   *          so that they share packets, if zero_copy_
+   *          With options_.cork, held for all of flush(), of any TCP socket
+   */
+  void cork(bool enable);
+
+  /**
+   * @brief   Writes gathered_, send_window at a time, as split by
+   *          size_records(), then send_file(j) if file_follows,
+   *          otherwise finish_flush()
+   */
+  void send_gathered(std::size_t j, bool file_follows);
+
+  /**
+   * @brief   Completion condition of a write, as transfer_all(), that
+   *          counts each part of it sent in keep_pace(), so that a write of
+   *          send_window is judged by min_send_rate as it goes, rather than
+   *          once done. Stops the write short once below min_send_rate
+   */
+  auto paced() {
+    return [this, counted = std::size_t{0}](const auto &ec,
+                                            std::size_t total) mutable {
+      auto bytes = total - counted;
+      counted = total;
+      if (ec || (bytes && !keep_pace(bytes)))
+        return std::size_t{0};
+      return asio::transfer_all()(ec, total);
+    };
+  }
+
+  /**
+   * @brief   Picks TLS record size for next of bytes to write, returns how
+   *          many of them to write in records of that size, SslSocket only
+   *          Small records, each decrypted as soon as its TCP segment arrives,
+   *          until tls_small_record_bytes sent, then 16KB for bulk throughput
+   */
+  auto size_records(std::size_t bytes) -> std::size_t;
+
+  /**
+   * @brief   Counts bytes just written, rearms deadline_,
+   *          false if writing fell below min_send_rate, once past write_timeout
+   */
+  bool keep_pace(std::size_t bytes);
+
+  /**
+   * @brief   Clears outgoing_, calls back chunks written,
+   *          then send_chunks() if streaming_,
+   *          otherwise parse_buffered() if ok and keep_alive_,
+   *          otherwise terminate()
+   */
+  void finish_flush(bool ok);
+
+  /**
+   * @brief   Backs Context::stream() for the current request
+   */
+  auto stream() -> Context::StreamPtr;
+
+  /**
+   * @brief   Queues chunk of the id-th stream, aborted if that one has ended
+   */
+  void write_chunk(std::size_t id, std::string chunk, BodyStream::Callback on_written);
+
+  /**
+   * @brief   Backs BodyStream::when_writable() of the id-th stream,
+   *          resume is parked while chunks_ hold send_window bytes or more
+   */
+  void when_writable(std::size_t id, std::function<void()> resume);
+
+  /**
+   * @brief   Resumes parked producers, once chunks_ are below send_window
+   *          or connection stopped
+   */
+  void resume_parked();
+
+  /**
+   * @brief   Queues head of response_, framed for a body of unknown length,
+   *          with what is in its body so far as the first chunk
+   */
+  void start_stream();
+
+  /**
+   * @brief   Queues last chunk with trailers_, resets request/response state
+   */
+  void end_stream();
+
+  /**
+   * @brief   Writes queued head, then chunks_ up to write_batch_bytes at a time,
+   *          unless a write is in progress
+   *          Once the last chunk is out, finish_flush() as for any response
+   */
+  void send_chunks();
+
+  /**
+   * @brief   Arms deadline_ on the io_service's TimerWheel,
+   *          check_deadline() runs on strand_ once it expires
+   */
+  void arm_deadline(ClockType::duration timeout);
+
   /**
    * @brief   Checks deadline expiration, 
-   *          If expired, terminates connection 
-   *          Otherwise, put timer on async wait for 
-   *            -# on expiration 
-   *            -# on cancel
+   *          If expired while idle or writing, terminates connection 
+   *          If expired while reading a request, sends 408
    */
-  void check_read_deadline();
+  void check_deadline();
   void send_read_timeout();
 
+  /**
+   * @brief   Reads rest of the HTTP/2 client preface begun in buffer_,
+   *          then start_http2()
+   */
+  void read_preface();
+
+  /**
+   * @brief   Hands socket over to an Http2Session, with what is left in buffer_
+   */
+  void start_http2();
+
+  /**
+   * @brief   handler, to run on strand_, allocated from handler_memory_,
+   *          along with the operation it completes
+   */
+  template <typename Handler> auto wrap(Handler handler) {
+    return strand_.wrap(bind_memory(handler_memory_, std::move(handler)));
+  }
+  template <typename Handler> void post(Handler handler) {
+    strand_.post(bind_memory(handler_memory_, std::move(handler)));
+  }
+
 public:
   SocketType socket_;
+
+  /**
+   * @brief   Writes of response bytes started, exposed for tests
+   */
+  auto write_count() const -> std::size_t { return write_count_; }
+
 private:
+  friend class Http2Session<SocketType>;
+  friend class ConnectionPool<SocketType>;
+
+  /**
+   * @brief   BodyStream handed to handlers, queues chunks on strand_,
+   *          in order with the handler's completion
+   */
+  class ChunkedStream : public BodyStream {
+  public:
+    ChunkedStream(std::shared_ptr<Connection> connection, std::size_t id)
+        : connection_(std::move(connection)), id_(id){};
+
+    void write(std::string chunk, Callback on_written = nullptr) override {
+      auto connection = connection_;
+      auto id = id_;
+      connection->strand_.dispatch(
+        [connection, id, chunk = std::move(chunk), on_written]() mutable {
+          connection->write_chunk(id, std::move(chunk), std::move(on_written));
+        });
+    }
+    void trailer(Message::HeaderType header) override {
+      auto connection = connection_;
+      auto id = id_;
+      connection->strand_.dispatch([connection, id, header] {
+        if (id == connection->stream_id_)
+          connection->trailers_.push_back(header);
+      });
+    }
+    void when_writable(std::function<void()> resume) override {
+      auto connection = connection_;
+      auto id = id_;
+      connection->strand_.dispatch([connection, id, resume] {
+        connection->when_writable(id, std::move(resume));
+      });
+    }
+
+  private:
+    std::shared_ptr<Connection> connection_;
+    std::size_t id_; // of stream on connection_, chunks of an ended one are aborted
+  };
+
+  struct Chunk {
+    std::string size_line_; // hex size, empty if not chunked
+    std::string data_;
+    BodyStream::Callback on_written_;
+  };
+
+  /* serializes read/write/deadline handlers when io_service_ runs on many threads */
+  asio::io_service::strand strand_;
+  HandlerMemory handler_memory_; // of operations in flight, see wrap()
   std::array<char, 4096> buffer_;
-  DeadlineTimer read_deadline_;
+  std::size_t buffer_begin_ = 0; // [begin, end) of buffer_ not yet parsed
+  std::size_t buffer_end_ = 0;
+  TimerWheel &timer_wheel_;   // shared by connections of the io_service
+  TimerWheel::Timer deadline_; // read, idle or write deadline
+  Arena arena_;      // param_ and query_ of request_, reset between requests
   Request request_;
   Response response_;
+  std::vector<Response> outgoing_;    // responses to write, in request order
+  std::size_t outgoing_bytes_ = 0;    // of bodies in outgoing_, unsent until written
+  std::vector<asio::const_buffer> gathered_; // left to write by send_gathered()
+  std::vector<char> file_buffer_;     // file body chunk, when not sendfile(2)
+  std::string file_text_;             // between ranges of a multipart file body
+  std::size_t record_bytes_ = 0;      // sent since TLS records were last small
+  ClockType::time_point last_write_;  // of TLS records
   Context context_{request_, response_};
   RequestParser request_parser_;
   Router<Handler> &router_;
+  std::vector<Handler> handlers_; // resolved for current request
+  std::size_t next_handler_ = 0;  // index run_handlers() resumes from
+  /* outstanding of {handler returned, completion called}, for a deferred handler */
+  std::shared_ptr<std::atomic<int>> pending_;
+  ThreadPool &blocking_executor_;
+  const ConnectionOptions &options_;
+  AdmissionControl &admission_;
+  bool counted_ = false;  // in open_connections_
+  bool shed_ = false;     // over max_connections, answered with 503, or
+                          // closed before the handshake, see AdmissionControl
+  /* in-flight counts of capped handlers taken by the current request */
+  std::vector<std::shared_ptr<std::atomic<std::size_t>>> in_flight_;
+  bool keep_alive_ = false;        // connection persists after current response
+  bool idle_ = false;              // awaiting first byte of a follow-up request
+  bool writing_ = false;           // flush() in progress
+  bool stopped_ = false;           // timer no longer rearmed, lets connection go
+  bool zero_copy_ = false;         // TCP socket takes plaintext, plain or kTLS
+  bool corked_ = false;            // TCP_CORK set on socket
+  bool streaming_ = false;         // body of current response goes out in chunks_
+  bool head_queued_ = false;       // of streamed response, in outgoing_
+  bool stream_ended_ = false;      // handlers done, last chunk queued
+  bool chunked_ = false;           // streamed with chunked transfer coding
+  std::size_t stream_id_ = 0;      // of current stream, bumped once it ends
+  std::deque<Chunk> chunks_;       // stable addresses, for gathered_
+  std::size_t chunks_in_flight_ = 0; // front of chunks_ being written
+  std::size_t chunk_bytes_ = 0;    // of chunks_, against send_window
+  std::vector<std::function<void()>> parked_; // producers awaiting room in send_window
+  ClockType::time_point write_start_; // of current write, for min_send_rate
+  std::size_t write_progress_ = 0;    // bytes written since write_start_
+  std::size_t write_count_ = 0;       // see write_count()
+  std::vector<Message::HeaderType> trailers_;
+  std::size_t request_count_ = 0;  // requests read on this connection
 };
 
 
@@ -0,0 +1,110 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include "asio.hpp"
+
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Connection.h"
+
+namespace Http {
+
+/**
+ * @brief   Closed connections of an io_service, kept for reuse
+ *
+ *  A connection whose last reference goes is recycled, i.e. its socket
+ *  closed and state reset, and parked here instead of being deleted, so
+ *  the next accept reuses its buffers, parser, arena and the capacity
+ *  grown by its strings and vectors. Up to options' connection_pool_size
+ *  are parked, connections that cannot be recycled are deleted
+ *
+ *    auto &pool = asio::use_service<ConnectionPool<TcpSocket>>(io_service);
+ *    auto connection = pool.acquire(io_service, router, ...);
+ */
+template <typename SocketType>
+class ConnectionPool : public asio::io_service::service {
+public:
+  using ConnectionType = Connection<SocketType>;
+  using ConnectionPtr = std::shared_ptr<ConnectionType>;
+
+  static asio::io_service::id id;
+
+public:
+  explicit ConnectionPool(asio::io_service &io_service)
+      : asio::io_service::service(io_service){};
+
+  /**
+   * @brief   A parked connection, or one constructed from args if none is
+   *          Handed back to the pool once the last reference goes
+   *
+   * @precond args are those every connection of the pool is made with
+   */
+  template <typename... Args> auto acquire(Args &&... args) -> ConnectionPtr {
+    std::unique_ptr<ConnectionType> connection;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!idle_.empty()) {
+        connection = std::move(idle_.back());
+        idle_.pop_back();
+        ++recycled_;
+      }
+    }
+    if (!connection)
+      connection = std::make_unique<ConnectionType>(std::forward<Args>(args)...);
+    return ConnectionPtr(connection.release(),
+                         [this](ConnectionType *connection) { release(connection); });
+  }
+
+  /**
+   * @brief   Number of parked connections
+   */
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_.size();
+  }
+
+  /**
+   * @brief   Number of connections handed out again after being parked
+   */
+  std::size_t recycled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return recycled_;
+  }
+
+private:
+  void release(ConnectionType *connection) {
+    std::unique_ptr<ConnectionType> owned(connection);
+    if (!connection->recycle())
+      return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!shutdown_ &&
+        idle_.size() < connection->options_.connection_pool_size)
+      idle_.push_back(std::move(owned));
+  }
+
+  /**
+   * @brief   Deletes parked connections, later ones are deleted on release
+   */
+  void shutdown_service() override {
+    std::vector<std::unique_ptr<ConnectionType>> idle;
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+    idle.swap(idle_);
+  }
+
+private:
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<ConnectionType>> idle_;
+  std::size_t recycled_ = 0;
+  bool shutdown_ = false;
+};
+
+template <typename SocketType>
+asio::io_service::id ConnectionPool<SocketType>::id;
+}
+
+#endif
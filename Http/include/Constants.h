@@ -2,14 +2,21 @@
 #define CONSTANTS_H
 
 #include "json.hpp"
+#include <functional>
+#include <string>
 #include <unordered_map>
 
+#include "Arena.h"
+
 namespace Http {
 
 /**
  * types
  */
-using ssmap = std::unordered_map<std::string, std::string>;
+// nodes and buckets on the heap, or in an Arena, e.g. of a connection's request
+using ssmap = std::unordered_map<
+    std::string, std::string, std::hash<std::string>, std::equal_to<std::string>,
+    ArenaAllocator<std::pair<const std::string, std::string>>>;
 using json_type = nlohmann::json;
 
 constexpr char EOL[] = "\r\n";
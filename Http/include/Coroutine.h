@@ -0,0 +1,163 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include "asio.hpp"
+#include "asio/coroutine.hpp"
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <system_error>
+#include <utility>
+
+#include "Router.h"
+
+namespace Http {
+
+/**
+ * @brief   Default per-request state of a coroutine handler
+ */
+struct NoState {};
+
+/**
+ * @brief   Activation of a coroutine handler for one request
+ *
+ *  The body is an asio stackless coroutine, re-entered with the result of
+ *  the last awaited operation whenever an operation started with
+ *  resume() as its completion handler completes. The handler is done,
+ *  and the response written, once the body returns without awaiting
+ *
+ *  Variables living across a yield must be kept in state_,
+ *  at most one operation is awaited at a time
+ *
+ *    #include "asio/yield.hpp"
+ *
+ *    Handler(make_coroutine<State>([](CoroutineFrame<State> &co, Context &ctx) {
+ *      reenter(co) {
+ *        yield asio::async_read(co.state_.pipe_, buffer, co.resume());
+ *        if (co.ec_) ...
+ *      }
+ *    }));
+ */
+template <typename State = NoState>
+class CoroutineFrame
+    : public asio::coroutine,
+      public std::enable_shared_from_this<CoroutineFrame<State>> {
+public:
+  using Body = std::function<void(CoroutineFrame &, Context &)>;
+
+  /**
+   * @brief   Completion handler re-entering the body,
+   *          for operations completing with (ec) or (ec, bytes_transferred)
+   */
+  class Resume {
+  public:
+    explicit Resume(std::shared_ptr<CoroutineFrame> frame)
+        : frame_(std::move(frame)){};
+
+    void operator()(std::error_code ec, std::size_t bytes_transferred = 0) {
+      frame_->ec_ = ec;
+      frame_->bytes_transferred_ = bytes_transferred;
+      frame_->step();
+    }
+
+  private:
+    std::shared_ptr<CoroutineFrame> frame_;
+  };
+
+public:
+  explicit CoroutineFrame(Body body, Context &ctx)
+      : body_(std::move(body)), ctx_(ctx){};
+
+  /**
+   * @brief   Defers response and enters the body for the first time
+   */
+  void start() {
+    done_ = ctx_.defer();
+    step();
+  }
+
+  /**
+   * @brief   Creates a completion handler for the operation being awaited
+   */
+  auto resume() -> Resume {
+    awaiting_ = true;
+    return Resume(this->shared_from_this());
+  }
+
+  /**
+   * @brief   Event loop of the connection the request came in on
+   */
+  auto io_service() -> asio::io_service & { return *ctx_.io_service_; }
+
+  /**
+   * @brief   Runs task, e.g. file or process calls, on executor, off the
+   *          event loop, and resumes on the event loop once done,
+   *          with std::errc::io_error if task threw
+   *
+   *    yield co.run_blocking(app->blocking_executor(), [&] { ... });
+   */
+  template <typename Executor, typename Task>
+  void run_blocking(Executor &executor, Task task) {
+    executor.post([task = std::move(task), &loop = io_service(),
+                   resume = resume()]() mutable {
+      std::error_code ec;
+      try {
+        task();
+      } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        ec = std::make_error_code(std::errc::io_error);
+      }
+      loop.post([resume, ec]() mutable { resume(ec); });
+    });
+  }
+
+private:
+  /**
+   * @brief   Runs body until it awaits or returns,
+   *          a body throwing is done, with a 500, and not re-entered
+   */
+  void step() {
+    if (!done_)
+      return;
+    awaiting_ = false;
+    try {
+      body_(*this, ctx_);
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      ctx_.res_.status_code(StatusCode::Internal_Server_Error);
+      awaiting_ = false;
+    }
+    if (!awaiting_) {
+      auto done = std::move(done_);
+      done_ = nullptr;
+      done();
+    }
+  }
+
+public:
+  std::error_code ec_;               // result of last awaited operation
+  std::size_t bytes_transferred_ = 0; // result of last awaited operation
+  State state_;                      // lives across yields
+
+private:
+  Body body_;
+  Context &ctx_;
+  Context::Completion done_;
+  bool awaiting_ = false;
+};
+
+/**
+ * @brief   Adapts a coroutine body to a function accepted by Handler,
+ *          each request gets its own CoroutineFrame<State>
+ */
+template <typename State = NoState>
+auto make_coroutine(typename CoroutineFrame<State>::Body body)
+    -> std::function<void(Context &)> {
+  return [body](Context &ctx) {
+    std::make_shared<CoroutineFrame<State>>(body, ctx)->start();
+  };
+}
+}
+
+#endif
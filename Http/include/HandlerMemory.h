@@ -0,0 +1,114 @@
+#ifndef HANDLERMEMORY_H
+#define HANDLERMEMORY_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace Http {
+
+/**
+ * @brief   Storage for asio completion handlers of one connection
+ *
+ *  asio allocates every operation it queues, holding its handler, through
+ *  asio_handler_allocate() found by ADL on the handler. Handlers made by
+ *  bind_memory() draw from a few fixed slots here, released once the
+ *  operation completes, so a connection's reads, writes and strand posts
+ *  reuse the same memory. An operation larger than a slot, or made while
+ *  every slot is taken, falls back to the heap
+ *
+ *    HandlerMemory memory;
+ *    socket.async_read_some(buffer, strand.wrap(bind_memory(memory,
+ *        [](std::error_code ec, std::size_t n) { ... })));
+ */
+class HandlerMemory {
+public:
+  static constexpr std::size_t slot_size = 1024;
+  static constexpr std::size_t slot_count = 4; // operations in flight at once
+
+public:
+  /* non-copy-constructible */
+  HandlerMemory(const HandlerMemory &) = delete;
+  HandlerMemory &operator=(const HandlerMemory &) = delete;
+
+  HandlerMemory() = default;
+
+  /**
+   * @brief   Storage of size bytes, from a free slot if it fits,
+   *          from any thread
+   */
+  void *allocate(std::size_t size) {
+    ++allocations_;
+    if (size <= slot_size)
+      for (auto &slot : slots_) {
+        bool free = false;
+        if (slot.in_use_.compare_exchange_strong(free, true,
+                                                 std::memory_order_acquire))
+          return slot.data_;
+      }
+    ++heap_allocations_;
+    return ::operator new(size);
+  }
+
+  void deallocate(void *p) {
+    for (auto &slot : slots_)
+      if (p == slot.data_) {
+        slot.in_use_.store(false, std::memory_order_release);
+        return;
+      }
+    ::operator delete(p);
+  }
+
+  /**
+   * @brief   Operations allocated for, and those that went to the heap
+   */
+  std::size_t allocations() const { return allocations_; }
+  std::size_t heap_allocations() const { return heap_allocations_; }
+
+private:
+  struct Slot {
+    alignas(std::max_align_t) char data_[slot_size];
+    std::atomic<bool> in_use_{false};
+  };
+
+  std::array<Slot, slot_count> slots_;
+  std::atomic<std::size_t> allocations_{0};
+  std::atomic<std::size_t> heap_allocations_{0};
+};
+
+/**
+ * @brief   Handler whose operations are allocated from a HandlerMemory
+ *          Invoked as the handler it wraps
+ */
+template <typename Handler> class MemoryHandler {
+public:
+  MemoryHandler(HandlerMemory &memory, Handler handler)
+      : memory_(&memory), handler_(std::move(handler)){};
+
+  template <typename... Args> void operator()(Args &&... args) {
+    handler_(std::forward<Args>(args)...);
+  }
+
+  friend void *asio_handler_allocate(std::size_t size, MemoryHandler *self) {
+    return self->memory_->allocate(size);
+  }
+  friend void asio_handler_deallocate(void *p, std::size_t,
+                                      MemoryHandler *self) {
+    self->memory_->deallocate(p);
+  }
+
+private:
+  HandlerMemory *memory_;
+  Handler handler_;
+};
+
+template <typename Handler>
+auto bind_memory(HandlerMemory &memory, Handler handler)
+    -> MemoryHandler<Handler> {
+  return MemoryHandler<Handler>(memory, std::move(handler));
+}
+}
+
+#endif
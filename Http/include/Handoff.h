@@ -0,0 +1,29 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <cstddef>
+#include <vector>
+
+namespace Http {
+
+/**
+ * @brief   Passes file descriptors to the process at the other end of a
+ *          connected Unix domain socket (SCM_RIGHTS), returns success
+ *          Descriptors stay open in the sender
+ */
+bool send_descriptors(int socket, const std::vector<int> &fds);
+
+/**
+ * @brief   Receives descriptors sent with send_descriptors(), at most max
+ *          Blocks until they arrive, empty if peer closed or on error
+ */
+auto receive_descriptors(int socket, std::size_t max = 64) -> std::vector<int>;
+
+/**
+ * @brief   Whether the process at the other end of a connected Unix domain
+ *          socket runs as this one's effective user (SO_PEERCRED)
+ */
+bool peer_is_same_user(int socket);
+}
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "Message.h"
+
+namespace Http {
+
+/**
+ * @brief   Header table of HPACK, RFC 7541,
+ *          61 static entries, then dynamic ones, newest first
+ */
+class HpackTable {
+public:
+  using HeaderType = Message::HeaderType;
+
+  explicit HpackTable(std::size_t max_size = 4096) : max_size_(max_size){};
+
+  /**
+   * @brief   Entry at 1-based index, nullptr if there is none
+   */
+  auto at(std::size_t index) const -> const HeaderType *;
+
+  /**
+   * @brief   Index of entry matching header, 0 if none,
+   *          name_only set if only its name matches
+   */
+  auto find(const HeaderType &header, bool &name_only) const -> std::size_t;
+
+  /**
+   * @brief   Adds entry, evicting oldest ones to stay within max_size()
+   */
+  void insert(HeaderType header);
+
+  /**
+   * @brief   Get/Set bound on size of dynamic entries,
+   *          each counted as its name and value plus 32 bytes
+   */
+  auto max_size() const -> std::size_t { return max_size_; }
+  void max_size(std::size_t max_size);
+
+  auto size() const -> std::size_t { return size_; }
+
+private:
+  void evict(std::size_t max_size);
+
+  std::deque<HeaderType> dynamic_; // newest in front
+  std::size_t size_ = 0;
+  std::size_t max_size_;
+};
+
+/**
+ * @brief   Decodes header blocks of one connection, in order
+ */
+class HpackDecoder {
+public:
+  using HeaderType = Message::HeaderType;
+
+  /**
+   * @brief   max_table_size is what the decoder announced to the encoder,
+   *          larger tables asked for are a decoding error
+   *          max_list_size bounds headers of a block, counted as entries
+   *          of the table are, 0 for no limit
+   */
+  explicit HpackDecoder(std::size_t max_table_size = 4096,
+                        std::size_t max_list_size = 0)
+      : table_(max_table_size), max_table_size_(max_table_size),
+        max_list_size_(max_list_size){};
+
+  /**
+   * @brief   Appends headers of block to headers,
+   *          false on a decoding error, after which the table is unusable,
+   *          i.e. a COMPRESSION_ERROR for the connection,
+   *          or once headers exceed max_list_size, see too_large()
+   */
+  bool decode(const std::uint8_t *data, std::size_t size,
+              std::vector<HeaderType> &headers);
+
+  /**
+   * @brief   Whether decode() stopped at max_list_size, rather than
+   *          on a decoding error
+   */
+  auto too_large() const -> bool { return too_large_; }
+
+private:
+  HpackTable table_;
+  std::size_t max_table_size_;
+  std::size_t max_list_size_;
+  bool too_large_ = false;
+};
+
+/**
+ * @brief   Encodes header blocks of one connection, in order
+ *          Names are sent lower case, as HTTP/2 requires
+ */
+class HpackEncoder {
+public:
+  using HeaderType = Message::HeaderType;
+
+  /**
+   * @brief   Bounds table size, to what the peer's decoder allows,
+   *          announced at the start of next block
+   */
+  void max_table_size(std::size_t max_size);
+
+  /**
+   * @brief   Appends block of headers to out
+   *          Headers whose values vary with each message are not indexed
+   */
+  void encode(const std::vector<HeaderType> &headers, std::string &out);
+
+private:
+  HpackTable table_;
+  bool size_update_ = false;
+  std::size_t min_size_ = 4096; // smallest since last block, announced first
+};
+
+/**
+ * @brief   Huffman code of HPACK, RFC 7541 Appendix B
+ *          huffman_decode() is false if bits are not a valid encoding
+ */
+auto huffman_encoded_size(const std::string &s) -> std::size_t;
+void huffman_encode(const std::string &s, std::string &out);
+bool huffman_decode(const std::uint8_t *data, std::size_t size, std::string &out);
+}
+
+#endif
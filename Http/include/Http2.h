@@ -0,0 +1,340 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include "asio.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+#include "Connection.h"
+#include "Hpack.h"
+#include "Request.h"
+#include "Response.h"
+#include "Router.h"
+
+namespace Http {
+
+/**
+ * @brief   Lets clients of ctx pick h2 by ALPN, if options->http2,
+ *          http/1.1 otherwise, options must outlive ctx
+ */
+void http2_alpn(SSL_CTX *ctx, const ConnectionOptions *options);
+
+/**
+ * @brief   Whether protocol negotiated on ssl by ALPN is h2
+ */
+bool http2_negotiated(SSL *ssl);
+
+/**
+ * @brief   Whether data, of size bytes, is the start of the HTTP/2 client
+ *          connection preface, complete once size reaches http2_preface_size
+ */
+constexpr std::size_t http2_preface_size = 24;
+bool http2_preface(const char *data, std::size_t size);
+
+/**
+ * @brief   HTTP/2, RFC 7540, on a connection's socket, once negotiated
+ *          by ALPN h2 over TLS, or by the client preface over TCP,
+ *          i.e. h2c with prior knowledge
+ *          -- each stream is a request run through the connection's router,
+ *             as over HTTP/1.1, Context::defer(), Context::stream(),
+ *             blocking handlers and admission control included
+ *          -- DATA of ready streams is interleaved, in frames of at most
+ *             max frame size, within send windows of peer
+ *          -- request bodies are buffered, windows given back as they arrive
+ *          Runs on the connection's strand_, keeps connection alive until
+ *          socket is closed
+ */
+template <typename SocketType>
+class Http2Session
+    : public std::enable_shared_from_this<Http2Session<SocketType>> {
+public:
+  using ConnectionType = Connection<SocketType>;
+  using HeaderType = Message::HeaderType;
+
+  static constexpr std::size_t frame_header_size = 9;
+  static constexpr std::size_t max_frame_size = 16384; // received, as default
+  static constexpr std::int64_t default_window = 65535;
+  static constexpr std::int64_t max_window = 0x7fffffff;
+  static constexpr std::size_t max_request_body = 1 << 20;
+  static constexpr std::size_t max_header_list_size = 64 * 1024; // advertised, bounds header blocks too
+  static constexpr std::size_t max_control_bytes = 64 * 1024; // queued ahead of DATA, before reads pause
+
+  enum class FrameType : std::uint8_t {
+    data = 0x0,
+    headers = 0x1,
+    priority = 0x2,
+    rst_stream = 0x3,
+    settings = 0x4,
+    push_promise = 0x5,
+    ping = 0x6,
+    goaway = 0x7,
+    window_update = 0x8,
+    continuation = 0x9
+  };
+
+  enum Flags : std::uint8_t {
+    end_stream = 0x1,
+    ack = 0x1,
+    end_headers = 0x4,
+    padded = 0x8,
+    priority = 0x20
+  };
+
+  enum class ErrorCode : std::uint32_t {
+    no_error = 0x0,
+    protocol_error = 0x1,
+    internal_error = 0x2,
+    flow_control_error = 0x3,
+    stream_closed = 0x5,
+    frame_size_error = 0x6,
+    refused_stream = 0x7,
+    cancel = 0x8,
+    compression_error = 0x9,
+    enhance_your_calm = 0xb
+  };
+
+  enum class Setting : std::uint16_t {
+    header_table_size = 0x1,
+    enable_push = 0x2,
+    max_concurrent_streams = 0x3,
+    initial_window_size = 0x4,
+    max_frame_size = 0x5,
+    max_header_list_size = 0x6
+  };
+
+  explicit Http2Session(std::shared_ptr<ConnectionType> connection);
+  ~Http2Session();
+
+  /**
+   * @brief   Takes over connection's socket, parsing data, size bytes
+   *          already read from it, first
+   */
+  void start(const char *data, std::size_t size);
+
+private:
+  /**
+   * @brief   Text or file range of a response body, written in order
+   *          on_written, of a streamed chunk, called once it is out
+   */
+  struct Segment {
+    std::string text_;
+    std::shared_ptr<int> fd_; // file range instead of text_, if set
+    std::size_t offset_ = 0;  // into text_ or file
+    std::size_t length_ = 0;  // left to send
+    BodyStream::Callback on_written_;
+  };
+
+  struct Stream {
+    explicit Stream(std::uint32_t id) : id_(id){};
+
+    std::uint32_t id_;
+    Request request_;
+    Response response_;
+    Context context_{request_, response_};
+    std::vector<Handler> handlers_;
+    std::size_t next_handler_ = 0;
+    std::shared_ptr<std::atomic<int>> pending_; // as Connection's
+    std::vector<std::shared_ptr<std::atomic<std::size_t>>> in_flight_;
+
+    bool remote_closed_ = false; // END_STREAM received
+    bool handling_ = false;      // handlers running
+    bool responded_ = false;     // HEADERS sent
+    bool streaming_ = false;     // body from Context::stream()
+    bool last_queued_ = false;   // no segments come after those in body_
+    bool reset_ = false;         // RST_STREAM sent or received
+    bool ready_ = false;         // in ready_
+    std::int64_t send_window_;
+    std::int64_t recv_window_ = default_window;
+    std::deque<Segment> body_;
+    std::size_t queued_bytes_ = 0; // of text in body_, against send_window
+    std::vector<std::function<void()>> parked_; // producers awaiting room
+    std::vector<HeaderType> trailers_;
+  };
+  using StreamPtr = std::shared_ptr<Stream>;
+
+  /**
+   * @brief   BodyStream of a stream, queues chunks on strand_
+   */
+  class DataStream : public BodyStream {
+  public:
+    DataStream(std::shared_ptr<Http2Session> session, StreamPtr stream)
+        : session_(std::move(session)), stream_(std::move(stream)){};
+
+    void write(std::string chunk, Callback on_written = nullptr) override;
+    void trailer(HeaderType header) override;
+    void when_writable(std::function<void()> resume) override;
+
+  private:
+    std::shared_ptr<Http2Session> session_;
+    StreamPtr stream_;
+  };
+
+  void read();
+
+  /**
+   * @brief   Reads on, unless frames queued in control_, as answers to
+   *          PING and SETTINGS, pile up unread by peer, then once they drain
+   */
+  void read_more();
+
+  /**
+   * @brief   Handles complete frames in in_, false once connection is
+   *          to be closed
+   */
+  bool parse();
+  bool handle_frame(FrameType type, std::uint8_t flags, std::uint32_t id,
+                    const std::uint8_t *payload, std::size_t length);
+  bool handle_headers(std::uint8_t flags, std::uint32_t id,
+                      const std::uint8_t *payload, std::size_t length);
+  bool handle_header_block(std::uint32_t id, bool end_of_stream);
+  bool handle_data(std::uint8_t flags, std::uint32_t id,
+                   const std::uint8_t *payload, std::size_t length);
+  bool handle_settings(std::uint8_t flags, std::uint32_t id,
+                       const std::uint8_t *payload, std::size_t length);
+  bool handle_window_update(std::uint32_t id, const std::uint8_t *payload,
+                            std::size_t length);
+
+  /**
+   * @brief   Fills in request_ from pseudo-headers and headers,
+   *          false if malformed
+   */
+  bool make_request(Stream &stream, std::vector<HeaderType> &headers);
+
+  /**
+   * @brief   Resolves handlers of stream and runs them, as Connection::handle()
+   */
+  void handle(const StreamPtr &stream);
+  bool admit_handlers(Stream &stream);
+  void send_overloaded(const StreamPtr &stream);
+  void run_handlers(const StreamPtr &stream, std::size_t i);
+  auto defer(const StreamPtr &stream) -> Context::Completion;
+  bool suspended(Stream &stream);
+  void release(Stream &stream);
+
+  /**
+   * @brief   Sends response_ of stream, head, then body unless streamed
+   */
+  void respond(const StreamPtr &stream);
+  void send_head(Stream &stream, bool end_of_stream);
+
+  /**
+   * @brief   Appends HEADERS, and CONTINUATION as needed, to out
+   *          Blocks must go out in the order they are encoded
+   */
+  void append_headers(std::string &out, std::uint32_t id,
+                      const std::vector<HeaderType> &headers,
+                      bool end_of_stream);
+  void write_chunk(const StreamPtr &stream, std::string chunk,
+                   BodyStream::Callback on_written);
+  void start_stream(Stream &stream);
+  void end_data(const StreamPtr &stream);
+
+  /**
+   * @brief   Appends segment to body_ of stream, its text counted as unsent
+   */
+  void queue_segment(Stream &stream, Segment segment);
+
+  /**
+   * @brief   As Connection's, with send_window applied to each stream
+   */
+  void when_writable(const StreamPtr &stream, std::function<void()> resume);
+  void resume_parked(Stream &stream);
+  void mark_ready(const StreamPtr &stream);
+
+  /**
+   * @brief   Drops body_ of stream, its chunks' callbacks get an error
+   */
+  void abort(Stream &stream);
+
+  /**
+   * @brief   Stream is done with, once handlers are and its last frame sent
+   */
+  void close_stream(std::uint32_t id);
+  void reset_stream(std::uint32_t id, ErrorCode error);
+
+  /**
+   * @brief   Queues a frame to go out ahead of DATA
+   */
+  void queue_frame(FrameType type, std::uint8_t flags, std::uint32_t id,
+                   const std::string &payload);
+  void goaway(ErrorCode error);
+
+  /**
+   * @brief   GOAWAY with error, then false, for handlers of frames
+   */
+  bool fail(ErrorCode error);
+
+  /**
+   * @brief   Writes queued frames, then DATA of ready streams, round robin,
+   *          up to write_batch_bytes at a time
+   */
+  void send();
+  void fill_data(std::size_t budget);
+  void write_buffer();
+
+  /**
+   * @brief   Arms idle deadline if no stream is open, read deadline if one
+   *          awaits END_STREAM, write deadline if writing
+   */
+  void update_deadline();
+  void arm_deadline(ClockType::duration timeout);
+  void check_deadline();
+
+  /**
+   * @brief   Closes socket, once a GOAWAY is out and streams are done
+   */
+  void close_if_done();
+  void close();
+
+private:
+  std::shared_ptr<ConnectionType> connection_;
+  asio::io_service::strand &strand_;
+  const ConnectionOptions &options_;
+  std::array<char, 16384> buffer_;
+  std::vector<std::uint8_t> in_;  // received, not yet parsed
+  std::size_t preface_left_ = http2_preface_size;
+  bool settings_received_ = false;
+
+  HpackDecoder decoder_{4096, max_header_list_size};
+  HpackEncoder encoder_;
+  std::string header_block_;       // fragments of block up to END_HEADERS
+  std::uint32_t continued_id_ = 0; // stream of header_block_, 0 if none
+  bool continued_end_stream_ = false;
+
+  std::map<std::uint32_t, StreamPtr> streams_;
+  std::deque<StreamPtr> ready_;     // streams with DATA to send
+  std::uint32_t last_stream_id_ = 0; // highest opened by peer
+  std::size_t stream_count_ = 0;    // opened on this connection
+
+  std::int64_t send_window_ = default_window;        // of connection
+  std::int64_t initial_send_window_ = default_window; // of new streams
+  std::size_t peer_max_frame_size_ = max_frame_size;
+  std::int64_t recv_window_ = default_window;
+
+  std::string control_; // frames ahead of DATA
+  std::string out_;     // being written
+  std::size_t out_offset_ = 0;
+  std::vector<std::pair<BodyStream::Callback, std::size_t>> written_; // in out_
+  bool writing_ = false;
+  bool read_paused_ = false; // control_ over max_control_bytes
+  bool going_away_ = false; // GOAWAY sent, no new streams
+  bool failed_ = false;     // closing for an error, drop streams
+  bool closed_ = false;
+};
+
+extern template class Http2Session<TcpSocket>;
+extern template class Http2Session<SslSocket>;
+extern template class Http2Session<UnixSocket>;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef KTLS_H
+#define KTLS_H
+
+#include <cstdint>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+namespace Http {
+
+/**
+ * @brief   Traffic keys of server's side of an established TLS session,
+ *          in the layout kernel TLS expects
+ */
+struct KtlsKeys {
+  int version_ = 0;                // TLS1_2_VERSION or TLS1_3_VERSION
+  int cipher_ = 0;                 // TLS_CIPHER_* of <linux/tls.h>
+  std::vector<unsigned char> key_;
+  std::vector<unsigned char> salt_; // implicit nonce, empty for ChaCha20
+  std::vector<unsigned char> iv_;   // rest of nonce
+  std::uint64_t seq_ = 0;           // sequence number of next record sent
+};
+
+/**
+ * @brief   Prepares context so that sessions marked by ktls_session()
+ *          keep what is needed to hand their transmit side to the kernel
+ */
+void ktls_context(SSL_CTX *ctx);
+
+/**
+ * @brief   Marks session, before its handshake, as a candidate for kTLS
+ */
+void ktls_session(SSL *ssl);
+
+/**
+ * @brief   Derives keys of a marked session once its handshake completed
+ *          false for protocols and ciphers kernel TLS does not support
+ */
+auto ktls_keys(SSL *ssl, KtlsKeys &keys) -> bool;
+
+/**
+ * @brief   Moves encryption of records sent by ssl to kernel, on socket fd
+ *          Plaintext written to fd is sent as application data thereafter,
+ *          SSL_write() must no longer be called
+ *          false, with socket untouched, if kernel lacks TLS support
+ */
+auto ktls_start_tx(SSL *ssl, int fd) -> bool;
+
+/**
+ * @brief   Shuts down socket fd as soon as OpenSSL writes a record for ssl,
+ *          as an alert in answer to the peer, rather than let kernel send
+ *          it encrypted twice, or the peer asks for a KeyUpdate of ours
+ *          Called by ktls_start_tx(), exposed for tests
+ */
+void ktls_guard(SSL *ssl, int fd);
+}
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef HEADER_H
 #define HEADER_H
 
+#include <cstdint>
 #include <list>
 #include <ostream>
 #include <string>
@@ -9,6 +10,16 @@
 
 namespace Http {
 
+/**
+ * @brief   Bytes [first_, last_] of a representation, as in RFC 7233
+ */
+struct ByteRange {
+  std::uint64_t first_;
+  std::uint64_t last_;
+
+  auto length() const -> std::uint64_t { return last_ - first_ + 1; }
+};
+
 class Message {
 public:
   using HeaderNameType = std::string;
@@ -51,8 +62,14 @@ public:
   auto content_type() -> HeaderValueType;
   void content_type(HeaderValueType value);
 
-  int version_major_;
-  int version_minor_;
+  /**
+   * @brief   Resets to an empty HTTP/1.1 message, 
+   *          keeps allocated capacity of headers_ and body_
+   */
+  void clear();
+
+  int version_major_ = 1;
+  int version_minor_ = 1;
   std::vector<HeaderType> headers_;
   std::string body_;
 
@@ -1,14 +1,21 @@
 #ifndef REQUEST_H
 #define REQUEST_H
 
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <limits>
 #include <ostream>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+#include "Arena.h"     // Arena
 #include "Constants.h" // RequestMetho
 #include "Message.h"   // base class
 #include "Uri.h"       // Uri
-#include "Utilities.h" // enum_map
+#include "Utilities.h" // enum_map, to_lower, trim
 
 namespace Http {
 
@@ -21,6 +28,179 @@ public:
   ssmap param_;
   ssmap query_;
 
+public:
+  static constexpr std::size_t max_spare_headers = 64;
+
+  /**
+   * @brief   Places nodes of param_ and query_ in arena
+   *
+   * @precond arena outlives them, reset only after clear()
+   */
+  void use_arena(Arena &arena) {
+    param_ = ssmap(ssmap::allocator_type(&arena));
+    query_ = ssmap(ssmap::allocator_type(&arena));
+  }
+
+  /**
+   * @brief   Resets to an empty request, for the next one on a connection
+   *          Header and uri strings keep their capacity for the next request
+   */
+  void clear() {
+    for (auto &header : headers_) {
+      if (spare_headers_.size() == max_spare_headers)
+        break;
+      spare_headers_.push_back(std::move(header));
+    }
+    Message::clear();
+    method_ = RequestMethod::UNDETERMINED;
+    uri_.clear();
+    // rebuilt, not cleared, buckets of an arena's map are about to be reset
+    param_ = ssmap(param_.get_allocator());
+    query_ = ssmap(query_.get_allocator());
+  }
+
+  /**
+   * @brief   Appends an empty header, for the parser to build,
+   *          made of strings of a cleared request's headers if any
+   */
+  auto add_header() -> HeaderType & {
+    if (spare_headers_.empty()) {
+      headers_.emplace_back();
+      return headers_.back();
+    }
+    headers_.push_back(std::move(spare_headers_.back()));
+    spare_headers_.pop_back();
+    headers_.back().first.clear();
+    headers_.back().second.clear();
+    return headers_.back();
+  }
+
+  /**
+   * @brief   Whether client wants connection kept open after this request
+   *          HTTP/1.1 defaults to keep-alive, HTTP/1.0 to close, 
+   *          either overridden by the Connection header
+   */
+  auto keep_alive() const -> bool {
+    bool keep_alive = version_major_ > 1 ||
+                      (version_major_ == 1 && version_minor_ >= 1);
+
+    for (const auto &header : headers_) {
+      if (to_lower(header.first) != "connection")
+        continue;
+      auto value = to_lower(header.second);
+      if (value.find("close") != std::string::npos)
+        return false;
+      if (value.find("keep-alive") != std::string::npos)
+        keep_alive = true;
+    }
+    return keep_alive;
+  }
+
+  /**
+   * @brief   Whether request carries a message body
+   */
+  auto has_body() const -> bool {
+    for (const auto &header : headers_) {
+      auto name = to_lower(header.first);
+      if (name == "transfer-encoding" ||
+          (name == "content-length" && header.second != "0"))
+        return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief   Byte ranges of the Range header, RFC 7233, of a representation
+   *          of size bytes, sorted, overlapping or adjacent ones merged
+   *            bytes=0-99        first 100 bytes
+   *            bytes=100-        all from byte 100 on
+   *            bytes=-100        last 100 bytes
+   *          Ranges starting past the end are dropped, ends past it are
+   *          clamped, empty if none is left, i.e. 416
+   *          More than max_ranges left, 0 for no limit, are coalesced into
+   *          one spanning them all, as RFC 7233 6.1 allows, so that a small
+   *          request cannot ask for many small parts
+   *          Throws std::invalid_argument if header is missing or malformed
+   */
+  auto byte_ranges(std::uint64_t size, std::size_t max_ranges = 0)
+      -> std::vector<ByteRange> {
+    auto found = get_header("Range");
+    if (!found.second)
+      throw std::invalid_argument("no Range header");
+    const auto &value = found.first;
+
+    auto eq = value.find('=');
+    if (eq == std::string::npos || to_lower(trim(value.substr(0, eq))) != "bytes")
+      throw std::invalid_argument("not a byte range " + value);
+
+    std::vector<ByteRange> ranges;
+    bool any = false;
+    for (std::size_t begin = eq + 1, end; begin <= value.size(); begin = end + 1) {
+      end = std::min(value.find(',', begin), value.size());
+      auto spec = trim(value.substr(begin, end - begin));
+      if (spec.empty())
+        continue; // 1#range-spec allows empty list elements
+      any = true;
+
+      auto dash = spec.find('-');
+      if (dash == std::string::npos)
+        throw std::invalid_argument("malformed range " + spec);
+      auto first = spec.substr(0, dash), last = spec.substr(dash + 1);
+
+      if (first.empty()) {
+        // suffix, the last n bytes
+        auto n = to_offset(last);
+        if (n && size)
+          ranges.push_back({size - std::min(n, size), size - 1});
+        continue;
+      }
+      auto first_pos = to_offset(first);
+      auto last_pos = last.empty() ? std::numeric_limits<std::uint64_t>::max()
+                                   : to_offset(last);
+      if (last_pos < first_pos)
+        throw std::invalid_argument("malformed range " + spec);
+      if (first_pos < size)
+        ranges.push_back({first_pos, std::min(last_pos, size - 1)});
+    }
+    if (!any)
+      throw std::invalid_argument("no range in " + value);
+
+    std::sort(ranges.begin(), ranges.end(),
+              [](const ByteRange &a, const ByteRange &b) {
+                return a.first_ < b.first_;
+              });
+    std::vector<ByteRange> merged;
+    for (const auto &range : ranges) {
+      if (!merged.empty() && range.first_ <= merged.back().last_ + 1)
+        merged.back().last_ = std::max(merged.back().last_, range.last_);
+      else
+        merged.push_back(range);
+    }
+    if (max_ranges && merged.size() > max_ranges)
+      merged = {{merged.front().first_, merged.back().last_}};
+    return merged;
+  }
+
+private:
+  std::vector<HeaderType> spare_headers_; // of cleared requests, see add_header()
+
+  /**
+   * @brief   Parses 1*DIGIT, saturating at the largest offset
+   */
+  static auto to_offset(const std::string &digits) -> std::uint64_t {
+    if (digits.empty())
+      throw std::invalid_argument("missing byte position");
+    const auto max = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t n = 0;
+    for (auto c : digits) {
+      if (!std::isdigit(static_cast<unsigned char>(c)))
+        throw std::invalid_argument("malformed byte position " + digits);
+      auto digit = static_cast<std::uint64_t>(c - '0');
+      n = n > (max - digit) / 10 ? max : n * 10 + digit;
+    }
+    return n;
+  }
+
 public:
   constexpr static const char *request_method_to_string(RequestMethod method) {
     return enum_map(request_methods, method);
@@ -18,6 +18,11 @@ public:
 
   State state_;
 
+  /**
+   * @brief   Resets to initial state, for the next request on a connection
+   */
+  void reset() { state_ = State::req_start; }
+
   /**
  * @brief Populate Request object given a Range of chars
  */
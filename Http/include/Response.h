@@ -4,13 +4,38 @@
 #include "asio.hpp"
 #include "json.hpp"
 #include <array>
+#include <memory>
+#include <string>
+#include <vector>
 
+#include "Compression.h"
 #include "Constants.h"
 #include "Message.h"
 #include "Utilities.h"
 
 namespace Http {
 
+/**
+ * @brief   Byte range of an open file, sent as body without reading it in
+ *          Further ranges of the same file, each after its own prefix_,
+ *          then suffix_, make up a multipart/byteranges body
+ */
+struct FileRange {
+  struct Part {
+    std::string prefix_; // delimiter and headers of part
+    std::size_t offset_;
+    std::size_t length_;
+  };
+
+  std::shared_ptr<int> fd_; // closed once no response refers to it
+  std::size_t offset_ = 0;
+  std::size_t length_ = 0;
+  std::vector<Part> parts_; // sent, in order, after this range
+  std::string suffix_;      // sent after the last range
+
+  explicit operator bool() const { return fd_ && length_; }
+};
+
 class Response : public Message {
 public:
   using BuildStatus = int;
@@ -20,6 +45,22 @@ public:
    */
   auto to_payload() const -> std::string;
 
+  /**
+   * @brief   Generates response as a buffer sequence for a gathered write
+   *          status line + header block, serialized into head_, then body_,
+   *          which is not copied
+   *          Buffers are valid until response is modified or moved
+   *          file_, if any, is to be sent after them
+   */
+  auto to_buffers() -> std::vector<asio::const_buffer>;
+
+  /**
+   * @brief   Sends payload, a whole response serialized once beforehand,
+   *          e.g. by to_payload(), as is by to_buffers(), in place of
+   *          status line, headers and body, until clear()
+   */
+  auto write_payload(std::shared_ptr<const std::string> payload) -> void;
+
   /**
    * @brief   gets/Sets status code for response
    */
@@ -67,13 +108,52 @@ public:
       -> void;
   auto write_json(json_type data) -> void;
 
+  /**
+   * @brief   206 with ranges, as from Request::byte_ranges(), of file at path
+   *          as body, left in the page cache until the connection sends it
+   *          One range is the body itself, several are parts of a
+   *          multipart/byteranges body, each of content_type
+   *          false, with response untouched, if file cannot be opened
+   *
+   * @precond ranges non-empty, sorted, disjoint and within file
+   */
+  auto write_file_ranges(const std::string &path,
+                         const std::vector<ByteRange> &ranges,
+                         const std::string &content_type =
+                             "application/octet-stream") -> bool;
+
+  /**
+   * @brief   Compresses body_ with the coding accept_encoding, the request's
+   *          Accept-Encoding, prefers, setting Content-Encoding, Content-Length
+   *          and Vary: Accept-Encoding
+   *          Left as is if under min_size, a file body, of a type compressed
+   *          already, e.g. application/vnd.ga4gh.bam, already encoded, or
+   *          not any smaller compressed
+   *          true if body_ was compressed
+   */
+  auto compress(const std::string &accept_encoding,
+                std::size_t min_size = compress_min_size, int level = -1)
+      -> bool;
+
+  static constexpr std::size_t compress_min_size = 1024; // below, gains little
+
   /**
    * @brief   Clears body and resets size
    */
   auto clear_body() -> void;
 
+  /**
+   * @brief   Resets to an empty 200 OK, for the next request on a connection
+   */
+  auto clear() -> void;
+
+public:
+  FileRange file_; // sent after body_
+
 private:
   StatusCode status_code_ = StatusCode::OK; // defaults to 200 OK
+  std::string head_;                        // serialized by to_buffers()
+  std::shared_ptr<const std::string> payload_; // see write_payload()
 
 public:
   /**
@@ -1,10 +1,16 @@
 #ifndef ROUTER_H
 #define ROUTER_H
 
+#include "asio.hpp"
+
 #include <algorithm>
+#include <atomic>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <system_error>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -16,7 +22,73 @@
 
 namespace Http {
 
+/**
+ * @brief   Response body written in chunks as they are produced
+ *          Body ends once handlers are done, i.e. on return or, for a
+ *          deferred handler, its completion
+ */
+class BodyStream {
+public:
+  using Callback = std::function<void(std::error_code, std::size_t)>;
+
+  virtual ~BodyStream() = default;
+
+  /**
+   * @brief   Queues chunk, from any thread,
+   *          on_written is called once it is written out, which is the
+   *          cue to produce the next one, or with an error if it never will
+   *          Empty chunks are skipped
+   */
+  virtual void write(std::string chunk, Callback on_written = nullptr) = 0;
+
+  /**
+   * @brief   Adds a header sent after the last chunk
+   */
+  virtual void trailer(Message::HeaderType header) = 0;
+
+  /**
+   * @brief   Calls resume, from any thread, once fewer than the connection's
+   *          send_window of bytes are queued unsent, right away if so already,
+   *          or if they never will be
+   *          A producer parks on it between chunks, bounding what it holds
+   */
+  virtual void when_writable(std::function<void()> resume) { resume(); }
+
+  /**
+   * @brief   Blocks until when_writable() resumes,
+   *          from blocking handlers only, never on an event loop
+   */
+  void wait_writable() {
+    auto ready = std::make_shared<std::promise<void>>();
+    auto resumed = ready->get_future();
+    when_writable([ready] { ready->set_value(); });
+    resumed.wait();
+  }
+};
+
+/**
+ * @brief   Appends chunks to the body of a response,
+ *          for a context not bound to a connection
+ */
+class BufferedStream : public BodyStream {
+public:
+  explicit BufferedStream(Response &res) : res_(res){};
+
+  void write(std::string chunk, Callback on_written = nullptr) override {
+    res_.body_ += chunk;
+    if (on_written)
+      on_written({}, chunk.size());
+  }
+  void trailer(Message::HeaderType header) override { res_.set_header(header); }
+
+private:
+  Response &res_;
+};
+
 struct Context {
+  using Completion = std::function<void()>;
+  using StreamPtr = std::shared_ptr<BodyStream>;
+
   Request &req_;
   Response &res_;
   ssmap &param_;
@@ -24,6 +96,41 @@ struct Context {
 
   Context(Request &req, Response &res)
       : req_(req), res_(res), param_(req.param_), query_(req.query_){};
+
+  /**
+   * @brief   Streams the response body,
+   *          status and headers of res_ go out with the first chunk,
+   *          framed by Transfer-Encoding: chunked for HTTP/1.1,
+   *          by closing the connection for HTTP/1.0
+   *          Anything in res_.body_ by then is sent first
+   *
+   * @precond no file body, res_ left alone once a chunk is written
+   */
+  auto stream() -> StreamPtr {
+    if (make_stream_)
+      return make_stream_();
+    return std::make_shared<BufferedStream>(res_);
+  }
+
+  /**
+   * @brief   Defers the response, 
+   *          handler may return right away and finish res_ later,
+   *          calling the returned completion, from any thread, once done
+   *          Remaining handlers and the write run after completion
+   *
+   * @precond called at most once per handler invocation,
+   *          completion called exactly once
+   */
+  auto defer() -> Completion {
+    if (make_completion_)
+      return make_completion_();
+    return [] {};
+  }
+
+  /* set by the connection owning this context */
+  std::function<Completion()> make_completion_;
+  std::function<StreamPtr()> make_stream_;
+  asio::io_service *io_service_ = nullptr; // event loop of the connection
 };
 
 /**
@@ -58,6 +165,27 @@ public:
 
   operator bool() const { return handler_ != nullptr; }
   void operator()(Context &ctx) { handler_(ctx); }
+
+  /**
+   * @brief   Marks handler as blocking, i.e. it runs on the server's
+   *          blocking executor instead of the event loop
+   */
+  auto blocking(bool is_blocking = true) -> Handler_ & {
+    blocking_ = is_blocking;
+    return *this;
+  }
+
+  /**
+   * @brief   Caps requests running this handler at once, 0 for no cap
+   *          Requests over the cap are answered with 503
+   *          Count is shared by copies of the handler, i.e. by all shards
+   */
+  auto max_in_flight(std::size_t max) -> Handler_ & {
+    max_in_flight_ = max;
+    if (!in_flight_)
+      in_flight_ = std::make_shared<std::atomic<std::size_t>>(0);
+    return *this;
+  }
   bool operator==(const Handler_<> &rhs) {
     return handler_id_ == rhs.handler_id_;
   }
@@ -72,6 +200,9 @@ public:
 public:
   HandlerFunc handler_;
   int handler_id_;
+  bool blocking_ = false;
+  std::size_t max_in_flight_ = 0;
+  std::shared_ptr<std::atomic<std::size_t>> in_flight_; // requests running it
 
 public:
   friend auto inline operator<<(std::ostream &strm, Handler_<> &handler)
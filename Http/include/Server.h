@@ -9,54 +9,249 @@
 #include "asio/impl/src.hpp"
 #include "asio/ssl.hpp"
 #include "asio/ssl/impl/src.hpp"
+#include "asio/basic_waitable_timer.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "Connection.h"
+#include "ConnectionPool.h"
+#include "Handoff.h"
+#include "Http2.h"
 #include "Router.h"
+#include "ThreadPool.h"
+#include "TlsSessions.h"
 
 
 namespace Http {
 
 using ServerAddr = std::pair<std::string, int>;
+using ReusePort = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#ifdef TCP_DEFER_ACCEPT
+using DeferAccept = asio::detail::socket_option::integer<IPPROTO_TCP, TCP_DEFER_ACCEPT>;
+#endif
+#ifdef TCP_FASTOPEN
+using FastOpen = asio::detail::socket_option::integer<IPPROTO_TCP, TCP_FASTOPEN>;
+#endif
+
+/**
+ * @brief   A TCP port listened on, and the scheme served there
+ */
+struct Listener {
+  std::string scheme_; // http, or https for a TLS handshake first
+  int port_;
+};
 
 /**
  * @brief   A generic Http server
+ *
+ *  Two execution modes
+ *    -- shared (default), one io_service run by thread_count() threads
+ *    -- sharded, thread_count() shards each with its own io_service,
+ *       acceptor bound with SO_REUSEPORT and copy of router_,
+ *       run by exactly one thread, kernel spreads connections among shards
+ *
+ *  Hot restart, with handoff_path() set
+ *    -- on run(), takes over listening sockets from the server serving
+ *       handoff_path(), if any, instead of binding new ones
+ *    -- then serves handoff_path() itself, a successor connecting to it
+ *       is passed the listening sockets, unix_path()'s included, this
+ *       server stops accepting, drains its connections for up to
+ *       drain_timeout() and run() returns
+ *  The listen queue is shared throughout, so connections are never refused.
+ *  Either side only deals with a peer of its own effective user, still,
+ *  handoff_path() belongs in a directory private to that user (0700), as
+ *  whoever binds it first is who is handed the listeners
+ *
+ *  Listens on the ports of Derived's listeners(), by default port() alone,
+ *  every shard on each of them, so that whichever kind of traffic comes,
+ *  it is spread over all threads and served by the same routes
+ *
+ *  With unix_path() set, also listens on that Unix socket, e.g. for a
+ *  reverse proxy on the same host, served by the first shard with the same
+ *  routes. Connections on it are plain HTTP, whatever the server's scheme
  */
 template <typename Derived> class GenericServer {
 public:
   constexpr static int max_header_bytes = 1 << 20; // 1MB
+
+  /**
+   * @brief   An event loop with its own acceptor and routes
+   *          Nothing in a shard is touched by threads of another shard
+   */
+  struct Shard {
+    Shard(const Router<Handler> &router, std::size_t listener_count)
+        : io_service_(), router_(router) {
+      for (std::size_t i = 0; i < listener_count; ++i)
+        acceptors_.push_back(std::make_unique<asio::ip::tcp::acceptor>(io_service_));
+    };
+
+    asio::io_service io_service_;
+    std::vector<std::unique_ptr<asio::ip::tcp::acceptor>> acceptors_; // one per listener
+    Router<Handler> router_;                       // snapshot of server's router_
+    std::atomic<std::size_t> connection_count_{0}; // accepted connections
+  };
+
 public:
   /* non-copy-constructible */
   GenericServer(const GenericServer &) = delete;
   GenericServer &operator=(const GenericServer &) = delete;
 
   explicit GenericServer(const ServerAddr server_addr)
-      : server_address_(server_addr), io_service_(), acceptor_(io_service_){};
+      : server_address_(server_addr){};
 
   /**
    * @brief   Starts the server
-   *  Initiate io_service event loop,
-   *  acceptor instantiates and queues connection
+   *  Snapshots router_ into each shard,
+   *  acceptors of each shard instantiate and queue connections,
+   *  thread_count() threads, including the caller, run the event loops
    */
   void run() {
-    asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port());
+    std::size_t shard_count = sharded_ ? thread_count_ : 1;
+    blocking_executor_ = std::make_unique<ThreadPool>(blocking_thread_count_);
+    admission_.prepare(connection_options_);
+    admission_.draining_ = false;
 
-    // configure acceptor
-    acceptor_.open(endpoint.protocol());
-    acceptor_.set_option(asio::ip::tcp::acceptor::reuse_address(true));
-    acceptor_.set_option(asio::ip::tcp::no_delay(true));
-    acceptor_.bind(endpoint);
-    acceptor_.listen();
-    /* accpeting connection on an event loop */
-    static_cast<Derived *>(this)->accept_connection();
-    io_service_.run();
+    // accept_connection() reads this snapshot, not listeners() of Derived,
+    // which may be changed meanwhile for the next run()
+    running_listeners_ = static_cast<Derived *>(this)->listeners();
+    const auto &listeners = running_listeners_;
+
+    // handed off shard by shard, listener by listener, those beyond
+    // shard_count shards, and connections queued on them, are lost
+    auto inherited = take_over_listeners();
+    auto inherited_unix = take_unix_listener(inherited);
+    for (std::size_t i = shard_count * listeners.size(); i < inherited.size(); ++i)
+      ::close(inherited[i]);
+
+    shards_.clear();
+    for (std::size_t i = 0; i < shard_count; ++i) {
+      shards_.push_back(std::make_unique<Shard>(router_, listeners.size()));
+      auto &shard = *shards_.back();
+      for (std::size_t j = 0; j < listeners.size(); ++j) {
+        auto k = i * listeners.size() + j;
+        if (k < inherited.size())
+          shard.acceptors_[j]->assign(asio::ip::tcp::v4(), inherited[k]);
+        else
+          listen(*shard.acceptors_[j], listeners[j].port_);
+        /* accpeting connection on an event loop */
+        static_cast<Derived *>(this)->accept_connection(shard, j);
+      }
+    }
+    listen_unix(inherited_unix);
+    serve_handoff();
+
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < thread_count_; ++i)
+      workers.emplace_back([this, i] { run_event_loop(i); });
+    run_event_loop(0);
+
+    for (auto &worker : workers)
+      worker.join();
+
+    drain_timer_.reset();
+    handoff_acceptor_.reset();
+    unix_acceptor_.reset();
+    blocking_executor_.reset();
+
+    // drain_timeout_ passed, destroying event loops closes what is left open
+    if (admission_.draining_)
+      shards_.clear();
+  }
+
+  /**
+   * @brief   Stops the event loops, run() returns once all threads exit
+   */
+  void stop() {
+    for (auto &shard : shards_)
+      shard->io_service_.stop();
+  }
+
+  /**
+   * @brief   Gets/Sets number of threads running event loops
+   *          Takes effect on next call to run()
+   */
+  std::size_t thread_count() const { return thread_count_; }
+  void thread_count(std::size_t count) { thread_count_ = std::max<std::size_t>(count, 1); }
+
+  /**
+   * @brief   Gets/Sets number of threads running blocking handlers
+   *          Takes effect on next call to run()
+   */
+  std::size_t blocking_thread_count() const { return blocking_thread_count_; }
+  void blocking_thread_count(std::size_t count) {
+    blocking_thread_count_ = std::max<std::size_t>(count, 1);
+  }
+
+  /**
+   * @brief   Threads running blocking handlers, for handlers moving
+   *          blocking calls off the event loop themselves
+   *
+   * @precond server is running
+   */
+  ThreadPool &blocking_executor() { return *blocking_executor_; }
+
+  /**
+   * @brief   Gets/Sets shard-per-thread mode
+   *          Takes effect on next call to run()
+   */
+  bool sharded() const { return sharded_; }
+  void sharded(bool enable) { sharded_ = enable; }
+
+  /**
+   * @brief   Gets/Sets Unix socket path listeners are handed off through,
+   *          empty, the default, disables hot restart
+   *          Takes effect on next call to run()
+   */
+  std::string handoff_path() const { return handoff_path_; }
+  void handoff_path(std::string path) { handoff_path_ = std::move(path); }
+
+  /**
+   * @brief   Gets/Sets path of Unix socket listened on besides port(),
+   *          empty, the default, for none
+   *          Takes effect on next call to run()
+   */
+  std::string unix_path() const { return unix_path_; }
+  void unix_path(std::string path) { unix_path_ = std::move(path); }
+
+  /**
+   * @brief   Gets/Sets how long connections are drained after handoff
+   */
+  ClockType::duration drain_timeout() const { return drain_timeout_; }
+  void drain_timeout(ClockType::duration timeout) { drain_timeout_ = timeout; }
+
+  /**
+   * @brief   Number of connections accepted by each shard
+   */
+  auto connection_counts() const -> std::vector<std::size_t> {
+    std::vector<std::size_t> counts;
+    for (const auto &shard : shards_)
+      counts.push_back(shard->connection_count_);
+    return counts;
+  }
+
+  /**
+   * @brief   Ports listened on, with the scheme of each
+   *          Derived may hide it to listen on more than port()
+   */
+  auto listeners() -> std::vector<Listener> {
+    return {{static_cast<Derived *>(this)->scheme(), port()}};
   }
 
   /**
@@ -73,11 +268,302 @@ public:
            std::to_string(port());
   }
 
+protected:
+  /**
+   * @brief   Accept connection on i-th acceptor of shard into a new or
+   *          recycled Connection<SocketType>, constructed with args first
+   */
+  template <typename SocketType, typename... Args>
+  void accept(Shard &shard, std::size_t i, Args &... args) {
+    auto &acceptor = *shard.acceptors_[i];
+    auto new_conn =
+        asio::use_service<ConnectionPool<SocketType>>(shard.io_service_)
+            .acquire(shard.io_service_, args..., shard.router_,
+                     *blocking_executor_, connection_options_, admission_);
+
+    acceptor.async_accept(
+        new_conn->socket_.lowest_layer(),
+        [this, &shard, &acceptor, i, &args..., new_conn](std::error_code ec) {
+          if (!ec) {
+            ++shard.connection_count_;
+            new_conn->start();
+          }
+          if (acceptor.is_open())
+            accept<SocketType>(shard, i, args...);
+        });
+  }
+
+private:
+  /**
+   * @brief   Opens and binds acceptor on port
+   *          In sharded mode, every shard binds the same port with SO_REUSEPORT
+   *          Socket options of connection_options_ are set on the acceptor,
+   *          accepted sockets inherit them
+   */
+  void listen(asio::ip::tcp::acceptor &acceptor, int port) {
+    asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port);
+    const auto &options = connection_options_;
+
+    // configure acceptor
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+    if (sharded_)
+      acceptor.set_option(ReusePort(true));
+    acceptor.set_option(asio::ip::tcp::no_delay(true));
+    // before listen(), so that the window scale offered fits them
+    if (options.send_buffer)
+      acceptor.set_option(
+          asio::socket_base::send_buffer_size(options.send_buffer));
+    if (options.receive_buffer)
+      acceptor.set_option(
+          asio::socket_base::receive_buffer_size(options.receive_buffer));
+#ifdef TCP_DEFER_ACCEPT
+    if (options.defer_accept.count())
+      acceptor.set_option(DeferAccept(options.defer_accept.count()));
+#endif
+#ifdef TCP_FASTOPEN
+    if (options.fastopen_queue)
+      acceptor.set_option(FastOpen(options.fastopen_queue));
+#endif
+    acceptor.bind(endpoint);
+    acceptor.listen(options.backlog);
+  }
+
+  /**
+   * @brief   Listens on unix_path_, if set, on the first shard,
+   *          on inherited, if handed off, or else a new socket
+   *          A socket file left there, e.g. by a predecessor no longer
+   *          running, is replaced, any other file is left alone and throws
+   */
+  void listen_unix(int inherited) {
+    if (unix_path_.empty())
+      return;
+
+    unix_acceptor_ = std::make_unique<asio::local::stream_protocol::acceptor>(
+        shards_.front()->io_service_);
+    if (inherited >= 0) {
+      unix_acceptor_->assign(asio::local::stream_protocol(), inherited);
+    } else {
+      struct stat st;
+      if (::lstat(unix_path_.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode))
+          throw std::runtime_error(unix_path_ + " exists, not a socket");
+        ::unlink(unix_path_.c_str());
+      }
+      unix_acceptor_->open();
+      unix_acceptor_->bind(asio::local::stream_protocol::endpoint(unix_path_));
+      unix_acceptor_->listen(connection_options_.backlog);
+    }
+    accept_unix_connection(*shards_.front());
+  }
+
+  /**
+   * @brief   Removes Unix sockets from inherited listeners, returns the one
+   *          bound to unix_path_, -1 if none, closing any other
+   */
+  auto take_unix_listener(std::vector<int> &inherited) -> int {
+    int found = -1;
+    auto tcp = inherited.begin();
+    for (auto fd : inherited) {
+      sockaddr_un addr{};
+      socklen_t length = sizeof(addr);
+      if (::getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &length) != 0 ||
+          addr.sun_family != AF_UNIX) {
+        *tcp++ = fd;
+        continue;
+      }
+      std::string path(addr.sun_path, ::strnlen(addr.sun_path, sizeof(addr.sun_path)));
+      if (found < 0 && !unix_path_.empty() && path == unix_path_)
+        found = fd;
+      else
+        ::close(fd);
+    }
+    inherited.erase(tcp, inherited.end());
+    return found;
+  }
+
+  /**
+   * @brief   Accept connection on unix_acceptor_ into a new or recycled
+   *          session, routed by shard's router_
+   */
+  void accept_unix_connection(Shard &shard) {
+    auto new_conn =
+        asio::use_service<ConnectionPool<UnixSocket>>(shard.io_service_)
+            .acquire(shard.io_service_, shard.router_, *blocking_executor_,
+                     connection_options_, admission_);
+
+    unix_acceptor_->async_accept(
+        new_conn->socket_, [this, &shard, new_conn](std::error_code ec) {
+          if (!ec) {
+            ++shard.connection_count_;
+            new_conn->start();
+          }
+          if (unix_acceptor_->is_open())
+            accept_unix_connection(shard);
+        });
+  }
+
+  /**
+   * @brief   Runs event loop of i-th thread on calling thread,
+   *          an exception escaping a handler is logged and the loop resumed
+   *
+   *  In sharded mode, thread i runs shard i and is pinned to a core
+   */
+  void run_event_loop(std::size_t i) {
+    auto &io_service = shards_[sharded_ ? i : 0]->io_service_;
+    if (sharded_)
+      pin_to_core(i);
+
+    for (;;) {
+      try {
+        io_service.run();
+        break;
+      } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+      }
+    }
+  }
+
+  /**
+   * @brief   Receives listening sockets from server serving handoff_path_,
+   *          empty if hot restart is disabled or no server is there
+   */
+  auto take_over_listeners() -> std::vector<int> {
+    if (handoff_path_.empty())
+      return {};
+
+    asio::io_service io_service;
+    asio::local::stream_protocol::socket socket(io_service);
+    asio::error_code ec;
+    socket.connect(asio::local::stream_protocol::endpoint(handoff_path_), ec);
+    if (ec)
+      return {};
+    if (!peer_is_same_user(socket.native_handle())) {
+      std::cerr << handoff_path_ << " served by another user, ignored"
+                << std::endl;
+      return {};
+    }
+    return receive_descriptors(socket.native_handle());
+  }
+
+  /**
+   * @brief   Listens on handoff_path_ for a successor
+   */
+  void serve_handoff() {
+    if (handoff_path_.empty())
+      return;
+
+    // a stale socket of a predecessor, anything else is left alone
+    struct stat st;
+    if (::lstat(handoff_path_.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+      ::unlink(handoff_path_.c_str());
+
+    // serving goes on without hot restart, rather than not at all
+    asio::error_code ec;
+    handoff_acceptor_ = std::make_unique<asio::local::stream_protocol::acceptor>(
+        shards_.front()->io_service_);
+    asio::local::stream_protocol::endpoint endpoint(handoff_path_);
+    handoff_acceptor_->open(endpoint.protocol(), ec);
+    if (!ec)
+      handoff_acceptor_->bind(endpoint, ec);
+    if (!ec)
+      handoff_acceptor_->listen(asio::socket_base::max_connections, ec);
+    if (ec) {
+      std::cerr << "hot restart disabled, " << handoff_path_ << ": "
+                << ec.message() << std::endl;
+      handoff_acceptor_.reset();
+      return;
+    }
+    accept_handoff();
+  }
+
+  void accept_handoff() {
+    auto successor = std::make_shared<asio::local::stream_protocol::socket>(
+        shards_.front()->io_service_);
+
+    handoff_acceptor_->async_accept(
+        *successor, [this, successor](std::error_code ec) {
+          if (ec)
+            return;
+          if (!peer_is_same_user(successor->native_handle()))
+            return accept_handoff();
+
+          std::vector<int> fds;
+          for (auto &shard : shards_)
+            for (auto &acceptor : shard->acceptors_)
+              fds.push_back(acceptor->native_handle());
+          // told apart by address family, see take_unix_listener()
+          if (unix_acceptor_)
+            fds.push_back(unix_acceptor_->native_handle());
+          if (!send_descriptors(successor->native_handle(), fds))
+            return accept_handoff();
+
+          std::cerr << "listeners handed off, draining" << std::endl;
+          handoff_acceptor_->close();
+          drain();
+        });
+  }
+
+  /**
+   * @brief   Stops accepting, connections close after their current
+   *          response, stop() once all closed or drain_timeout_ passed
+   */
+  void drain() {
+    admission_.draining_ = true;
+    for (auto &shard : shards_)
+      shard->io_service_.post([&shard = *shard] {
+        asio::error_code ignored_ec;
+        for (auto &acceptor : shard.acceptors_)
+          acceptor->close(ignored_ec);
+      });
+    if (unix_acceptor_)
+      shards_.front()->io_service_.post([this] {
+        asio::error_code ignored_ec;
+        unix_acceptor_->close(ignored_ec);
+      });
+
+    drain_timer_ = std::make_unique<asio::basic_waitable_timer<ClockType>>(
+        shards_.front()->io_service_);
+    check_drained(ClockType::now() + drain_timeout_);
+  }
+
+  void check_drained(ClockType::time_point deadline) {
+    if (admission_.open_connections_ == 0 || ClockType::now() >= deadline)
+      return stop();
+
+    drain_timer_->expires_from_now(std::chrono::milliseconds(100));
+    drain_timer_->async_wait([this, deadline](const asio::error_code &ec) {
+      if (!ec)
+        check_drained(deadline);
+    });
+  }
+
+  static void pin_to_core(std::size_t i) {
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(i % std::max(std::thread::hardware_concurrency(), 1u), &cpuset);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+#endif
+  }
+
 public:
   Router<Handler> router_;
-  ServerAddr server_address_; // (host, port) pair
-  asio::io_service io_service_;
-  asio::ip::tcp::acceptor acceptor_; // tcp acceptor
+  ServerAddr server_address_;                 // (host, port) pair
+  std::vector<std::unique_ptr<Shard>> shards_; // one shard unless sharded_
+  std::size_t thread_count_ = 1;              // threads running event loops
+  bool sharded_ = false;                      // shard-per-thread mode
+  std::size_t blocking_thread_count_ = 4;     // threads running blocking handlers
+  std::unique_ptr<ThreadPool> blocking_executor_; // shared by all shards
+  ConnectionOptions connection_options_;       // timeouts, keep-alive and admission limits
+  AdmissionControl admission_;                 // open connections and shed counts
+  std::string handoff_path_;                   // hot restart, see handoff_path()
+  ClockType::duration drain_timeout_ = std::chrono::seconds(30);
+  std::unique_ptr<asio::local::stream_protocol::acceptor> handoff_acceptor_;
+  std::string unix_path_;                      // see unix_path()
+  std::unique_ptr<asio::local::stream_protocol::acceptor> unix_acceptor_;
+  std::unique_ptr<asio::basic_waitable_timer<ClockType>> drain_timer_;
+  std::vector<Listener> running_listeners_;   // listeners() as of run()
 };
 
 /**
@@ -90,23 +576,13 @@ public:
 
 public:
   /**
-   * @brief   Accept connection and creates new session
+   * @brief   Accept connection on shard's i-th acceptor into a new or
+   *          recycled session
    */
-  void accept_connection() {
-
-    auto new_conn =
-        std::make_shared<Connection<TcpSocket>>(io_service_, router_);
-
-    acceptor_.async_accept(
-      new_conn->socket_,
-      [this, new_conn](std::error_code ec) {
-
-        if (!ec) {
-          new_conn->start();
-        }
-        accept_connection();
-      });
+  void accept_connection(Shard &shard, std::size_t i) {
+    accept<TcpSocket>(shard, i);
   }
+
   /**
    * @brief   Scheme of HTTPS
    */
@@ -114,47 +590,66 @@ public:
 };
 
 /**
- * @brief   An HTTPS server
+ * @brief   TLS context of a server, key and certificate from Http/ssl,
+ *          with its cipher, group and session settings
  */
-class HttpsServer : public GenericServer<HttpsServer> {
+class TlsContext {
 public:
-  explicit HttpsServer(const ServerAddr server_addr)
-      : GenericServer(server_addr), context_(asio::ssl::context::sslv23) {
-    configure_ssl_context();
+  /**
+   * @brief   options, of the server, are those of its TLS connections,
+   *          read as handshakes negotiate kernel TLS and h2
+   */
+  explicit TlsContext(const ConnectionOptions *options)
+      : context_(asio::ssl::context::sslv23) {
+    configure_ssl_context(options);
   };
 
 public:
   /**
-   * @brief   Accept connection and creates new session
+   * @brief   Get/Set ciphers in server's order of preference, in OpenSSL's
+   *          format, tls12 for TLS 1.2, tls13 for TLS 1.3 cipher suites
+   *          Throws std::invalid_argument if a list matches no cipher
    */
-  void accept_connection() {
-
-    auto new_conn =
-        std::make_shared<Connection<SslSocket>>(io_service_, context_, router_);
-
-    acceptor_.async_accept(
-      new_conn->socket_.lowest_layer(),
-        [this, new_conn](std::error_code ec) {
-          if (!ec) {
-            new_conn->start();
-          }
-          accept_connection();
-        });
+  auto ciphers() -> std::pair<std::string, std::string> {
+    return {ciphers_, ciphersuites_};
+  }
+  void ciphers(const std::string &tls12, const std::string &tls13) {
+    if (!SSL_CTX_set_cipher_list(context_.native_handle(), tls12.c_str()))
+      throw std::invalid_argument("no cipher matches " + tls12);
+    if (!SSL_CTX_set_ciphersuites(context_.native_handle(), tls13.c_str()))
+      throw std::invalid_argument("no cipher suite matches " + tls13);
+    ciphers_ = tls12;
+    ciphersuites_ = tls13;
   }
 
   /**
-   * @brief   Scheme of HTTPS
+   * @brief   Get/Set ECDHE groups in server's order of preference
+   *          Throws std::invalid_argument if groups are unknown
    */
-  auto scheme() -> std::string { return "https"; }
+  auto groups() -> std::string { return groups_; }
+  void groups(const std::string &groups) {
+    if (!SSL_CTX_set1_groups_list(context_.native_handle(), groups.c_str()))
+      throw std::invalid_argument("unknown groups " + groups);
+    groups_ = groups;
+  }
 
 private:
   /**
    * @brief   Sets options, key, cert for Openssl
    */
-  void inline configure_ssl_context() {
+  void inline configure_ssl_context(const ConnectionOptions *options) {
     context_.set_options(asio::ssl::context::default_workarounds |
                          asio::ssl::context::no_sslv2 |
-                         asio::ssl::context::single_dh_use);
+                         asio::ssl::context::no_sslv3);
+    SSL_CTX_set_options(context_.native_handle(),
+                        SSL_OP_CIPHER_SERVER_PREFERENCE);
+    // ECDHE only, AEAD ciphers that kernel TLS can take over
+    groups("X25519:P-256");
+    ciphers("ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+            "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305:"
+            "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384",
+            "TLS_AES_128_GCM_SHA256:TLS_CHACHA20_POLY1305_SHA256:"
+            "TLS_AES_256_GCM_SHA384");
 
     context_.set_password_callback([](
         std::size_t max_length, asio::ssl::context::password_purpose purpose) {
@@ -167,12 +662,101 @@ private:
     });
     context_.use_private_key_file("Http/ssl/key.pem", asio::ssl::context::pem);
     context_.use_certificate_chain_file("Http/ssl/cert.pem");
-    context_.use_tmp_dh_file("Http/ssl/dh512.pem");
+    // lets connections with options->ktls move to kernel TLS
+    ktls_context(context_.native_handle());
+    tls_sessions_.attach(context_.native_handle());
+    // h2 offered to clients, unless options->http2 is unset
+    http2_alpn(context_.native_handle(), options);
   };
 
-private:
+public:
+  TlsSessions tls_sessions_; // resumption settings and handshake counters
+
+protected:
   asio::ssl::context context_;
+
+private:
+  std::string ciphers_;
+  std::string ciphersuites_;
+  std::string groups_;
+};
+
+/**
+ * @brief   An HTTPS server
+ */
+class HttpsServer : public GenericServer<HttpsServer>, public TlsContext {
+public:
+  explicit HttpsServer(const ServerAddr server_addr)
+      : GenericServer(server_addr), TlsContext(&connection_options_){};
+
+public:
+  /**
+   * @brief   Accept connection on shard's i-th acceptor into a new or
+   *          recycled session
+   */
+  void accept_connection(Shard &shard, std::size_t i) {
+    accept<SslSocket>(shard, i, context_);
+  }
+
+  /**
+   * @brief   Scheme of HTTPS
+   */
+  auto scheme() -> std::string { return "https"; }
+};
+
+/**
+ * @brief   A server of HTTP and HTTPS on several ports at once
+ *
+ *  Every listener feeds the same event loops, blocking_executor_ and
+ *  router_, so threads go wherever traffic is, be it mostly TLS or mostly
+ *  plaintext, and limits of connection_options_ hold across all of them
+ *
+ *    MultiServer app({"127.0.0.1", 8888}); // http on 8888
+ *    app.add_listener("https", 8889);
+ *    app.run();
+ */
+class MultiServer : public GenericServer<MultiServer>, public TlsContext {
+public:
+  explicit MultiServer(const ServerAddr server_addr)
+      : GenericServer(server_addr), TlsContext(&connection_options_),
+        listeners_{{"http", server_addr.second}} {};
+
+public:
+  /**
+   * @brief   Also listens on port, serving scheme, http or https
+   *          Throws std::invalid_argument for any other scheme
+   *          Takes effect on next call to run()
+   */
+  void add_listener(const std::string &scheme, int port) {
+    if (scheme != "http" && scheme != "https")
+      throw std::invalid_argument("unknown scheme " + scheme);
+    listeners_.push_back({scheme, port});
+  }
+
+  /**
+   * @brief   Ports listened on, port() first
+   */
+  auto listeners() -> std::vector<Listener> { return listeners_; }
+
+  /**
+   * @brief   Accept connection on shard's i-th acceptor into a new or
+   *          recycled session, TLS if its listener is https
+   */
+  void accept_connection(Shard &shard, std::size_t i) {
+    if (running_listeners_[i].scheme_ == "https")
+      accept<SslSocket>(shard, i, context_);
+    else
+      accept<TcpSocket>(shard, i);
+  }
+
+  /**
+   * @brief   Scheme of port()
+   */
+  auto scheme() -> std::string { return "http"; }
+
+private:
+  std::vector<Listener> listeners_; // for next run(), see add_listener()
 };
 }
 
-#endif
\ No newline at end of file
+#endif
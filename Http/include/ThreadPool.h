@@ -0,0 +1,86 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "asio.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace Http {
+
+/**
+ * @brief   A fixed number of threads running their own io_service,
+ *          executes work that would otherwise stall a server event loop
+ */
+class ThreadPool {
+public:
+  using Task = std::function<void()>;
+
+public:
+  /* non-copy-constructible */
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  explicit ThreadPool(std::size_t thread_count)
+      : io_service_(),
+        work_(std::make_unique<asio::io_service::work>(io_service_)) {
+    for (std::size_t i = 0; i < std::max<std::size_t>(thread_count, 1); ++i)
+      threads_.emplace_back([this] { run(); });
+  };
+
+  /**
+   * @brief   Finishes queued tasks, then joins threads
+   */
+  ~ThreadPool() {
+    work_.reset();
+    for (auto &thread : threads_)
+      thread.join();
+  }
+
+  /**
+   * @brief   Queues task to run on one of the threads
+   */
+  void post(Task task) {
+    ++queue_size_;
+    io_service_.post([this, task = std::move(task)] {
+      --queue_size_;
+      task();
+    });
+  }
+
+  std::size_t thread_count() const { return threads_.size(); }
+
+  /**
+   * @brief   Number of tasks posted but not yet started
+   */
+  std::size_t queue_size() const { return queue_size_; }
+
+private:
+  /**
+   * @brief   An exception escaping a task is logged, thread keeps running
+   */
+  void run() {
+    for (;;) {
+      try {
+        io_service_.run();
+        break;
+      } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+      }
+    }
+  }
+
+private:
+  asio::io_service io_service_;
+  std::unique_ptr<asio::io_service::work> work_; // keeps run() from returning
+  std::vector<std::thread> threads_;
+  std::atomic<std::size_t> queue_size_{0};
+};
+}
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "asio.hpp"
+#include "asio/basic_waitable_timer.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace Http {
+
+/**
+ * @brief   Hashed hierarchical timer wheel, one per io_service
+ *
+ *  Deadlines are rounded up to tick, never fire early, and fire at most
+ *  one tick late. Arming and cancelling are O(1); a single waitable timer
+ *  drives the wheel while any timer is armed, waking at the next tick with
+ *  timers due or else at the next cascade, so idle ticks are skipped
+ *
+ *    -- level 0, 256 slots of 1 tick      (2.56s)
+ *    -- level 1, 256 slots of 256 ticks   (~11min)
+ *    -- level 2, 256 slots of 65536 ticks (~46h), longer deadlines are
+ *       parked in the last slot and re-placed when it cascades
+ *
+ *  Callbacks run on a thread running the io_service, outside any strand.
+ *  With a shard per thread, each thread has an io_service and so a wheel of
+ *  its own, and the mutex is uncontended. With threads sharing one
+ *  io_service, a connection's handlers run on any of them, and re-arm or
+ *  cancel a deadline armed from another, so the wheel is shared and locked
+ *
+ *    auto &wheel = asio::use_service<TimerWheel>(io_service);
+ *    wheel.arm(timer, std::chrono::seconds(2), [] { ... });
+ *    wheel.cancel(timer);
+ */
+class TimerWheel : public asio::io_service::service {
+public:
+  using ClockType = std::chrono::steady_clock;
+  using Callback = std::function<void()>;
+
+  static asio::io_service::id id;
+  static constexpr auto tick = std::chrono::milliseconds(10);
+  static constexpr int slot_bits = 8;
+  static constexpr std::size_t slot_count = 1 << slot_bits;
+  static constexpr std::size_t level_count = 3;
+
+  /**
+   * @brief   A deadline that can be armed on at most one wheel at a time,
+   *          intrusive node of a slot list, cancelled on destruction
+   */
+  class Timer {
+  public:
+    /* non-copy-constructible */
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+    Timer() = default;
+    ~Timer() {
+      if (wheel_)
+        wheel_->cancel(*this);
+    }
+
+    /**
+     * @brief   Deadline last armed with, time_point::max() if cancelled
+     *          Wheel may run a callback of a deadline since re-armed,
+     *          callbacks compare this against now to tell
+     */
+    auto expires_at() const -> ClockType::time_point { return expires_at_; }
+
+  private:
+    friend class TimerWheel;
+    Timer *prev_ = nullptr;
+    Timer *next_ = nullptr;
+    Timer **slot_ = nullptr; // head of list linked into, null if not armed
+    std::uint64_t expiry_tick_ = 0;
+    ClockType::time_point expires_at_ = ClockType::time_point::max();
+    Callback callback_;
+    TimerWheel *wheel_ = nullptr; // last armed on
+  };
+
+public:
+  explicit TimerWheel(asio::io_service &io_service);
+
+  /**
+   * @brief   Arms timer, replacing any deadline it was armed with
+   */
+  void arm(Timer &timer, ClockType::time_point deadline, Callback callback);
+  void arm(Timer &timer, ClockType::duration timeout, Callback callback) {
+    arm(timer, ClockType::now() + timeout, std::move(callback));
+  }
+
+  /**
+   * @brief   Disarms timer, its callback is dropped
+   */
+  void cancel(Timer &timer);
+
+  /**
+   * @brief   Runs callbacks of timers with deadlines up to now
+   *          Called by the driving timer, exposed for tests
+   */
+  void advance(ClockType::time_point now);
+
+  /**
+   * @brief   Number of armed timers
+   */
+  std::size_t size() const;
+
+private:
+  void shutdown_service() override;
+
+  auto to_tick(ClockType::time_point time) const -> std::uint64_t;
+
+  /**
+   * @brief   Places timer in slot by its distance from current_tick_
+   */
+  void link(Timer &timer);
+  void unlink(Timer &timer);
+
+  /**
+   * @brief   Re-places timers of a slot at level > 0 onto lower levels
+   */
+  void cascade(std::size_t level, std::size_t slot);
+
+  /**
+   * @brief   Earliest tick after current_tick_ with timers in its level 0
+   *          slot, or the next cascade if none are due before it
+   */
+  auto next_tick() const -> std::uint64_t;
+
+  /**
+   * @brief   Starts driving timer for next_tick(), or moves it earlier,
+   *          unless nothing armed
+   */
+  void schedule();
+
+private:
+  using Slot = Timer *; // head of doubly linked list
+  std::array<std::array<Slot, slot_count>, level_count> levels_{};
+
+  mutable std::mutex mutex_;
+  ClockType::time_point start_ = ClockType::now(); // tick 0
+  std::uint64_t current_tick_ = 0;                 // processed up to
+  std::size_t size_ = 0;
+  bool scheduled_ = false;
+  std::uint64_t scheduled_tick_ = 0; // driving timer wakes at, if scheduled_
+  bool shutdown_ = false;
+  asio::basic_waitable_timer<ClockType> driver_;
+};
+}
+
+#endif
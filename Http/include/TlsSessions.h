@@ -0,0 +1,111 @@
+#ifndef TLSSESSIONS_H
+#define TLSSESSIONS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+
+#include <openssl/ssl.h>
+
+namespace Http {
+
+/**
+ * @brief   TLS session resumption for a server's SSL_CTX
+ *          -- session cache, bounded, shared by all io threads
+ *          -- session tickets, stateless, keys rotated every
+ *             ticket_key_rotation(), tickets under previous key still accepted
+ *             and renewed, TLS 1.3 resumes with these as well
+ *          -- handshake counters
+ */
+class TlsSessions {
+public:
+  using ClockType = std::chrono::steady_clock;
+
+  TlsSessions() = default;
+  TlsSessions(const TlsSessions &) = delete;
+  TlsSessions &operator=(const TlsSessions &) = delete;
+
+  /**
+   * @brief   Enables session cache and tickets on ctx, which must not
+   *          outlive this
+   */
+  void attach(SSL_CTX *ctx);
+
+  /**
+   * @brief   Get/Set number of sessions cached, oldest evicted beyond it,
+   *          OpenSSL's default of 20480 unless set
+   */
+  auto cache_size() -> std::size_t;
+  void cache_size(std::size_t size);
+
+  /**
+   * @brief   Get/Set how long a session may be resumed, cached or ticket,
+   *          1 hour unless set
+   */
+  auto lifetime() -> std::chrono::seconds;
+  void lifetime(std::chrono::seconds lifetime);
+
+  /**
+   * @brief   Get/Set interval between ticket key rotations
+   */
+  auto ticket_key_rotation() -> std::chrono::seconds;
+  void ticket_key_rotation(std::chrono::seconds interval);
+
+  /**
+   * @brief   Rotates ticket keys now, tickets issued under key before
+   *          the previous one no longer resume
+   */
+  void rotate_ticket_keys();
+
+  /**
+   * @brief   Number of sessions now in cache
+   */
+  auto cached() -> std::size_t;
+
+  /**
+   * @brief   Counts a server side handshake, ok if it succeeded,
+   *          into TlsSessions attached to its context
+   */
+  static void record_handshake(SSL *ssl, bool ok);
+
+  std::atomic<std::size_t> full_handshakes_{0};
+  std::atomic<std::size_t> resumed_handshakes_{0};
+  std::atomic<std::size_t> failed_handshakes_{0};
+
+private:
+  struct TicketKey {
+    unsigned char name_[16];
+    unsigned char aes_key_[32];
+    unsigned char hmac_key_[32];
+  };
+
+  /**
+   * @brief   Picks key to encrypt a new ticket, or key named name to
+   *          decrypt one, returns 0 if none, 1 if found, 2 if found but
+   *          ticket should be renewed
+   */
+  auto ticket_key(const unsigned char *name, bool encrypt, TicketKey &key)
+      -> int;
+
+  /**
+   * @brief   Makes current key previous one, and a new current key,
+   *          mutex_ held
+   */
+  void rotate(ClockType::time_point now);
+
+  static auto from(SSL *ssl) -> TlsSessions *;
+  friend struct TicketKeyCallback;
+
+private:
+  SSL_CTX *ctx_ = nullptr;
+  std::mutex mutex_; // guards ticket keys, used by handshakes on any thread
+  TicketKey current_;
+  TicketKey previous_;
+  bool has_previous_ = false;
+  ClockType::time_point rotated_at_;
+  std::chrono::seconds rotation_ = std::chrono::hours(1);
+};
+}
+
+#endif
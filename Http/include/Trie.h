@@ -134,6 +134,23 @@ public:
   Trie()
       : root_(std::make_shared<TrieNode>(nullptr)), size_(0){};
 
+  /**
+   * @brief   Copies are deep, a copy shares no node with the original
+   */
+  Trie(const Trie &other)
+      : root_(clone(*other.root_, nullptr)), size_(other.size_){};
+  Trie &operator=(const Trie &other)
+  {
+    if (this != &other)
+    {
+      root_ = clone(*other.root_, nullptr);
+      size_ = other.size_;
+    }
+    return *this;
+  }
+  Trie(Trie &&other) = default;
+  Trie &operator=(Trie &&other) = default;
+
   /**
    * @brief   Iterator related functions
    */
@@ -433,6 +450,18 @@ private:
     return std::make_unique<TrieNode>(parent);
   }
 
+  /**
+   * @brief   Recursively copies subtree rooted at node, 
+   *          copied root is attached to parent
+   */
+  auto static clone(const TrieNode &node, node_ptr parent) -> uniq_node_ptr
+  {
+    auto copy = std::make_unique<TrieNode>(parent, node.data_);
+    for (const auto &child : node.child_)
+      copy->child_.emplace(child.first, clone(*child.second, copy.get()));
+    return copy;
+  }
+
   /**
    * @brief   Find a TrieNode in Trie rooted at node 
    *          with key equivalent to key, If no exact match, 
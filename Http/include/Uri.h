@@ -33,7 +33,12 @@ public:
   auto consume(char c) -> ParseStatus;
 
   /**
-   * @brief   Decodes fields in uri
+   * @brief   Resets to an empty uri, keeps allocated capacity of fields
+   */
+  auto clear() -> void;
+
+  /**
+   * @brief   Decodes fields in uri, in place, those without a % are left as is
    */
   auto decode() -> void;
   /**
@@ -57,8 +62,10 @@ public:
 
   /**
    * @brief   Convert a query string to a map of key-value pairs
+   *          Second form inserts into query_map, keeping its allocator
    */
   auto static make_query(const std::string &query) -> ssmap;
+  auto static make_query(const std::string &query, ssmap &query_map) -> void;
 
 public:
   friend auto operator<<(std::ostream &strm, Uri uri) -> std::ostream &;
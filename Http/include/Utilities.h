@@ -1,10 +1,13 @@
 #ifndef UTILITIES_H
 #define UTILITIES_H
 
+#include <algorithm>
+#include <cctype>
 #include <cstddef>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <system_error>
 #include <type_traits>
 #include <typeinfo>
 #include <unordered_map>
@@ -24,6 +27,29 @@ auto concat(InputIter begin, InputIter end) -> std::string{
   return s;
 }
 
+static inline auto to_lower(std::string s) -> std::string {
+  std::transform(s.begin(), s.end(), s.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return s;
+}
+
+/**
+ * @brief   strips optional whitespace, SP and HTAB, off both ends
+ */
+static inline auto trim(const std::string &s) -> std::string {
+  auto begin = s.find_first_not_of(" \t");
+  if (begin == std::string::npos)
+    return "";
+  return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+}
+
+/**
+ * @brief   Passed to callbacks of chunks never to be written
+ */
+static inline auto aborted() -> std::error_code {
+  return std::make_error_code(std::errc::operation_canceled);
+}
+
 static inline auto split(std::string s, char delim)
     -> std::pair<std::string, std::string> {
   auto pos = s.find(delim);
@@ -24,11 +24,16 @@ using namespace asio;
 using namespace Http;
 using nlohmann::json;
 
-template<typename ServerType>
-void start_server(int port){
+int main(int argc, char**argv) {
+
+  try {
+
+    // http on 8888, https on 8889, one pool of threads for both
     ServerAddr server_address =
-        std::make_pair("127.0.0.1", port);
-    auto app = std::make_unique<ServerType>(server_address);
+        std::make_pair("127.0.0.1", 8888);
+    auto app = std::make_unique<MultiServer>(server_address);
+    app->add_listener("https", 8889);
+    app->thread_count(std::thread::hardware_concurrency());
 
     app->router_.get("/r", Handler([](Context &ctx) {
                        // url query parser
@@ -40,23 +45,12 @@ void start_server(int port){
                        std::cout << std::setw(4) << urlparse << std::endl;
                      }));
 
-    std::cout << "app starts running on " << 
-      app->host() << std::to_string(app->port()) << std::endl;
+    for (const auto &listener : app->listeners())
+      std::cout << "app starts running on " << listener.scheme_ << "://"
+                << app->host() << ":" << listener.port_ << std::endl;
     std::cout << app->router_ << std::endl;
-                     
-    app->run();
-}
-
 
-int main(int argc, char**argv) {
-
-  try {
-
-    std::thread httpserver_task(start_server<HttpServer>, 8888);
-    std::thread httpsserver_task(start_server<HttpsServer>, 8889);
-
-    httpserver_task.join();
-    httpsserver_task.join();
+    app->run();
 
   } catch (const std::exception e) {
     std::cerr << e.what() << std::endl;
@@ -0,0 +1,169 @@
+#include <algorithm> // max
+#include <cstdlib>   // strtod
+
+#include <zlib.h>
+#ifdef HTTP_ZSTD
+#include <zstd.h>
+#endif
+
+#include "Compression.h"
+#include "Utilities.h" // to_lower, trim
+
+namespace Http {
+
+namespace {
+
+/**
+ * @brief   zlib stream of a thread, kept across bodies, reset in between
+ *          window_bits picks the wrapper, 16 + 15 for gzip, 15 for zlib,
+ *          which is what HTTP calls deflate
+ */
+struct Deflater {
+  ~Deflater() {
+    if (initialized_)
+      deflateEnd(&stream_);
+  }
+
+  bool reset(int window_bits, int level) {
+    if (initialized_ && window_bits == window_bits_ && level == level_)
+      return deflateReset(&stream_) == Z_OK;
+    if (initialized_)
+      deflateEnd(&stream_);
+    stream_ = z_stream();
+    initialized_ = deflateInit2(&stream_, level, Z_DEFLATED, window_bits, 8,
+                                Z_DEFAULT_STRATEGY) == Z_OK;
+    window_bits_ = window_bits;
+    level_ = level;
+    return initialized_;
+  }
+
+  z_stream stream_ = z_stream();
+  bool initialized_ = false;
+  int window_bits_ = 0;
+  int level_ = 0;
+};
+
+bool deflate_body(int window_bits, const std::string &in, std::string &out,
+                  int level) {
+  thread_local Deflater deflater;
+  if (!deflater.reset(window_bits, level < 0 ? Z_DEFAULT_COMPRESSION : level))
+    return false;
+
+  auto &stream = deflater.stream_;
+  out.resize(deflateBound(&stream, in.size()));
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+  stream.avail_in = in.size();
+  stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+  stream.avail_out = out.size();
+  if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+    return false;
+  out.resize(stream.total_out);
+  return true;
+}
+
+#ifdef HTTP_ZSTD
+struct ZstdContext {
+  ~ZstdContext() { ZSTD_freeCCtx(context_); }
+  ZSTD_CCtx *context_ = ZSTD_createCCtx();
+};
+
+bool zstd_body(const std::string &in, std::string &out, int level) {
+  thread_local ZstdContext zstd;
+  if (!zstd.context_)
+    return false;
+  out.resize(ZSTD_compressBound(in.size()));
+  auto size = ZSTD_compressCCtx(zstd.context_, &out[0], out.size(), in.data(),
+                                in.size(),
+                                level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+  if (ZSTD_isError(size))
+    return false;
+  out.resize(size);
+  return true;
+}
+#endif
+}
+
+auto coding_to_string(ContentCoding coding) -> const char * {
+  switch (coding) {
+  case ContentCoding::gzip:
+    return "gzip";
+  case ContentCoding::deflate:
+    return "deflate";
+  case ContentCoding::zstd:
+    return "zstd";
+  default:
+    return "identity";
+  }
+}
+
+bool coding_available(ContentCoding coding) {
+#ifndef HTTP_ZSTD
+  if (coding == ContentCoding::zstd)
+    return false;
+#endif
+  return true;
+}
+
+auto negotiate_coding(const std::string &accept_encoding) -> ContentCoding {
+  // q-values of zstd, gzip, deflate, by order of preference, -1 if unlisted
+  const ContentCoding preference[] = {ContentCoding::zstd, ContentCoding::gzip,
+                                      ContentCoding::deflate};
+  double q[] = {-1, -1, -1};
+  double any = -1; // of *
+
+  std::size_t begin = 0;
+  while (begin < accept_encoding.size()) {
+    auto end = accept_encoding.find(',', begin);
+    if (end == std::string::npos)
+      end = accept_encoding.size();
+    auto element = accept_encoding.substr(begin, end - begin);
+    begin = end + 1;
+
+    auto semicolon = element.find(';');
+    auto coding = to_lower(trim(element.substr(0, semicolon)));
+
+    double weight = 1;
+    if (semicolon != std::string::npos) {
+      auto parameter = trim(element.substr(semicolon + 1));
+      if (parameter.size() > 2 && (parameter[0] == 'q' || parameter[0] == 'Q') &&
+          parameter[1] == '=')
+        weight = std::strtod(parameter.c_str() + 2, nullptr);
+    }
+
+    if (coding == "*")
+      any = weight;
+    else if (coding == "x-gzip")
+      q[1] = std::max(q[1], weight);
+    for (std::size_t i = 0; i < 3; ++i)
+      if (coding == coding_to_string(preference[i]))
+        q[i] = weight;
+  }
+
+  auto best = ContentCoding::identity;
+  double best_q = 0;
+  for (std::size_t i = 0; i < 3; ++i) {
+    auto weight = q[i] < 0 ? any : q[i];
+    if (weight > best_q && coding_available(preference[i])) {
+      best = preference[i];
+      best_q = weight;
+    }
+  }
+  return best;
+}
+
+bool compress(ContentCoding coding, const std::string &in, std::string &out,
+              int level) {
+  switch (coding) {
+  case ContentCoding::gzip:
+    return deflate_body(16 + MAX_WBITS, in, out, level);
+  case ContentCoding::deflate:
+    return deflate_body(MAX_WBITS, in, out, level);
+#ifdef HTTP_ZSTD
+  case ContentCoding::zstd:
+    return zstd_body(in, out, level);
+#endif
+  default:
+    return false;
+  }
+}
+}
@@ -1,12 +1,25 @@
 #include "asio.hpp"
 #include "asio/ssl.hpp"
 
+#include <algorithm> // min
+#include <cerrno>
+#include <cstdio> // snprintf
 #include <iostream>
-#include <iterator> // advance
+#include <iterator> // advance, make_move_iterator
 #include <utility>  // enable_shared_from_this, move
 
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
 #include "Connection.h"
+#include "Http2.h"
+#include "TlsSessions.h"
 #include "Uri.h"
+#include "Utilities.h"
 #include "Constants.h"
 
 using namespace std;
@@ -15,159 +28,839 @@ namespace Http {
 
 template<typename SocketType> 
 void Connection<SocketType>::stop(){
-  read_deadline_.cancel();
+  stopped_ = true;
+  timer_wheel_.cancel(deadline_);
 }
 
 template<typename SocketType>
-void Connection<SocketType>::terminate() {};
-
-template<>
-void Connection<TcpSocket>::terminate(){
+void Connection<SocketType>::terminate(){
   stop();
-  socket_.shutdown(asio::ip::tcp::socket::shutdown_both);
-  socket_.close();
+  asio::error_code ignored_ec;
+  socket_.shutdown(SocketType::shutdown_both, ignored_ec);
+  socket_.close(ignored_ec);
 }
 
 template<>
 void Connection<SslSocket>::terminate(){
   stop();
-  socket_.async_shutdown(
+  if (zero_copy_) {
+    // OpenSSL no longer knows the record sequence, skip its close_notify,
+    // marked as sent all the same, so that the session stays resumable
+    SSL_set_shutdown(socket_.native_handle(), SSL_SENT_SHUTDOWN);
+    asio::error_code ignored_ec;
+    socket_.lowest_layer().shutdown(asio::ip::tcp::socket::shutdown_both, ignored_ec);
+    socket_.lowest_layer().close(ignored_ec);
+    return;
+  }
+  socket_.async_shutdown(wrap(
     [this, self=this->shared_from_this()](std::error_code ec) { 
-    socket_.lowest_layer().close(); 
-  });
+    asio::error_code ignored_ec;
+    socket_.lowest_layer().close(ignored_ec); 
+  }));
+}
+
+template<typename SocketType>
+bool Connection<SocketType>::recycle() {
+  if (!options_.connection_pool_size)
+    return false;
+
+  stop();
+  asio::error_code ignored_ec;
+  socket_.close(ignored_ec);
+  if (counted_)
+    --admission_.open_connections_;
+  counted_ = shed_ = false;
+
+  reset();
+  buffer_begin_ = buffer_end_ = 0;
+  admission_.unsent_bytes_ -= outgoing_bytes_ + chunk_bytes_;
+  outgoing_.clear();
+  outgoing_bytes_ = 0;
+  gathered_.clear();
+  file_text_.clear();
+  record_bytes_ = 0;
+  next_handler_ = 0;
+  pending_.reset();
+  keep_alive_ = idle_ = writing_ = stopped_ = zero_copy_ = corked_ = false;
+  streaming_ = head_queued_ = stream_ended_ = chunked_ = false;
+  ++stream_id_;
+  chunks_.clear();
+  chunks_in_flight_ = 0;
+  chunk_bytes_ = 0;
+  parked_.clear();
+  write_progress_ = 0;
+  trailers_.clear();
+  request_count_ = 0;
+  return true;
+}
+
+template<>
+bool Connection<SslSocket>::recycle() { return false; }
+
+template<typename SocketType>
+constexpr std::size_t Connection<SocketType>::file_chunk_size;
+
+template<typename SocketType>
+void Connection<SocketType>::send_file(std::size_t i) {
+#ifdef __linux__
+  if (!zero_copy_)
+    return copy_file(i);
+
+  auto &file = outgoing_[i].file_;
+  auto &socket = tcp_layer(socket_);
+  socket.native_non_blocking(true);
+
+  while (file.length_) {
+    off_t offset = file.offset_;
+    auto n = ::sendfile(socket.native_handle(), *file.fd_, &offset,
+                        file.length_);
+    if (n > 0) {
+      file.offset_ += n;
+      file.length_ -= n;
+      if (!keep_pace(n))
+        return finish_flush(false);
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // socket buffer is full, resume once writable
+      arm_deadline(options_.write_timeout);
+      socket.async_write_some(asio::null_buffers(), wrap(
+        [this, self = this->shared_from_this(), i]
+          (std::error_code ec, std::size_t) {
+          if (ec)
+            return finish_flush(false);
+          send_file(i);
+      }));
+      return;
+    }
+    // error, or file shrank and Content-Length can no longer be met
+    return finish_flush(false);
+  }
+
+  if (next_part(i))
+    return;
+  cork(false);
+  send_queued(i + 1);
+#else
+  copy_file(i);
+#endif
+}
+
+template<typename SocketType>
+bool Connection<SocketType>::next_part(std::size_t i) {
+  auto &file = outgoing_[i].file_;
+  if (!file.parts_.empty()) {
+    auto &part = file.parts_.front();
+    file_text_ = std::move(part.prefix_);
+    file.offset_ = part.offset_;
+    file.length_ = part.length_;
+    file.parts_.erase(file.parts_.begin());
+  } else if (!file.suffix_.empty()) {
+    file_text_ = std::move(file.suffix_);
+    file.suffix_.clear();
+  } else {
+    return false;
+  }
+
+  gathered_.assign({asio::buffer(file_text_)});
+  send_gathered(i, true);
+  return true;
 }
 
+template<typename SocketType>
+void Connection<SocketType>::cork(bool enable) {
+#ifdef __linux__
+  if (std::is_same<SocketType, UnixSocket>::value)
+    return;
+  if (!zero_copy_ && !options_.cork)
+    return;
+  // with options_.cork, only finish_flush() lets go
+  if (!enable && options_.cork && writing_)
+    return;
+  if (enable == corked_)
+    return;
+  corked_ = enable;
+  int value = enable;
+  ::setsockopt(tcp_layer(socket_).native_handle(), IPPROTO_TCP, TCP_CORK,
+               &value, sizeof(value));
+#endif
+}
 
 template<typename SocketType>
-void Connection<SocketType>::start() {}
+auto Connection<SocketType>::size_records(std::size_t bytes) -> std::size_t {
+  return bytes;
+}
 
 template<>
-void Connection<TcpSocket>::start() { 
-  read(); 
+auto Connection<SslSocket>::size_records(std::size_t bytes) -> std::size_t {
+  // kernel TLS sizes its own records
+  if (zero_copy_ || !options_.tls_small_record_bytes)
+    return bytes;
+
+  // after an idle period, TCP restarts from a small congestion window
+  auto now = ClockType::now();
+  if (now - last_write_ > options_.tls_record_reset)
+    record_bytes_ = 0;
+  last_write_ = now;
+
+  // lowering the max lowers the split fragment too, raising it does not
+  auto ssl = socket_.native_handle();
+  if (record_bytes_ >= options_.tls_small_record_bytes) {
+    SSL_set_max_send_fragment(ssl, SSL3_RT_MAX_PLAIN_LENGTH);
+    SSL_set_split_send_fragment(ssl, SSL3_RT_MAX_PLAIN_LENGTH);
+    return bytes;
+  }
+  SSL_set_max_send_fragment(ssl, options_.tls_small_record);
+  bytes = std::min(bytes, options_.tls_small_record_bytes - record_bytes_);
+  record_bytes_ += bytes;
+  return bytes;
+}
 
-  read_deadline_.async_wait(
-    [this, self=this->shared_from_this()]
-      (std::error_code ec){
-      check_read_deadline();
-  });
+template<typename SocketType>
+void Connection<SocketType>::start() { 
+  context_.make_completion_ = [this] { return defer(); };
+  context_.make_stream_ = [this] { return stream(); };
+  admit();
+#ifdef __linux__
+  zero_copy_ = true;
+#endif
+  read(); 
 }
 
 template<>
 void Connection<SslSocket>::start(){
+  context_.make_completion_ = [this] { return defer(); };
+  context_.make_stream_ = [this] { return stream(); };
+  admit();
+  // the 503 would cost a handshake, spared if so configured
+  if (shed_ && options_.shed_tls_before_handshake) {
+    stop();
+    asio::error_code ignored_ec;
+    socket_.lowest_layer().close(ignored_ec);
+    return;
+  }
 
-  socket_.async_handshake(asio::ssl::stream_base::server,
+  socket_.async_handshake(asio::ssl::stream_base::server, wrap(
     [this, self=this->shared_from_this()]
       (std::error_code ec){
+        TlsSessions::record_handshake(socket_.native_handle(), !ec);
         if(!ec){
+          // from here on, kernel encrypts what is written to the TCP socket
+          zero_copy_ = options_.ktls &&
+            ktls_start_tx(socket_.native_handle(), socket_.lowest_layer().native_handle());
+          if (options_.http2 && http2_negotiated(socket_.native_handle()))
+            return start_http2();
           read();
-          read_deadline_.async_wait(
-            [this, self=this->shared_from_this()]
-              (std::error_code ec){
-              check_read_deadline();
-          });
         }
-      });
+      }));
 }
 
 template<typename SocketType>
 void Connection<SocketType>::send_read_timeout(){
+  // aborts pending read, so that its completion does not race the 408
+  asio::error_code ignored_ec;
+  socket_.lowest_layer().cancel(ignored_ec);
+  keep_alive_ = false;
   response_.status_code(StatusCode::Request_Timeout);
   write();
 }
 
 template<typename SocketType>
-void Connection<SocketType>::check_read_deadline(){
-  if(read_deadline_.expires_at() <= ClockType::now()){
+void Connection<SocketType>::arm_deadline(ClockType::duration timeout){
+  std::weak_ptr<Connection> weak = this->shared_from_this();
+  timer_wheel_.arm(deadline_, timeout, [this, weak] {
+    if (auto self = weak.lock())
+      post([this, self] { check_deadline(); });
+  });
+}
+
+template<typename SocketType>
+void Connection<SocketType>::check_deadline(){
+  // fired for a deadline since re-armed or cancelled
+  if(stopped_ || deadline_.expires_at() > ClockType::now())
+    return;
+
+  if(writing_ || idle_)
+    terminate();
+  else
     send_read_timeout();
-  } else {
-    read_deadline_.async_wait(
-      [this, self=this->shared_from_this()]
-        (std::error_code ec){
-        check_read_deadline();
-    });
-  }
 }
 
 
 template<typename SocketType>
 void Connection<SocketType>::read() {
 
-  read_deadline_.expires_from_now(read_timeout);
+  arm_deadline(idle_ ? options_.idle_timeout : options_.read_timeout);
 
   asio::async_read(
     socket_, 
     asio::buffer(buffer_), 
     asio::transfer_at_least(1),
-    [ this, self = this->shared_from_this() ]
+    wrap([ this, self = this->shared_from_this() ]
       (std::error_code ec, std::size_t bytes_read) {
 
       assert(this == self.get());
       if (!ec) {
-        decltype(buffer_.begin()) begin;
-        ParseStatus parse_status;
-
-        std::tie(begin, parse_status) =
-            request_parser_.parse(request_, buffer_.begin(),
-                                  buffer_.begin() + bytes_read);
-
-        /**
-        * Current buffer is fully read, branch on ParseStatus
-        *    -- in_progress,
-        *        so continue do async read
-        *    -- accept,
-        *        request header parsing finished
-        *    -- reject,
-        *        request has malformed syntax, send 400
-        */
-        switch (parse_status) {
-        case ParseStatus::in_progress: {
-          read();
-          break;
-        }
-        case ParseStatus::accept: {
-          response_.status_code(StatusCode::OK);
-          response_.version_major_ = request_.version_major_;
-          response_.version_minor_ = request_.version_minor_;
-          request_.query_ = Uri::make_query(request_.uri_.query_);
-
-          auto handlers = router_.resolve(request_);
-          for (auto &handler : handlers) {
-            handler(context_);
+        idle_ = false;
+        buffer_begin_ = 0;
+        buffer_end_ = bytes_read;
+        // h2c with prior knowledge, preface in place of the first request
+        if (!std::is_same<SocketType, SslSocket>::value && options_.http2 &&
+            !request_count_ &&
+            request_parser_.state_ == RequestParser::State::req_start &&
+            http2_preface(buffer_.data(), buffer_end_))
+          return read_preface();
+        parse_buffered();
+      } 
+    }));
+}
+
+template<typename SocketType>
+void Connection<SocketType>::read_preface() {
+  if (buffer_end_ >= http2_preface_size)
+    return start_http2();
+
+  asio::async_read(
+    socket_,
+    asio::buffer(buffer_.data() + buffer_end_, http2_preface_size - buffer_end_),
+    asio::transfer_all(),
+    wrap([ this, self = this->shared_from_this() ]
+      (std::error_code ec, std::size_t bytes_read) {
+      if (ec)
+        return;
+      buffer_end_ += bytes_read;
+      if (!http2_preface(buffer_.data(), buffer_end_))
+        return terminate();
+      start_http2();
+    }));
+}
+
+template<typename SocketType>
+void Connection<SocketType>::start_http2() {
+  // session keeps its own deadlines, on deadline_
+  timer_wheel_.cancel(deadline_);
+  std::make_shared<Http2Session<SocketType>>(this->shared_from_this())
+      ->start(buffer_.data() + buffer_begin_, buffer_end_ - buffer_begin_);
+}
+
+template<typename SocketType>
+void Connection<SocketType>::parse_buffered() {
+  if (buffer_begin_ == buffer_end_) {
+    // queued responses go out before waiting on the client
+    if (!outgoing_.empty())
+      return flush();
+    idle_ = request_parser_.state_ == RequestParser::State::req_start;
+    if (idle_ && admission_.draining_)
+      return terminate();
+    return read();
+  }
+
+  decltype(buffer_.begin()) begin;
+  ParseStatus parse_status;
+
+  std::tie(begin, parse_status) =
+      request_parser_.parse(request_, buffer_.begin() + buffer_begin_,
+                            buffer_.begin() + buffer_end_);
+  buffer_begin_ = begin - buffer_.begin();
+
+  /**
+  * Branch on ParseStatus
+  *    -- in_progress,
+  *        buffer is used up, so continue do async read
+  *    -- accept,
+  *        request header parsing finished, 
+  *        bytes left in buffer are kept for the next request
+  *    -- reject,
+  *        request has malformed syntax, send 400
+  */
+  switch (parse_status) {
+  case ParseStatus::in_progress: {
+    parse_buffered();
+    break;
+  }
+  case ParseStatus::accept: {
+    // an unread body would be taken for the next request, so close after it
+    keep_alive_ = !request_.has_body() && request_.keep_alive() &&
+                  ++request_count_ < options_.max_requests &&
+                  !admission_.draining_;
+    handle();
+    break;
+  }
+
+  case ParseStatus::reject: {
+    keep_alive_ = false;
+    response_.status_code(StatusCode::Bad_Request);
+    write();
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+template<typename SocketType>
+void Connection<SocketType>::handle() {
+  // request is in, handlers may take longer than read_timeout
+  timer_wheel_.cancel(deadline_);
+
+  response_.status_code(StatusCode::OK);
+  response_.version_major_ = request_.version_major_;
+  response_.version_minor_ = request_.version_minor_;
+  Uri::make_query(request_.uri_.query_, request_.query_);
+
+  handlers_ = router_.resolve(request_);
+  if (shed_ || !admit_handlers())
+    return send_overloaded();
+  run_handlers(0);
+}
+
+template<typename SocketType>
+void Connection<SocketType>::admit() {
+  auto open = ++admission_.open_connections_;
+  if (options_.max_connections && open > options_.max_connections) {
+    --admission_.open_connections_;
+    ++admission_.shed_connections_;
+    shed_ = true;
+    return;
+  }
+  counted_ = true;
+}
+
+template<typename SocketType>
+bool Connection<SocketType>::admit_handlers() {
+  for (const auto &handler : handlers_) {
+    if (!handler.max_in_flight_)
+      continue;
+    in_flight_.push_back(handler.in_flight_);
+    if (++*handler.in_flight_ > handler.max_in_flight_) {
+      ++admission_.shed_requests_;
+      return false;
+    }
+  }
+  return true;
+}
+
+template<typename SocketType>
+void Connection<SocketType>::send_overloaded() {
+  keep_alive_ = false;
+  // head is out already, cut the stream short instead
+  if (streaming_)
+    return end_stream();
+  reset();
+  outgoing_.emplace_back();
+  outgoing_.back().write_payload(admission_.overloaded_payload_);
+  flush();
+}
+
+template<typename SocketType>
+void Connection<SocketType>::reset() {
+  request_.clear();
+  arena_.reset();
+  response_.clear();
+  request_parser_.reset();
+  handlers_.clear();
+  for (auto &in_flight : in_flight_)
+    --*in_flight;
+  in_flight_.clear();
+}
+
+template<typename SocketType>
+void Connection<SocketType>::run_handlers(std::size_t i) {
+  for (; i < handlers_.size(); ++i) {
+    next_handler_ = i + 1;
+
+    if (handlers_[i].blocking_) {
+      if (options_.max_blocking_queue &&
+          blocking_executor_.queue_size() >= options_.max_blocking_queue) {
+        ++admission_.shed_blocking_;
+        return send_overloaded();
+      }
+
+      blocking_executor_.post(
+        [this, self = this->shared_from_this(), i] {
+          auto next = i + 1;
+          try {
+            handlers_[i](context_);
+            if (suspended())
+              return;
+          } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            pending_.reset();
+            response_.status_code(StatusCode::Internal_Server_Error);
+            next = handlers_.size();
           }
+          post([this, self, next] { run_handlers(next); });
+        });
+      return;
+    }
+
+    handlers_[i](context_);
+    if (suspended())
+      return;
+  }
+  write();
+}
 
-          write();
-          break;
-        }
+template<typename SocketType>
+auto Connection<SocketType>::defer() -> Context::Completion {
+  auto pending = std::make_shared<std::atomic<int>>(2);
+  pending_ = pending;
+
+  return [this, self = this->shared_from_this(), pending, next = next_handler_] {
+    if (--*pending == 0)
+      post([this, self, next] { run_handlers(next); });
+  };
+}
 
-        case ParseStatus::reject: {
-          response_.status_code(StatusCode::Bad_Request);
-          write();
-          break;
-        }
-        default:
-          break;
-        }
-      } 
-    });
+template<typename SocketType>
+bool Connection<SocketType>::suspended() {
+  if (!pending_)
+    return false;
+  auto pending = std::move(pending_);
+  return --*pending != 0;
 }
 
 template<typename SocketType>
 void Connection<SocketType>::write() {
+  if (streaming_)
+    return end_stream();
+
+  // client finds end of a kept-alive response by Content-Length
+  if (!response_.get_header("Content-Length").second)
+    response_.content_length(response_.body_.size());
+  response_.set_header({"Connection", keep_alive_ ? "keep-alive" : "close"});
+
+  // body is moved, not copied, into the queue
+  outgoing_bytes_ += response_.body_.size();
+  admission_.unsent_bytes_ += response_.body_.size();
+  outgoing_.push_back(std::move(response_));
+  reset();
+
+  bool pipelined = buffer_begin_ != buffer_end_;
+  if (keep_alive_ && pipelined &&
+      outgoing_.size() < options_.max_pipeline_depth &&
+      outgoing_bytes_ < options_.write_batch_bytes)
+    parse_buffered();
+  else
+    flush();
+}
+
+template<typename SocketType>
+void Connection<SocketType>::flush() {
+  writing_ = true;
+  if (options_.cork)
+    cork(true);
+  write_start_ = ClockType::now();
+  write_progress_ = 0;
+  arm_deadline(options_.write_timeout);
+  send_queued(0);
+}
+
+template<typename SocketType>
+void Connection<SocketType>::send_queued(std::size_t i) {
+  if (i == outgoing_.size())
+    return finish_flush(true);
+
+  // gather responses up to and including the next with a file body
+  gathered_.clear();
+  auto j = i;
+  for (; j < outgoing_.size(); ++j) {
+    auto response_buffers = outgoing_[j].to_buffers();
+    gathered_.insert(gathered_.end(), response_buffers.begin(),
+                     response_buffers.end());
+    if (outgoing_[j].file_)
+      break;
+  }
+
+  bool file_follows = j < outgoing_.size();
+  if (file_follows)
+    cork(true);
+  send_gathered(j, file_follows);
+}
+
+template<typename SocketType>
+void Connection<SocketType>::send_gathered(std::size_t j, bool file_follows) {
+  // up to send_window, as much as goes out in records of the current size,
+  // a slow reader shows in keep_pace() as it goes, see paced()
+  std::vector<asio::const_buffer> buffers;
+  auto bytes = asio::buffer_size(gathered_);
+  if (options_.send_window)
+    bytes = std::min(bytes, options_.send_window);
+  bytes = size_records(bytes);
+  auto requested = bytes;
+  auto k = std::size_t{0};
+  for (; k < gathered_.size() && bytes; ++k) {
+    auto size = std::min(bytes, asio::buffer_size(gathered_[k]));
+    buffers.push_back(asio::buffer(gathered_[k], size));
+    bytes -= size;
+    if (size < asio::buffer_size(gathered_[k])) {
+      gathered_[k] = gathered_[k] + size;
+      break;
+    }
+  }
+  gathered_.erase(gathered_.begin(), gathered_.begin() + k);
+
+  auto handler = wrap([ this, self = this->shared_from_this(), j, file_follows,
+                        requested ](
+        std::error_code ec, std::size_t bytes_written) {
+      // cut short by paced(), below min_send_rate
+      if (ec || bytes_written < requested)
+        return finish_flush(false);
+      if (!gathered_.empty())
+        send_gathered(j, file_follows);
+      else if (file_follows)
+        send_file(j);
+      else
+        finish_flush(true);
+    });
 
+  ++write_count_;
+  if (zero_copy_)
+    asio::async_write(tcp_layer(socket_), buffers, paced(), handler);
+  else
+    asio::async_write(socket_, buffers, paced(), handler);
+}
 
+template<typename SocketType>
+void Connection<SocketType>::copy_file(std::size_t i) {
+  auto &file = outgoing_[i].file_;
+  if (!file.length_) {
+    if (next_part(i))
+      return;
+    cork(false);
+    return send_queued(i + 1);
+  }
+
+  file_buffer_.resize(size_records(std::min(file.length_, file_chunk_size)));
+  auto n = ::pread(*file.fd_, file_buffer_.data(), file_buffer_.size(),
+                   file.offset_);
+  // file shrank, Content-Length can no longer be met
+  if (n <= 0)
+    return finish_flush(false);
+  file.offset_ += n;
+  file.length_ -= n;
+
+  arm_deadline(options_.write_timeout);
+  ++write_count_;
   asio::async_write(
-    socket_, 
-    asio::buffer(response_.to_payload()),
-    asio::transfer_all(),
-    [ this, self = this->shared_from_this() ](
+    socket_,
+    asio::buffer(file_buffer_.data(), n),
+    paced(),
+    wrap([ this, self = this->shared_from_this(), i, n ](
         std::error_code ec, std::size_t bytes_written) {
+      if (ec || bytes_written < std::size_t(n))
+        return finish_flush(false);
+      copy_file(i);
+    }));
+}
 
-      if (!ec) {
-        terminate();
-      }
-    });
+template<typename SocketType>
+auto Connection<SocketType>::stream() -> Context::StreamPtr {
+  streaming_ = true;
+  return std::make_shared<ChunkedStream>(this->shared_from_this(), stream_id_);
+}
+
+template<typename SocketType>
+void Connection<SocketType>::write_chunk(std::size_t id, std::string chunk,
+                                         BodyStream::Callback on_written) {
+  if (id != stream_id_ || stopped_) {
+    if (on_written)
+      on_written(aborted(), 0);
+    return;
+  }
+  if (chunk.empty()) {
+    if (on_written)
+      on_written({}, 0);
+    return;
+  }
+
+  if (!head_queued_)
+    start_stream();
+  std::string size_line;
+  if (chunked_) {
+    char hex[2 * sizeof(std::size_t) + 3];
+    std::snprintf(hex, sizeof(hex), "%zx\r\n", chunk.size());
+    size_line = hex;
+  }
+  chunk_bytes_ += chunk.size();
+  admission_.unsent_bytes_ += chunk.size();
+  chunks_.push_back({std::move(size_line), std::move(chunk), std::move(on_written)});
+  send_chunks();
+}
+
+template<typename SocketType>
+void Connection<SocketType>::when_writable(std::size_t id,
+                                           std::function<void()> resume) {
+  // an ended stream's writes are aborted, no need to wait for them
+  if (id != stream_id_ || stopped_ || !options_.send_window ||
+      chunk_bytes_ < options_.send_window)
+    return resume();
+  parked_.push_back(std::move(resume));
 }
 
+template<typename SocketType>
+void Connection<SocketType>::resume_parked() {
+  if (parked_.empty())
+    return;
+  if (!stopped_ && chunk_bytes_ >= options_.send_window)
+    return;
+  // resumed producers may park again right away
+  auto parked = std::move(parked_);
+  parked_.clear();
+  for (auto &resume : parked)
+    resume();
+}
+
+template<typename SocketType>
+void Connection<SocketType>::start_stream() {
+  // HTTP/1.0 has no chunked coding, body ends when the connection closes
+  chunked_ = response_.version_major_ > 1 ||
+             (response_.version_major_ == 1 && response_.version_minor_ >= 1);
+  response_.unset_header("Content-Length");
+  if (chunked_)
+    response_.set_header({"Transfer-Encoding", "chunked"});
+  else
+    keep_alive_ = false;
+  response_.set_header({"Connection", keep_alive_ ? "keep-alive" : "close"});
+
+  std::string body = std::move(response_.body_);
+  response_.body_.clear();
+  outgoing_.push_back(std::move(response_));
+  head_queued_ = true;
+  if (!body.empty())
+    write_chunk(stream_id_, std::move(body), nullptr);
+}
+
+template<typename SocketType>
+void Connection<SocketType>::end_stream() {
+  if (!head_queued_)
+    start_stream();
+  if (chunked_) {
+    std::string last_chunk = "0\r\n";
+    for (const auto &header : trailers_)
+      last_chunk += header.first + ": " + header.second + "\r\n";
+    last_chunk += "\r\n";
+    // counted as any chunk, finish_flush() takes it off as written
+    chunk_bytes_ += last_chunk.size();
+    admission_.unsent_bytes_ += last_chunk.size();
+    chunks_.push_back({"", std::move(last_chunk), nullptr});
+  }
+  trailers_.clear();
+  stream_ended_ = true;
+  ++stream_id_;
+  reset();
+  send_chunks();
+}
+
+template<typename SocketType>
+void Connection<SocketType>::send_chunks() {
+  if (writing_)
+    return;
+  if (stopped_) {
+    auto dropped = std::move(chunks_);
+    chunks_.clear();
+    admission_.unsent_bytes_ -= chunk_bytes_;
+    chunk_bytes_ = 0;
+    for (auto &chunk : dropped)
+      if (chunk.on_written_)
+        chunk.on_written_(aborted(), 0);
+    return resume_parked();
+  }
+  // head, and responses pipelined before it, go first
+  if (!outgoing_.empty())
+    return flush();
+  if (chunks_.empty()) {
+    if (!stream_ended_)
+      return; // awaiting handler
+    streaming_ = stream_ended_ = head_queued_ = false;
+    return finish_flush(true);
+  }
+
+  static const std::string crlf = "\r\n";
+  gathered_.clear();
+  std::size_t bytes = 0;
+  for (chunks_in_flight_ = 0; chunks_in_flight_ < chunks_.size() &&
+                              bytes < options_.write_batch_bytes;
+       ++chunks_in_flight_) {
+    auto &chunk = chunks_[chunks_in_flight_];
+    if (!chunk.size_line_.empty())
+      gathered_.push_back(asio::buffer(chunk.size_line_));
+    gathered_.push_back(asio::buffer(chunk.data_));
+    if (!chunk.size_line_.empty())
+      gathered_.push_back(asio::buffer(crlf));
+    bytes += chunk.data_.size();
+  }
+
+  writing_ = true;
+  if (options_.cork)
+    cork(true);
+  write_start_ = ClockType::now();
+  write_progress_ = 0;
+  arm_deadline(options_.write_timeout);
+  send_gathered(outgoing_.size(), false);
+}
+
+template<typename SocketType>
+bool Connection<SocketType>::keep_pace(std::size_t bytes) {
+  write_progress_ += bytes;
+  arm_deadline(options_.write_timeout);
+
+  auto elapsed = ClockType::now() - write_start_;
+  if (!options_.min_send_rate || elapsed < options_.write_timeout)
+    return true;
+  auto seconds = std::chrono::duration<double>(elapsed).count();
+  return write_progress_ >= options_.min_send_rate * seconds;
+}
+
+template<typename SocketType>
+void Connection<SocketType>::finish_flush(bool ok) {
+  outgoing_.clear();
+  admission_.unsent_bytes_ -= outgoing_bytes_;
+  outgoing_bytes_ = 0;
+  writing_ = false;
+  cork(false);
+  timer_wheel_.cancel(deadline_);
+
+  // written chunks make way for more, on failure none ever will
+  // callbacks may queue chunks right away, so take them out first
+  auto written = chunks_.begin() + (ok ? chunks_in_flight_ : chunks_.size());
+  std::deque<Chunk> done(std::make_move_iterator(chunks_.begin()),
+                         std::make_move_iterator(written));
+  chunks_.erase(chunks_.begin(), written);
+  chunks_in_flight_ = 0;
+  std::size_t done_bytes = 0;
+  for (auto &chunk : done)
+    done_bytes += chunk.data_.size();
+  chunk_bytes_ -= done_bytes;
+  admission_.unsent_bytes_ -= done_bytes;
+  if (!ok)
+    terminate();
+  for (auto &chunk : done)
+    if (chunk.on_written_)
+      chunk.on_written_(ok ? std::error_code() : aborted(),
+                        ok ? chunk.data_.size() : 0);
+  resume_parked();
+
+  if (!ok)
+    return;
+  if (streaming_)
+    send_chunks();
+  else if (keep_alive_)
+    parse_buffered();
+  else
+    terminate();
+}
 
+/* used from outside this file, for the plain socket types */
+template void Connection<TcpSocket>::start();
+template void Connection<UnixSocket>::start();
+template void Connection<TcpSocket>::terminate();
+template void Connection<UnixSocket>::terminate();
+template bool Connection<TcpSocket>::recycle();
+template bool Connection<UnixSocket>::recycle();
+template auto Connection<TcpSocket>::size_records(std::size_t) -> std::size_t;
+template auto Connection<UnixSocket>::size_records(std::size_t) -> std::size_t;
 
 }
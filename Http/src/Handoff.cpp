@@ -0,0 +1,67 @@
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "Handoff.h"
+
+namespace Http {
+
+bool send_descriptors(int socket, const std::vector<int> &fds) {
+  if (fds.empty())
+    return false;
+
+  // one byte of payload carries the descriptors, as control data
+  char count = static_cast<char>(fds.size());
+  iovec iov{&count, 1};
+
+  std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+
+  auto cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+  std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+  return ::sendmsg(socket, &msg, MSG_NOSIGNAL) == 1;
+}
+
+auto receive_descriptors(int socket, std::size_t max) -> std::vector<int> {
+  char count;
+  iovec iov{&count, 1};
+
+  std::vector<char> control(CMSG_SPACE(sizeof(int) * max));
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+
+  std::vector<int> fds;
+  if (::recvmsg(socket, &msg, MSG_CMSG_CLOEXEC) != 1)
+    return fds;
+
+  for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+    auto n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    auto first = fds.size();
+    fds.resize(first + n);
+    std::memcpy(fds.data() + first, CMSG_DATA(cmsg), sizeof(int) * n);
+  }
+  return fds;
+}
+
+bool peer_is_same_user(int socket) {
+  ucred cred{};
+  socklen_t size = sizeof(cred);
+  if (::getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &cred, &size) != 0)
+    return false;
+  return cred.uid == ::geteuid();
+}
+}
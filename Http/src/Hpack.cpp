@@ -0,0 +1,449 @@
+#include <algorithm>
+#include <utility>
+
+#include "Hpack.h"
+#include "Utilities.h"
+
+namespace Http {
+
+namespace {
+
+using HeaderType = Message::HeaderType;
+
+const HeaderType static_table[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+constexpr std::size_t static_size = sizeof(static_table) / sizeof(static_table[0]);
+constexpr std::size_t entry_overhead = 32;
+
+/* values differing between messages, not worth a table entry */
+const char *unindexed[] = {":path", "content-length", "content-range", "date",
+                           "etag", "last-modified", "location", "set-cookie",
+                           "authorization", "cookie"};
+
+struct HuffmanCode {
+  std::uint32_t code_;
+  std::uint8_t length_;
+};
+
+/* code of each octet, then of EOS, 256 */
+const HuffmanCode huffman_codes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+    {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+    {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+    {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+    {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+    {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+    {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+    {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+    {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+    {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+    {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+    {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+    {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+    {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+    {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+    {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+    {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+    {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+    {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+    {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+constexpr std::size_t eos = 256;
+constexpr std::uint8_t max_code_length = 30;
+
+/**
+ * @brief   Code is canonical, i.e. codes of a length are consecutive,
+ *          in order of symbol, decoded by length, shortest first
+ */
+struct HuffmanDecodeTable {
+  HuffmanDecodeTable() {
+    for (std::uint16_t s = 0; s < 257; ++s)
+      symbols_.push_back(s);
+    std::stable_sort(symbols_.begin(), symbols_.end(),
+                     [](std::uint16_t a, std::uint16_t b) {
+                       return huffman_codes[a].length_ < huffman_codes[b].length_;
+                     });
+    std::size_t offset = 0;
+    for (std::uint8_t length = 1; length <= max_code_length; ++length) {
+      offset_[length] = offset;
+      count_[length] = 0;
+      first_[length] = 0;
+      while (offset + count_[length] < symbols_.size() &&
+             huffman_codes[symbols_[offset + count_[length]]].length_ == length)
+        ++count_[length];
+      if (count_[length])
+        first_[length] = huffman_codes[symbols_[offset]].code_;
+      offset += count_[length];
+    }
+  }
+
+  std::vector<std::uint16_t> symbols_; // by code
+  std::uint32_t first_[max_code_length + 1]; // code of first symbol of length
+  std::size_t count_[max_code_length + 1];
+  std::size_t offset_[max_code_length + 1];  // into symbols_
+};
+
+/**
+ * @brief   Integer of prefix_bits bits, RFC 7541 5.1
+ */
+void encode_integer(std::size_t value, int prefix_bits, std::uint8_t flags,
+                    std::string &out) {
+  std::size_t max_prefix = (1u << prefix_bits) - 1;
+  if (value < max_prefix) {
+    out.push_back(static_cast<char>(flags | value));
+    return;
+  }
+  out.push_back(static_cast<char>(flags | max_prefix));
+  value -= max_prefix;
+  for (; value >= 128; value >>= 7)
+    out.push_back(static_cast<char>(0x80 | (value & 0x7f)));
+  out.push_back(static_cast<char>(value));
+}
+
+bool decode_integer(const std::uint8_t *&p, const std::uint8_t *end,
+                    int prefix_bits, std::size_t &value) {
+  if (p == end)
+    return false;
+  std::size_t max_prefix = (1u << prefix_bits) - 1;
+  value = *p++ & max_prefix;
+  if (value < max_prefix)
+    return true;
+  for (int shift = 0; p != end; shift += 7) {
+    // beyond any size that fits in a header block
+    if (shift > 28)
+      return false;
+    auto byte = *p++;
+    value += static_cast<std::size_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+void encode_string(const std::string &s, std::string &out) {
+  auto huffman_size = huffman_encoded_size(s);
+  if (huffman_size < s.size()) {
+    encode_integer(huffman_size, 7, 0x80, out);
+    huffman_encode(s, out);
+  } else {
+    encode_integer(s.size(), 7, 0, out);
+    out += s;
+  }
+}
+
+bool decode_string(const std::uint8_t *&p, const std::uint8_t *end,
+                   std::string &out) {
+  if (p == end)
+    return false;
+  bool huffman = *p & 0x80;
+  std::size_t length;
+  if (!decode_integer(p, end, 7, length) ||
+      length > static_cast<std::size_t>(end - p))
+    return false;
+  out.clear();
+  if (huffman && !huffman_decode(p, length, out))
+    return false;
+  if (!huffman)
+    out.assign(reinterpret_cast<const char *>(p), length);
+  p += length;
+  return true;
+}
+}
+
+auto HpackTable::at(std::size_t index) const -> const HeaderType * {
+  if (index == 0)
+    return nullptr;
+  if (index <= static_size)
+    return &static_table[index - 1];
+  index -= static_size + 1;
+  return index < dynamic_.size() ? &dynamic_[index] : nullptr;
+}
+
+auto HpackTable::find(const HeaderType &header, bool &name_only) const
+    -> std::size_t {
+  std::size_t name_index = 0;
+  for (std::size_t i = 0; i < static_size; ++i) {
+    if (static_table[i].first != header.first)
+      continue;
+    if (static_table[i].second == header.second) {
+      name_only = false;
+      return i + 1;
+    }
+    if (!name_index)
+      name_index = i + 1;
+  }
+  for (std::size_t i = 0; i < dynamic_.size(); ++i) {
+    if (dynamic_[i].first != header.first)
+      continue;
+    if (dynamic_[i].second == header.second) {
+      name_only = false;
+      return static_size + i + 1;
+    }
+    if (!name_index)
+      name_index = static_size + i + 1;
+  }
+  name_only = true;
+  return name_index;
+}
+
+void HpackTable::insert(HeaderType header) {
+  auto size = header.first.size() + header.second.size() + entry_overhead;
+  // an entry larger than the table empties it, RFC 7541 4.4
+  if (size > max_size_) {
+    evict(0);
+    return;
+  }
+  evict(max_size_ - size);
+  size_ += size;
+  dynamic_.push_front(std::move(header));
+}
+
+void HpackTable::max_size(std::size_t max_size) {
+  max_size_ = max_size;
+  evict(max_size);
+}
+
+void HpackTable::evict(std::size_t max_size) {
+  while (size_ > max_size) {
+    auto &oldest = dynamic_.back();
+    size_ -= oldest.first.size() + oldest.second.size() + entry_overhead;
+    dynamic_.pop_back();
+  }
+}
+
+bool HpackDecoder::decode(const std::uint8_t *data, std::size_t size,
+                          std::vector<HeaderType> &headers) {
+  auto p = data, end = data + size;
+  bool block_start = true;
+  std::size_t list_size = 0;
+  too_large_ = false;
+  auto fits = [&](const HeaderType &header) {
+    list_size += header.first.size() + header.second.size() + entry_overhead;
+    too_large_ = max_list_size_ && list_size > max_list_size_;
+    return !too_large_;
+  };
+  while (p != end) {
+    auto byte = *p;
+    std::size_t index;
+
+    if (byte & 0x80) {
+      // indexed header field
+      if (!decode_integer(p, end, 7, index))
+        return false;
+      auto entry = table_.at(index);
+      if (!entry || !fits(*entry))
+        return false;
+      headers.push_back(*entry);
+      block_start = false;
+      continue;
+    }
+
+    if ((byte & 0xe0) == 0x20) {
+      // dynamic table size update, only ahead of any field
+      if (!block_start || !decode_integer(p, end, 5, index) ||
+          index > max_table_size_)
+        return false;
+      table_.max_size(index);
+      continue;
+    }
+
+    // literal, with incremental indexing, without, or never indexed
+    bool indexing = (byte & 0xc0) == 0x40;
+    if (!decode_integer(p, end, indexing ? 6 : 4, index))
+      return false;
+    HeaderType header;
+    if (index) {
+      auto entry = table_.at(index);
+      if (!entry)
+        return false;
+      header.first = entry->first;
+    } else if (!decode_string(p, end, header.first)) {
+      return false;
+    }
+    if (!decode_string(p, end, header.second) || !fits(header))
+      return false;
+    if (indexing)
+      table_.insert(header);
+    headers.push_back(std::move(header));
+    block_start = false;
+  }
+  return true;
+}
+
+void HpackEncoder::max_table_size(std::size_t max_size) {
+  // peers announce 4096 at most, larger tables are not used
+  max_size = std::min<std::size_t>(max_size, 4096);
+  min_size_ = std::min(min_size_, max_size);
+  size_update_ = size_update_ || max_size != table_.max_size();
+  table_.max_size(max_size);
+}
+
+void HpackEncoder::encode(const std::vector<HeaderType> &headers,
+                          std::string &out) {
+  if (size_update_) {
+    // smallest first, so that the peer evicts as the encoder did
+    if (min_size_ < table_.max_size())
+      encode_integer(min_size_, 5, 0x20, out);
+    encode_integer(table_.max_size(), 5, 0x20, out);
+    size_update_ = false;
+  }
+  min_size_ = table_.max_size();
+
+  for (const auto &h : headers) {
+    HeaderType header{to_lower(h.first), h.second};
+    bool name_only;
+    auto index = table_.find(header, name_only);
+    if (index && !name_only) {
+      encode_integer(index, 7, 0x80, out);
+      continue;
+    }
+
+    bool indexing = std::none_of(
+        std::begin(unindexed), std::end(unindexed),
+        [&header](const char *name) { return header.first == name; });
+    if (indexing)
+      encode_integer(index, 6, 0x40, out);
+    else
+      encode_integer(index, 4, 0, out);
+    if (!index)
+      encode_string(header.first, out);
+    encode_string(header.second, out);
+    if (indexing)
+      table_.insert(std::move(header));
+  }
+}
+
+auto huffman_encoded_size(const std::string &s) -> std::size_t {
+  std::size_t bits = 0;
+  for (unsigned char c : s)
+    bits += huffman_codes[c].length_;
+  return (bits + 7) / 8;
+}
+
+void huffman_encode(const std::string &s, std::string &out) {
+  std::uint64_t bits = 0;
+  int pending = 0; // bits in low end of bits, not yet out
+  for (unsigned char c : s) {
+    auto &code = huffman_codes[c];
+    bits = (bits << code.length_) | code.code_;
+    pending += code.length_;
+    for (; pending >= 8; pending -= 8)
+      out.push_back(static_cast<char>(bits >> (pending - 8)));
+  }
+  // padded with most significant bits of EOS, all ones
+  if (pending)
+    out.push_back(static_cast<char>((bits << (8 - pending)) |
+                                    (0xff >> pending)));
+}
+
+bool huffman_decode(const std::uint8_t *data, std::size_t size,
+                    std::string &out) {
+  static const HuffmanDecodeTable table;
+  std::uint32_t code = 0;
+  std::uint8_t length = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    for (int bit = 7; bit >= 0; --bit) {
+      code = (code << 1) | ((data[i] >> bit) & 1);
+      ++length;
+      if (code - table.first_[length] < table.count_[length] &&
+          code >= table.first_[length]) {
+        auto symbol = table.symbols_[table.offset_[length] + code -
+                                     table.first_[length]];
+        if (symbol == eos)
+          return false;
+        out.push_back(static_cast<char>(symbol));
+        code = 0;
+        length = 0;
+      } else if (length == max_code_length) {
+        return false;
+      }
+    }
+  }
+  // padding is a prefix of EOS, i.e. ones, shorter than an octet
+  return length < 8 && code == (1u << length) - 1;
+}
+}
@@ -0,0 +1,1205 @@
+#include "asio.hpp"
+#include "asio/ssl.hpp"
+
+#include <algorithm> // min, equal
+#include <cctype>    // toupper
+#include <iostream>
+#include <utility> // move
+
+#include <unistd.h> // pread
+
+#include "Constants.h"
+#include "Http2.h"
+#include "Uri.h"
+#include "Utilities.h"
+
+using namespace std;
+
+namespace Http {
+
+namespace {
+
+const char client_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+/* ALPN protocol lists, in order of preference */
+const unsigned char h2_protocols[] = "\x02h2\x08http/1.1";
+const unsigned char http11_protocols[] = "\x08http/1.1";
+
+int select_protocol(SSL *, const unsigned char **out, unsigned char *outlen,
+                    const unsigned char *in, unsigned int inlen, void *arg) {
+  auto options = static_cast<const ConnectionOptions *>(arg);
+  auto protocols = options->http2 ? h2_protocols : http11_protocols;
+  auto size = options->http2 ? sizeof(h2_protocols) - 1
+                             : sizeof(http11_protocols) - 1;
+  unsigned char *selected;
+  if (SSL_select_next_proto(&selected, outlen, protocols, size, in, inlen) !=
+      OPENSSL_NPN_NEGOTIATED)
+    return SSL_TLSEXT_ERR_NOACK; // client gets HTTP/1.1 all the same
+  *out = selected;
+  return SSL_TLSEXT_ERR_OK;
+}
+
+auto get_u32(const std::uint8_t *p) -> std::uint32_t {
+  return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) |
+         (std::uint32_t(p[2]) << 8) | p[3];
+}
+
+void put_u32(std::string &out, std::uint32_t value) {
+  out += char(value >> 24);
+  out += char(value >> 16);
+  out += char(value >> 8);
+  out += char(value);
+}
+
+void put_frame_header(char *p, std::size_t length, std::uint8_t type,
+                      std::uint8_t flags, std::uint32_t id) {
+  p[0] = char(length >> 16);
+  p[1] = char(length >> 8);
+  p[2] = char(length);
+  p[3] = char(type);
+  p[4] = char(flags);
+  p[5] = char(id >> 24);
+  p[6] = char(id >> 16);
+  p[7] = char(id >> 8);
+  p[8] = char(id);
+}
+
+void append_frame(std::string &out, std::uint8_t type, std::uint8_t flags,
+                  std::uint32_t id, const char *payload, std::size_t length) {
+  char header[9];
+  put_frame_header(header, length, type, flags, id);
+  out.append(header, sizeof(header));
+  out.append(payload, length);
+}
+
+/**
+ * @brief   Header name as HTTP/1.1 handlers look it up, e.g. content-type
+ *          as Content-Type
+ */
+auto canonical_name(const std::string &name) -> std::string {
+  std::string canonical = name;
+  bool start = true;
+  for (auto &c : canonical) {
+    if (start)
+      c = std::toupper(static_cast<unsigned char>(c));
+    start = c == '-';
+  }
+  return canonical;
+}
+
+/**
+ * @brief   Headers specific to an HTTP/1.1 connection, malformed in HTTP/2
+ */
+bool connection_specific(const std::string &lower) {
+  return lower == "connection" || lower == "keep-alive" ||
+         lower == "proxy-connection" || lower == "transfer-encoding" ||
+         lower == "upgrade";
+}
+}
+
+void http2_alpn(SSL_CTX *ctx, const ConnectionOptions *options) {
+  SSL_CTX_set_alpn_select_cb(ctx, select_protocol,
+                             const_cast<ConnectionOptions *>(options));
+}
+
+bool http2_negotiated(SSL *ssl) {
+  const unsigned char *protocol = nullptr;
+  unsigned int length = 0;
+  SSL_get0_alpn_selected(ssl, &protocol, &length);
+  return length == 2 && protocol[0] == 'h' && protocol[1] == '2';
+}
+
+bool http2_preface(const char *data, std::size_t size) {
+  return std::equal(data, data + std::min(size, http2_preface_size),
+                    client_preface);
+}
+
+template <typename SocketType>
+constexpr std::size_t Http2Session<SocketType>::frame_header_size;
+template <typename SocketType>
+constexpr std::size_t Http2Session<SocketType>::max_frame_size;
+template <typename SocketType>
+constexpr std::int64_t Http2Session<SocketType>::default_window;
+template <typename SocketType>
+constexpr std::int64_t Http2Session<SocketType>::max_window;
+template <typename SocketType>
+constexpr std::size_t Http2Session<SocketType>::max_request_body;
+template <typename SocketType>
+constexpr std::size_t Http2Session<SocketType>::max_header_list_size;
+template <typename SocketType>
+constexpr std::size_t Http2Session<SocketType>::max_control_bytes;
+
+template <typename SocketType>
+Http2Session<SocketType>::Http2Session(
+    std::shared_ptr<ConnectionType> connection)
+    : connection_(std::move(connection)), strand_(connection_->strand_),
+      options_(connection_->options_) {}
+
+template <typename SocketType> Http2Session<SocketType>::~Http2Session() {
+  // bodies of streams never sent, their io_service gone
+  for (auto &entry : streams_)
+    connection_->admission_.unsent_bytes_ -= entry.second->queued_bytes_;
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::start(const char *data, std::size_t size) {
+  std::string settings;
+  settings += char(0);
+  settings += char(Setting::max_concurrent_streams);
+  put_u32(settings, options_.http2_max_streams);
+  settings += char(0);
+  settings += char(Setting::max_header_list_size);
+  put_u32(settings, max_header_list_size);
+  queue_frame(FrameType::settings, 0, 0, settings);
+
+  in_.assign(data, data + size);
+  bool ok = parse();
+  send();
+  if (ok)
+    read_more();
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::read() {
+  connection_->socket_.async_read_some(
+      asio::buffer(buffer_),
+      connection_->wrap([this, self = this->shared_from_this()](
+          std::error_code ec, std::size_t bytes_read) {
+        if (ec || closed_)
+          return close();
+        in_.insert(in_.end(), buffer_.data(), buffer_.data() + bytes_read);
+        bool ok = parse();
+        send();
+        if (ok)
+          read_more();
+      }));
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::read_more() {
+  read_paused_ = control_.size() > max_control_bytes;
+  if (!read_paused_)
+    read();
+}
+
+template <typename SocketType>
+bool Http2Session<SocketType>::parse() {
+  std::size_t pos = 0;
+  if (preface_left_) {
+    auto n = std::min(preface_left_, in_.size());
+    auto expected = client_preface + (http2_preface_size - preface_left_);
+    if (!std::equal(in_.begin(), in_.begin() + n, expected))
+      return fail(ErrorCode::protocol_error);
+    preface_left_ -= n;
+    pos = n;
+  }
+
+  bool ok = true;
+  while (ok && in_.size() - pos >= frame_header_size) {
+    auto p = in_.data() + pos;
+    std::size_t length = (std::size_t(p[0]) << 16) | (p[1] << 8) | p[2];
+    if (length > max_frame_size) {
+      ok = fail(ErrorCode::frame_size_error);
+      break;
+    }
+    if (in_.size() - pos < frame_header_size + length)
+      break;
+    ok = handle_frame(FrameType(p[3]), p[4], get_u32(p + 5) & 0x7fffffff,
+                      p + frame_header_size, length);
+    pos += frame_header_size + length;
+  }
+  in_.erase(in_.begin(), in_.begin() + pos);
+  return ok;
+}
+
+template <typename SocketType>
+bool Http2Session<SocketType>::handle_frame(FrameType type, std::uint8_t flags,
+                                            std::uint32_t id,
+                                            const std::uint8_t *payload,
+                                            std::size_t length) {
+  // a header block is never interleaved with other frames
+  if (continued_id_ &&
+      (type != FrameType::continuation || id != continued_id_))
+    return fail(ErrorCode::protocol_error);
+  if (!settings_received_ && type != FrameType::settings)
+    return fail(ErrorCode::protocol_error);
+
+  switch (type) {
+  case FrameType::data:
+    return handle_data(flags, id, payload, length);
+  case FrameType::headers:
+    return handle_headers(flags, id, payload, length);
+  case FrameType::continuation: {
+    if (!continued_id_)
+      return fail(ErrorCode::protocol_error);
+    if (header_block_.size() + length > max_header_list_size)
+      return fail(ErrorCode::enhance_your_calm);
+    header_block_.append(reinterpret_cast<const char *>(payload), length);
+    if (!(flags & end_headers))
+      return true;
+    continued_id_ = 0;
+    return handle_header_block(id, continued_end_stream_);
+  }
+  case FrameType::settings:
+    return handle_settings(flags, id, payload, length);
+  case FrameType::window_update:
+    return handle_window_update(id, payload, length);
+  case FrameType::ping: {
+    if (id)
+      return fail(ErrorCode::protocol_error);
+    if (length != 8)
+      return fail(ErrorCode::frame_size_error);
+    if (!(flags & ack))
+      queue_frame(FrameType::ping, ack, 0,
+                  std::string(reinterpret_cast<const char *>(payload), 8));
+    return true;
+  }
+  case FrameType::priority: {
+    if (!id)
+      return fail(ErrorCode::protocol_error);
+    if (length != 5)
+      reset_stream(id, ErrorCode::frame_size_error);
+    return true; // streams are served round robin, regardless
+  }
+  case FrameType::rst_stream: {
+    if (!id)
+      return fail(ErrorCode::protocol_error);
+    if (length != 4)
+      return fail(ErrorCode::frame_size_error);
+    if (id > last_stream_id_)
+      return fail(ErrorCode::protocol_error);
+    auto found = streams_.find(id);
+    if (found != streams_.end()) {
+      found->second->reset_ = true;
+      abort(*found->second);
+      close_stream(id);
+    }
+    return true;
+  }
+  case FrameType::goaway: {
+    if (id)
+      return fail(ErrorCode::protocol_error);
+    // streams underway are finished, then the connection closed
+    goaway(ErrorCode::no_error);
+    return true;
+  }
+  case FrameType::push_promise:
+    return fail(ErrorCode::protocol_error);
+  default:
+    return true; // unknown frame types are ignored
+  }
+}
+
+template <typename SocketType>
+bool Http2Session<SocketType>::handle_headers(std::uint8_t flags,
+                                              std::uint32_t id,
+                                              const std::uint8_t *payload,
+                                              std::size_t length) {
+  // streams initiated by client are odd
+  if (!(id & 1))
+    return fail(ErrorCode::protocol_error);
+
+  std::size_t pad = 0;
+  if (flags & padded) {
+    if (!length)
+      return fail(ErrorCode::frame_size_error);
+    pad = payload[0];
+    ++payload;
+    --length;
+  }
+  if (flags & priority) {
+    if (length < 5)
+      return fail(ErrorCode::frame_size_error);
+    payload += 5;
+    length -= 5;
+  }
+  if (pad > length)
+    return fail(ErrorCode::protocol_error);
+
+  header_block_.assign(reinterpret_cast<const char *>(payload), length - pad);
+  if (!(flags & end_headers)) {
+    continued_id_ = id;
+    continued_end_stream_ = flags & end_stream;
+    return true;
+  }
+  return handle_header_block(id, flags & end_stream);
+}
+
+template <typename SocketType>
+bool Http2Session<SocketType>::handle_header_block(std::uint32_t id,
+                                                   bool end_of_stream) {
+  // decoded regardless of the stream, to keep the table in sync
+  std::vector<HeaderType> headers;
+  auto block = reinterpret_cast<const std::uint8_t *>(header_block_.data());
+  if (!decoder_.decode(block, header_block_.size(), headers))
+    return fail(decoder_.too_large() ? ErrorCode::enhance_your_calm
+                                     : ErrorCode::compression_error);
+  header_block_.clear();
+
+  // trailers of a request body, ignored
+  auto found = streams_.find(id);
+  if (found != streams_.end()) {
+    auto stream = found->second;
+    if (stream->remote_closed_) {
+      reset_stream(id, ErrorCode::stream_closed);
+      return true;
+    }
+    if (!end_of_stream) {
+      reset_stream(id, ErrorCode::protocol_error);
+      return true;
+    }
+    stream->remote_closed_ = true;
+    update_deadline();
+    if (!stream->handling_ && !stream->responded_)
+      handle(stream);
+    return true;
+  }
+
+  if (id <= last_stream_id_)
+    return fail(ErrorCode::stream_closed);
+  // past the last stream of our GOAWAY, never to be processed
+  if (going_away_)
+    return true;
+  last_stream_id_ = id;
+
+  if (streams_.size() >= options_.http2_max_streams) {
+    reset_stream(id, ErrorCode::refused_stream);
+    return true;
+  }
+
+  auto stream = std::make_shared<Stream>(id);
+  stream->send_window_ = initial_send_window_;
+  if (!make_request(*stream, headers)) {
+    reset_stream(id, ErrorCode::protocol_error);
+    return true;
+  }
+  stream->remote_closed_ = end_of_stream;
+  streams_[id] = stream;
+
+  // last stream served, as for requests over HTTP/1.1
+  if (++stream_count_ >= options_.max_requests ||
+      connection_->admission_.draining_)
+    goaway(ErrorCode::no_error);
+  update_deadline();
+
+  if (end_of_stream)
+    handle(stream);
+  return true;
+}
+
+template <typename SocketType>
+bool Http2Session<SocketType>::handle_data(std::uint8_t flags,
+                                           std::uint32_t id,
+                                           const std::uint8_t *payload,
+                                           std::size_t length) {
+  if (!id)
+    return fail(ErrorCode::protocol_error);
+
+  // padding counts towards flow control
+  auto frame_length = length;
+  std::size_t pad = 0;
+  if (flags & padded) {
+    if (!length)
+      return fail(ErrorCode::frame_size_error);
+    pad = payload[0];
+    ++payload;
+    --length;
+  }
+  if (pad > length)
+    return fail(ErrorCode::protocol_error);
+  length -= pad;
+
+  recv_window_ -= frame_length;
+  if (recv_window_ < 0)
+    return fail(ErrorCode::flow_control_error);
+  // connection window is given back right away, bodies are bounded by stream
+  if (frame_length) {
+    std::string increment;
+    put_u32(increment, frame_length);
+    queue_frame(FrameType::window_update, 0, 0, increment);
+    recv_window_ += frame_length;
+  }
+
+  auto found = streams_.find(id);
+  if (found == streams_.end()) {
+    // in flight when the stream was reset, or closed
+    return id > last_stream_id_ ? fail(ErrorCode::protocol_error) : true;
+  }
+  if (found->second->remote_closed_) {
+    reset_stream(id, ErrorCode::stream_closed);
+    return true;
+  }
+  auto stream = found->second;
+  auto &s = *stream;
+
+  s.recv_window_ -= frame_length;
+  if (s.recv_window_ < 0) {
+    reset_stream(id, ErrorCode::flow_control_error);
+    return true;
+  }
+  if (s.request_.body_.size() + length > max_request_body) {
+    // answered without running handlers, rest of the body is refused
+    s.remote_closed_ = true;
+    s.response_.status_code(StatusCode::Request_Entity_Too_Large);
+    respond(stream);
+    reset_stream(id, ErrorCode::no_error);
+    return true;
+  }
+  s.request_.body_.append(reinterpret_cast<const char *>(payload), length);
+
+  if (flags & end_stream) {
+    s.remote_closed_ = true;
+    if (!s.handling_ && !s.responded_)
+      handle(stream);
+  } else if (frame_length) {
+    std::string increment;
+    put_u32(increment, frame_length);
+    queue_frame(FrameType::window_update, 0, id, increment);
+    s.recv_window_ += frame_length;
+  }
+  // body is coming in, or complete
+  update_deadline();
+  return true;
+}
+
+template <typename SocketType>
+bool Http2Session<SocketType>::handle_settings(std::uint8_t flags,
+                                               std::uint32_t id,
+                                               const std::uint8_t *payload,
+                                               std::size_t length) {
+  if (id)
+    return fail(ErrorCode::protocol_error);
+  if (flags & ack)
+    return length ? fail(ErrorCode::frame_size_error) : true;
+  if (length % 6)
+    return fail(ErrorCode::frame_size_error);
+  settings_received_ = true;
+
+  for (std::size_t i = 0; i < length; i += 6) {
+    auto setting = Setting((payload[i] << 8) | payload[i + 1]);
+    auto value = get_u32(payload + i + 2);
+    switch (setting) {
+    case Setting::header_table_size:
+      encoder_.max_table_size(value);
+      break;
+    case Setting::enable_push:
+      if (value > 1)
+        return fail(ErrorCode::protocol_error);
+      break;
+    case Setting::initial_window_size: {
+      if (value > max_window)
+        return fail(ErrorCode::flow_control_error);
+      // applies to open streams too
+      auto delta = std::int64_t(value) - initial_send_window_;
+      initial_send_window_ = value;
+      for (auto &entry : streams_) {
+        auto &stream = entry.second;
+        stream->send_window_ += delta;
+        if (stream->send_window_ > max_window)
+          return fail(ErrorCode::flow_control_error);
+        if (delta > 0 && stream->responded_)
+          mark_ready(stream);
+      }
+      break;
+    }
+    case Setting::max_frame_size:
+      if (value < max_frame_size || value > 0xffffff)
+        return fail(ErrorCode::protocol_error);
+      peer_max_frame_size_ = value;
+      break;
+    default:
+      break; // unknown settings are ignored
+    }
+  }
+  queue_frame(FrameType::settings, ack, 0, "");
+  return true;
+}
+
+template <typename SocketType>
+bool Http2Session<SocketType>::handle_window_update(
+    std::uint32_t id, const std::uint8_t *payload, std::size_t length) {
+  if (length != 4)
+    return fail(ErrorCode::frame_size_error);
+  auto increment = get_u32(payload) & 0x7fffffff;
+
+  if (!id) {
+    if (!increment)
+      return fail(ErrorCode::protocol_error);
+    send_window_ += increment;
+    if (send_window_ > max_window)
+      return fail(ErrorCode::flow_control_error);
+    return true;
+  }
+
+  auto found = streams_.find(id);
+  if (found == streams_.end())
+    return id > last_stream_id_ ? fail(ErrorCode::protocol_error) : true;
+  if (!increment) {
+    reset_stream(id, ErrorCode::protocol_error);
+    return true;
+  }
+  auto &stream = found->second;
+  stream->send_window_ += increment;
+  if (stream->send_window_ > max_window) {
+    reset_stream(id, ErrorCode::flow_control_error);
+    return true;
+  }
+  if (stream->responded_)
+    mark_ready(stream);
+  return true;
+}
+
+template <typename SocketType>
+bool Http2Session<SocketType>::make_request(Stream &stream,
+                                            std::vector<HeaderType> &headers) {
+  auto &request = stream.request_;
+  request.version_major_ = 2;
+  request.version_minor_ = 0;
+
+  std::string method, path, authority;
+  bool regular = false;
+  for (auto &header : headers) {
+    auto &name = header.first;
+    if (name.empty())
+      return false;
+    if (name.front() == ':') {
+      // pseudo-headers come first
+      if (regular)
+        return false;
+      if (name == ":method")
+        method = std::move(header.second);
+      else if (name == ":path")
+        path = std::move(header.second);
+      else if (name == ":authority")
+        authority = std::move(header.second);
+      else if (name != ":scheme")
+        return false;
+      continue;
+    }
+    regular = true;
+    if (name != to_lower(name) || connection_specific(name))
+      return false;
+    request.headers_.push_back(
+        {canonical_name(name), std::move(header.second)});
+  }
+  if (method.empty() || path.empty() || path.front() != '/')
+    return false;
+  if (!authority.empty() && !request.get_header("Host").second)
+    request.headers_.push_back({"Host", std::move(authority)});
+
+  request.method_ = Request::string_to_request_method(method);
+  for (auto c : path)
+    if (!is_uri(c) || request.uri_.consume(c) == ParseStatus::reject)
+      return false;
+  request.uri_.decode();
+  return true;
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::handle(const StreamPtr &stream) {
+  auto &s = *stream;
+  s.handling_ = true;
+  s.response_.status_code(StatusCode::OK);
+  s.response_.version_major_ = 2;
+  s.response_.version_minor_ = 0;
+  s.request_.query_ = Uri::make_query(s.request_.uri_.query_);
+
+  // no cycle through the context stream owns
+  std::weak_ptr<Stream> weak = stream;
+  s.context_.io_service_ = connection_->context_.io_service_;
+  s.context_.make_completion_ = [this, weak] { return defer(weak.lock()); };
+  s.context_.make_stream_ = [this, weak]() -> Context::StreamPtr {
+    auto stream = weak.lock();
+    stream->streaming_ = true;
+    return std::make_shared<DataStream>(this->shared_from_this(), stream);
+  };
+
+  s.handlers_ = connection_->router_.resolve(s.request_);
+  if (connection_->shed_) {
+    goaway(ErrorCode::no_error);
+    return send_overloaded(stream);
+  }
+  if (!admit_handlers(s))
+    return send_overloaded(stream);
+  run_handlers(stream, 0);
+}
+
+template <typename SocketType>
+bool Http2Session<SocketType>::admit_handlers(Stream &stream) {
+  for (const auto &handler : stream.handlers_) {
+    if (!handler.max_in_flight_)
+      continue;
+    stream.in_flight_.push_back(handler.in_flight_);
+    if (++*handler.in_flight_ > handler.max_in_flight_) {
+      ++connection_->admission_.shed_requests_;
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::send_overloaded(const StreamPtr &stream) {
+  // head is out already, cut the stream short instead
+  if (!stream->streaming_)
+    stream->response_ = connection_->admission_.overloaded_;
+  respond(stream);
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::run_handlers(const StreamPtr &stream,
+                                            std::size_t i) {
+  auto &s = *stream;
+  for (; i < s.handlers_.size(); ++i) {
+    s.next_handler_ = i + 1;
+
+    if (s.handlers_[i].blocking_) {
+      auto &executor = connection_->blocking_executor_;
+      if (options_.max_blocking_queue &&
+          executor.queue_size() >= options_.max_blocking_queue) {
+        ++connection_->admission_.shed_blocking_;
+        return send_overloaded(stream);
+      }
+
+      executor.post([this, self = this->shared_from_this(), stream, i] {
+        auto next = i + 1;
+        try {
+          stream->handlers_[i](stream->context_);
+          if (suspended(*stream))
+            return;
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          stream->pending_.reset();
+          stream->response_.status_code(StatusCode::Internal_Server_Error);
+          next = stream->handlers_.size();
+        }
+        connection_->post(
+            [this, self, stream, next] { run_handlers(stream, next); });
+      });
+      return;
+    }
+
+    s.handlers_[i](s.context_);
+    if (suspended(s))
+      return;
+  }
+  respond(stream);
+}
+
+template <typename SocketType>
+auto Http2Session<SocketType>::defer(const StreamPtr &stream)
+    -> Context::Completion {
+  auto pending = std::make_shared<std::atomic<int>>(2);
+  stream->pending_ = pending;
+
+  return [this, self = this->shared_from_this(), stream, pending,
+          next = stream->next_handler_] {
+    if (--*pending == 0)
+      connection_->post([this, self, stream, next] { run_handlers(stream, next); });
+  };
+}
+
+template <typename SocketType>
+bool Http2Session<SocketType>::suspended(Stream &stream) {
+  if (!stream.pending_)
+    return false;
+  auto pending = std::move(stream.pending_);
+  return --*pending != 0;
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::release(Stream &stream) {
+  stream.handling_ = false;
+  stream.handlers_.clear();
+  for (auto &in_flight : stream.in_flight_)
+    --*in_flight;
+  stream.in_flight_.clear();
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::respond(const StreamPtr &stream) {
+  auto &s = *stream;
+  release(s);
+  if (s.streaming_)
+    return end_data(stream);
+  if (s.reset_ || closed_)
+    return close_stream(s.id_);
+
+  auto &response = s.response_;
+  if (!response.get_header("Content-Length").second)
+    response.content_length(response.body_.size());
+
+  if (!response.body_.empty()) {
+    Segment text;
+    text.length_ = response.body_.size();
+    text.text_ = std::move(response.body_);
+    queue_segment(s, std::move(text));
+  }
+  auto &file = response.file_;
+  if (file) {
+    queue_segment(s, {"", file.fd_, file.offset_, file.length_, nullptr});
+    for (auto &part : file.parts_) {
+      auto size = part.prefix_.size();
+      queue_segment(s, {std::move(part.prefix_), nullptr, 0, size, nullptr});
+      queue_segment(s, {"", file.fd_, part.offset_, part.length_, nullptr});
+    }
+    if (!file.suffix_.empty()) {
+      auto size = file.suffix_.size();
+      queue_segment(s, {std::move(file.suffix_), nullptr, 0, size, nullptr});
+    }
+  }
+
+  s.last_queued_ = true;
+  send_head(s, s.body_.empty());
+  if (s.body_.empty())
+    close_stream(s.id_);
+  else
+    mark_ready(stream);
+  send();
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::send_head(Stream &stream, bool end_of_stream) {
+  auto &response = stream.response_;
+  std::vector<HeaderType> headers{
+      {":status",
+       std::to_string(Response::status_code_to_int(response.status_code()))}};
+  for (const auto &header : response.headers_) {
+    auto name = to_lower(header.first);
+    if (!connection_specific(name))
+      headers.push_back({std::move(name), header.second});
+  }
+  append_headers(control_, stream.id_, headers, end_of_stream);
+  stream.responded_ = true;
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::append_headers(
+    std::string &out, std::uint32_t id, const std::vector<HeaderType> &headers,
+    bool end_of_stream) {
+  std::string block;
+  encoder_.encode(headers, block);
+
+  // HEADERS, then CONTINUATION beyond max frame size of peer
+  std::size_t offset = 0;
+  auto type = FrameType::headers;
+  std::uint8_t flags = end_of_stream ? end_stream : 0;
+  do {
+    auto length = std::min(block.size() - offset, peer_max_frame_size_);
+    if (offset + length == block.size())
+      flags |= end_headers;
+    append_frame(out, std::uint8_t(type), flags, id, block.data() + offset,
+                 length);
+    offset += length;
+    type = FrameType::continuation;
+    flags = 0;
+  } while (offset < block.size());
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::DataStream::write(std::string chunk,
+                                                 Callback on_written) {
+  auto session = session_;
+  auto stream = stream_;
+  session->strand_.dispatch(
+      [session, stream, chunk = std::move(chunk), on_written]() mutable {
+        session->write_chunk(stream, std::move(chunk), std::move(on_written));
+      });
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::DataStream::trailer(HeaderType header) {
+  auto session = session_;
+  auto stream = stream_;
+  session->strand_.dispatch([stream, header] {
+    if (!stream->last_queued_)
+      stream->trailers_.push_back({to_lower(header.first), header.second});
+  });
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::DataStream::when_writable(
+    std::function<void()> resume) {
+  auto session = session_;
+  auto stream = stream_;
+  session->strand_.dispatch([session, stream, resume] {
+    session->when_writable(stream, std::move(resume));
+  });
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::write_chunk(const StreamPtr &stream,
+                                           std::string chunk,
+                                           BodyStream::Callback on_written) {
+  auto &s = *stream;
+  if (s.reset_ || s.last_queued_ || closed_) {
+    if (on_written)
+      on_written(aborted(), 0);
+    return;
+  }
+  if (chunk.empty()) {
+    if (on_written)
+      on_written({}, 0);
+    return;
+  }
+
+  if (!s.responded_)
+    start_stream(s);
+  auto size = chunk.size();
+  queue_segment(s, {std::move(chunk), nullptr, 0, size, std::move(on_written)});
+  mark_ready(stream);
+  send();
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::start_stream(Stream &stream) {
+  // DATA frames delimit the body
+  auto &response = stream.response_;
+  response.unset_header("Content-Length");
+  if (!response.body_.empty()) {
+    auto size = response.body_.size();
+    queue_segment(stream,
+                  {std::move(response.body_), nullptr, 0, size, nullptr});
+  }
+  send_head(stream, false);
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::end_data(const StreamPtr &stream) {
+  auto &s = *stream;
+  if (s.reset_ || closed_) {
+    abort(s);
+    return close_stream(s.id_);
+  }
+  if (!s.responded_)
+    start_stream(s);
+  s.last_queued_ = true;
+  mark_ready(stream);
+  send();
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::mark_ready(const StreamPtr &stream) {
+  if (stream->ready_ || stream->reset_)
+    return;
+  if (stream->body_.empty() && !stream->last_queued_)
+    return;
+  stream->ready_ = true;
+  ready_.push_back(stream);
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::queue_segment(Stream &stream, Segment segment) {
+  stream.queued_bytes_ += segment.text_.size();
+  connection_->admission_.unsent_bytes_ += segment.text_.size();
+  stream.body_.push_back(std::move(segment));
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::when_writable(const StreamPtr &stream,
+                                             std::function<void()> resume) {
+  auto &s = *stream;
+  if (s.reset_ || s.last_queued_ || closed_ || !options_.send_window ||
+      s.queued_bytes_ < options_.send_window)
+    return resume();
+  s.parked_.push_back(std::move(resume));
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::resume_parked(Stream &stream) {
+  if (stream.parked_.empty())
+    return;
+  if (!stream.reset_ && !closed_ &&
+      stream.queued_bytes_ >= options_.send_window)
+    return;
+  auto parked = std::move(stream.parked_);
+  stream.parked_.clear();
+  for (auto &resume : parked)
+    resume();
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::abort(Stream &stream) {
+  auto dropped = std::move(stream.body_);
+  stream.body_.clear();
+  connection_->admission_.unsent_bytes_ -= stream.queued_bytes_;
+  stream.queued_bytes_ = 0;
+  for (auto &segment : dropped)
+    if (segment.on_written_)
+      segment.on_written_(aborted(), 0);
+  resume_parked(stream);
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::close_stream(std::uint32_t id) {
+  auto found = streams_.find(id);
+  if (found == streams_.end())
+    return;
+  // dropped once handlers are done, by respond()
+  if (found->second->handling_) {
+    found->second->reset_ = true;
+    return;
+  }
+  streams_.erase(found);
+  update_deadline();
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::reset_stream(std::uint32_t id,
+                                            ErrorCode error) {
+  std::string payload;
+  put_u32(payload, std::uint32_t(error));
+  queue_frame(FrameType::rst_stream, 0, id, payload);
+
+  auto found = streams_.find(id);
+  if (found == streams_.end())
+    return;
+  found->second->reset_ = true;
+  abort(*found->second);
+  close_stream(id);
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::queue_frame(FrameType type, std::uint8_t flags,
+                                           std::uint32_t id,
+                                           const std::string &payload) {
+  append_frame(control_, std::uint8_t(type), flags, id, payload.data(),
+               payload.size());
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::goaway(ErrorCode error) {
+  if (going_away_ && error == ErrorCode::no_error)
+    return;
+  going_away_ = true;
+  failed_ = error != ErrorCode::no_error;
+
+  std::string payload;
+  put_u32(payload, last_stream_id_);
+  put_u32(payload, std::uint32_t(error));
+  queue_frame(FrameType::goaway, 0, 0, payload);
+}
+
+template <typename SocketType>
+bool Http2Session<SocketType>::fail(ErrorCode error) {
+  goaway(error);
+  return false;
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::send() {
+  if (writing_ || closed_)
+    return;
+
+  out_ = std::move(control_);
+  control_.clear();
+  out_offset_ = 0;
+  if (!failed_ && out_.size() + frame_header_size < options_.write_batch_bytes)
+    fill_data(options_.write_batch_bytes - out_.size());
+
+  if (out_.empty())
+    return close_if_done();
+  write_buffer();
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::fill_data(std::size_t budget) {
+  while (budget > frame_header_size && !ready_.empty()) {
+    auto stream = std::move(ready_.front());
+    ready_.pop_front();
+    auto &s = *stream;
+    s.ready_ = false;
+    if (s.reset_)
+      continue;
+
+    // end of a streamed body, which takes no window
+    if (s.body_.empty()) {
+      if (!s.last_queued_)
+        continue;
+      if (s.trailers_.empty())
+        append_frame(out_, std::uint8_t(FrameType::data), end_stream, s.id_,
+                     nullptr, 0);
+      else
+        append_headers(out_, s.id_, s.trailers_, true);
+      budget -= std::min(budget, frame_header_size);
+      close_stream(s.id_);
+      continue;
+    }
+
+    if (s.send_window_ <= 0)
+      continue; // ready again on WINDOW_UPDATE
+    if (send_window_ <= 0) {
+      s.ready_ = true;
+      ready_.push_front(std::move(stream));
+      break;
+    }
+
+    auto &segment = s.body_.front();
+    auto length = std::min({budget - frame_header_size,
+                            std::size_t(send_window_),
+                            std::size_t(s.send_window_), peer_max_frame_size_,
+                            segment.length_});
+
+    auto pos = out_.size();
+    out_.resize(pos + frame_header_size + length);
+    auto payload = &out_[pos + frame_header_size];
+    if (segment.fd_) {
+      auto n = ::pread(*segment.fd_, payload, length, segment.offset_);
+      // file shrank, Content-Length can no longer be met
+      if (n <= 0) {
+        out_.resize(pos);
+        reset_stream(s.id_, ErrorCode::internal_error);
+        continue;
+      }
+      length = n;
+      out_.resize(pos + frame_header_size + length);
+    } else {
+      std::copy_n(segment.text_.data() + segment.offset_, length, payload);
+    }
+    segment.offset_ += length;
+    segment.length_ -= length;
+    send_window_ -= length;
+    s.send_window_ -= length;
+    budget -= frame_header_size + length;
+
+    if (!segment.length_) {
+      if (segment.on_written_)
+        written_.push_back(
+            {std::move(segment.on_written_), segment.text_.size()});
+      s.queued_bytes_ -= segment.text_.size();
+      connection_->admission_.unsent_bytes_ -= segment.text_.size();
+      s.body_.pop_front();
+    }
+    bool last = s.body_.empty() && s.last_queued_ && s.trailers_.empty();
+    put_frame_header(&out_[pos], length, std::uint8_t(FrameType::data),
+                     last ? end_stream : 0, s.id_);
+    if (last)
+      close_stream(s.id_);
+    else
+      mark_ready(stream);
+  }
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::write_buffer() {
+  writing_ = true;
+  arm_deadline(options_.write_timeout);
+
+  auto bytes = out_.size() - out_offset_;
+  if (options_.send_window)
+    bytes = std::min(bytes, options_.send_window);
+  bytes = connection_->size_records(bytes);
+  auto handler = connection_->wrap([this, self = this->shared_from_this(), bytes](
+      std::error_code ec, std::size_t) {
+    writing_ = false;
+    if (ec)
+      return close();
+    out_offset_ += bytes;
+    if (out_offset_ < out_.size())
+      return write_buffer();
+
+    out_.clear();
+    out_offset_ = 0;
+    auto written = std::move(written_);
+    written_.clear();
+    for (auto &chunk : written)
+      chunk.first({}, chunk.second);
+    // resumed producers may queue chunks, and close streams, right away
+    std::vector<StreamPtr> parked;
+    for (auto &entry : streams_)
+      if (!entry.second->parked_.empty())
+        parked.push_back(entry.second);
+    for (auto &stream : parked)
+      resume_parked(*stream);
+    update_deadline();
+    send();
+    if (read_paused_ && !closed_)
+      read_more();
+  });
+
+  // any progress within the write rearms the write deadline
+  auto progress = [this, counted = std::size_t{0}](const auto &ec,
+                                                   std::size_t total) mutable {
+    if (total > counted)
+      arm_deadline(options_.write_timeout);
+    counted = total;
+    return asio::transfer_all()(ec, total);
+  };
+  auto buffer = asio::buffer(out_.data() + out_offset_, bytes);
+  if (connection_->zero_copy_)
+    asio::async_write(tcp_layer(connection_->socket_), buffer, progress,
+                      handler);
+  else
+    asio::async_write(connection_->socket_, buffer, progress, handler);
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::update_deadline() {
+  if (closed_ || writing_)
+    return;
+  if (streams_.empty())
+    return arm_deadline(options_.idle_timeout);
+  for (auto &entry : streams_)
+    if (!entry.second->remote_closed_)
+      return arm_deadline(options_.read_timeout);
+  connection_->timer_wheel_.cancel(connection_->deadline_);
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::arm_deadline(ClockType::duration timeout) {
+  std::weak_ptr<Http2Session> weak = this->shared_from_this();
+  connection_->timer_wheel_.arm(connection_->deadline_, timeout, [this, weak] {
+    if (auto self = weak.lock())
+      connection_->post([this, self] { check_deadline(); });
+  });
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::check_deadline() {
+  // fired for a deadline since re-armed or cancelled
+  if (closed_ || connection_->deadline_.expires_at() > ClockType::now())
+    return;
+
+  if (writing_)
+    return close();
+  // streams whose requests stalled are dropped, as a 408 would over HTTP/1.1
+  std::vector<std::uint32_t> stalled;
+  for (auto &entry : streams_)
+    if (!entry.second->remote_closed_)
+      stalled.push_back(entry.first);
+  for (auto id : stalled)
+    reset_stream(id, ErrorCode::cancel);
+  goaway(ErrorCode::no_error);
+  send();
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::close_if_done() {
+  if (closed_ || writing_)
+    return;
+  if (failed_ || (going_away_ && streams_.empty()))
+    close();
+}
+
+template <typename SocketType>
+void Http2Session<SocketType>::close() {
+  if (closed_)
+    return;
+  closed_ = true;
+
+  auto streams = std::move(streams_);
+  streams_.clear();
+  ready_.clear();
+  for (auto &entry : streams)
+    abort(*entry.second);
+  auto written = std::move(written_);
+  written_.clear();
+  for (auto &chunk : written)
+    chunk.first(aborted(), 0);
+  connection_->terminate();
+}
+
+template class Http2Session<TcpSocket>;
+template class Http2Session<SslSocket>;
+template class Http2Session<UnixSocket>;
+}
@@ -0,0 +1,296 @@
+#include <cstring>
+#include <string>
+
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+
+#ifdef __linux__
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+#include "Ktls.h"
+
+namespace Http {
+
+namespace {
+
+// TLS_CIPHER_* of <linux/tls.h>
+enum : int { aes_gcm_128 = 51, aes_gcm_256 = 52, chacha20_poly1305 = 54 };
+
+/**
+ * @brief   What a marked session learns during its handshake
+ */
+struct KtlsSecrets {
+  std::string server_secret; // server application traffic secret, TLS 1.3
+  std::uint64_t tickets = 0; // session tickets sent under that secret
+  int fd = -1;               // socket kernel encrypts for, once guarded
+};
+
+void free_secrets(void *, void *ptr, CRYPTO_EX_DATA *, int, long, void *) {
+  delete static_cast<KtlsSecrets *>(ptr);
+}
+
+auto secrets_index() -> int {
+  static int index =
+      SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, free_secrets);
+  return index;
+}
+
+auto secrets(const SSL *ssl) -> KtlsSecrets * {
+  return static_cast<KtlsSecrets *>(SSL_get_ex_data(ssl, secrets_index()));
+}
+
+auto from_hex(const std::string &hex) -> std::string {
+  std::string bytes;
+  for (std::size_t i = 0; i + 1 < hex.size(); i += 2)
+    bytes.push_back(static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+  return bytes;
+}
+
+void keylog(const SSL *ssl, const char *line) {
+  auto s = secrets(ssl);
+  static const std::string label = "SERVER_TRAFFIC_SECRET_0 ";
+  if (!s || std::strncmp(line, label.data(), label.size()) != 0)
+    return;
+
+  // <label> <client random> <secret>, in hex
+  std::string fields(line + label.size());
+  s->server_secret = from_hex(fields.substr(fields.find(' ') + 1));
+}
+
+void on_message(int write_p, int, int content_type, const void *buf,
+                std::size_t len, SSL *ssl, void *) {
+  auto s = secrets(ssl);
+  if (!s)
+    return;
+  auto type = len > 0 ? static_cast<const unsigned char *>(buf)[0] : 0;
+#ifdef __linux__
+  if (s->fd >= 0) {
+    // an alert of OpenSSL on its way to the socket, where kernel would
+    // encrypt it again, or a KeyUpdate asking for ours, which kernel's
+    // keys cannot follow
+    bool update_requested = !write_p && content_type == SSL3_RT_HANDSHAKE &&
+                            type == SSL3_MT_KEY_UPDATE && len > 4 &&
+                            static_cast<const unsigned char *>(buf)[4] ==
+                                SSL_KEY_UPDATE_REQUESTED;
+    if (write_p || update_requested)
+      ::shutdown(s->fd, SHUT_RDWR);
+    return;
+  }
+#endif
+  if (write_p && content_type == SSL3_RT_HANDSHAKE &&
+      type == SSL3_MT_NEWSESSION_TICKET)
+    ++s->tickets;
+}
+
+/**
+ * @brief   TLS 1.2 key block, PRF(master, "key expansion", server + client random)
+ */
+auto key_block(SSL *ssl, const EVP_MD *md, std::size_t size)
+    -> std::vector<unsigned char> {
+  std::vector<unsigned char> master(SSL_MAX_MASTER_KEY_LENGTH);
+  master.resize(SSL_SESSION_get_master_key(SSL_get_session(ssl),
+                                           master.data(), master.size()));
+  unsigned char server_random[SSL3_RANDOM_SIZE];
+  unsigned char client_random[SSL3_RANDOM_SIZE];
+  SSL_get_server_random(ssl, server_random, sizeof(server_random));
+  SSL_get_client_random(ssl, client_random, sizeof(client_random));
+
+  static const std::string label = "key expansion";
+  std::vector<unsigned char> block(size);
+  auto pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_TLS1_PRF, nullptr);
+  bool ok =
+      pctx && EVP_PKEY_derive_init(pctx) > 0 &&
+      EVP_PKEY_CTX_set_tls1_prf_md(pctx, md) > 0 &&
+      EVP_PKEY_CTX_set1_tls1_prf_secret(pctx, master.data(), master.size()) > 0 &&
+      EVP_PKEY_CTX_add1_tls1_prf_seed(
+          pctx, reinterpret_cast<const unsigned char *>(label.data()),
+          label.size()) > 0 &&
+      EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, server_random,
+                                      sizeof(server_random)) > 0 &&
+      EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, client_random,
+                                      sizeof(client_random)) > 0 &&
+      EVP_PKEY_derive(pctx, block.data(), &size) > 0;
+  EVP_PKEY_CTX_free(pctx);
+  if (!ok)
+    block.clear();
+  return block;
+}
+
+/**
+ * @brief   TLS 1.3 HKDF-Expand-Label(secret, label, "", size)
+ */
+auto expand_label(const std::string &secret, const EVP_MD *md,
+                  const std::string &label, std::size_t size)
+    -> std::vector<unsigned char> {
+  std::string full_label = "tls13 " + label;
+  std::vector<unsigned char> info;
+  info.push_back(static_cast<unsigned char>(size >> 8));
+  info.push_back(static_cast<unsigned char>(size));
+  info.push_back(static_cast<unsigned char>(full_label.size()));
+  info.insert(info.end(), full_label.begin(), full_label.end());
+  info.push_back(0); // empty context
+
+  std::vector<unsigned char> out(size);
+  auto pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+  bool ok =
+      pctx && EVP_PKEY_derive_init(pctx) > 0 &&
+      EVP_PKEY_CTX_set_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+      EVP_PKEY_CTX_set_hkdf_md(pctx, md) > 0 &&
+      EVP_PKEY_CTX_set1_hkdf_key(
+          pctx, reinterpret_cast<const unsigned char *>(secret.data()),
+          secret.size()) > 0 &&
+      EVP_PKEY_CTX_add1_hkdf_info(pctx, info.data(), info.size()) > 0 &&
+      EVP_PKEY_derive(pctx, out.data(), &size) > 0;
+  EVP_PKEY_CTX_free(pctx);
+  if (!ok)
+    out.clear();
+  return out;
+}
+
+#ifdef __linux__
+template <typename CryptoInfo>
+auto set_tx(int fd, const KtlsKeys &keys, CryptoInfo info) -> bool {
+  info.info.version = keys.version_;
+  info.info.cipher_type = keys.cipher_;
+  std::memcpy(info.key, keys.key_.data(), sizeof(info.key));
+  std::memcpy(info.iv, keys.iv_.data(), sizeof(info.iv));
+  std::memcpy(info.salt, keys.salt_.data(), sizeof(info.salt));
+  for (std::size_t i = 0; i < sizeof(info.rec_seq); ++i)
+    info.rec_seq[i] = static_cast<unsigned char>(
+        keys.seq_ >> (8 * (sizeof(info.rec_seq) - 1 - i)));
+  return ::setsockopt(fd, SOL_TLS, TLS_TX, &info, sizeof(info)) == 0;
+}
+#endif
+}
+
+void ktls_context(SSL_CTX *ctx) {
+  secrets_index();
+  SSL_CTX_set_keylog_callback(ctx, keylog);
+  // records sent by OpenSSL after the switch would reuse sequence numbers,
+  // those it cannot be kept from sending close the socket, see ktls_guard()
+  SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION);
+}
+
+void ktls_session(SSL *ssl) {
+  delete secrets(ssl);
+  SSL_set_ex_data(ssl, secrets_index(), new KtlsSecrets());
+  SSL_set_msg_callback(ssl, on_message);
+}
+
+auto ktls_keys(SSL *ssl, KtlsKeys &keys) -> bool {
+  auto s = secrets(ssl);
+  auto cipher = SSL_get_current_cipher(ssl);
+  if (!s || !cipher)
+    return false;
+
+  keys.version_ = SSL_version(ssl);
+  std::size_t fixed_iv_size;
+  switch (SSL_CIPHER_get_id(cipher) & 0xffff) {
+  case 0x1301: // TLS_AES_128_GCM_SHA256
+  case 0x009c: // RSA_WITH_AES_128_GCM_SHA256
+  case 0x009e: // DHE_RSA_WITH_AES_128_GCM_SHA256
+  case 0xc02b: // ECDHE_ECDSA_WITH_AES_128_GCM_SHA256
+  case 0xc02f: // ECDHE_RSA_WITH_AES_128_GCM_SHA256
+    keys.cipher_ = aes_gcm_128;
+    keys.key_.resize(16);
+    fixed_iv_size = 4;
+    break;
+  case 0x1302: // TLS_AES_256_GCM_SHA384
+  case 0x009d: // RSA_WITH_AES_256_GCM_SHA384
+  case 0x009f: // DHE_RSA_WITH_AES_256_GCM_SHA384
+  case 0xc02c: // ECDHE_ECDSA_WITH_AES_256_GCM_SHA384
+  case 0xc030: // ECDHE_RSA_WITH_AES_256_GCM_SHA384
+    keys.cipher_ = aes_gcm_256;
+    keys.key_.resize(32);
+    fixed_iv_size = 4;
+    break;
+  case 0x1303: // TLS_CHACHA20_POLY1305_SHA256
+  case 0xcca8: // ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256
+  case 0xcca9: // ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256
+  case 0xccaa: // DHE_RSA_WITH_CHACHA20_POLY1305_SHA256
+    keys.cipher_ = chacha20_poly1305;
+    keys.key_.resize(32);
+    fixed_iv_size = 12;
+    break;
+  default:
+    return false;
+  }
+  auto md = SSL_CIPHER_get_handshake_digest(cipher);
+
+  std::vector<unsigned char> iv;
+  if (keys.version_ == TLS1_3_VERSION) {
+    if (s->server_secret.empty())
+      return false;
+    keys.key_ = expand_label(s->server_secret, md, "key", keys.key_.size());
+    iv = expand_label(s->server_secret, md, "iv", 12);
+    // session tickets follow server's Finished, under application keys
+    keys.seq_ = s->tickets;
+  } else if (keys.version_ == TLS1_2_VERSION) {
+    // client key, server key, client iv, server iv
+    auto key_size = keys.key_.size();
+    auto block = key_block(ssl, md, 2 * key_size + 2 * fixed_iv_size);
+    if (block.empty())
+      return false;
+    keys.key_.assign(block.begin() + key_size, block.begin() + 2 * key_size);
+    iv.assign(block.begin() + 2 * key_size + fixed_iv_size, block.end());
+    // server's Finished was the first record under these keys
+    keys.seq_ = 1;
+  } else {
+    return false;
+  }
+  if (keys.key_.empty() || iv.empty())
+    return false;
+
+  keys.salt_.clear();
+  keys.iv_.clear();
+  if (keys.cipher_ == chacha20_poly1305) {
+    keys.iv_ = iv;
+  } else if (keys.version_ == TLS1_3_VERSION) {
+    keys.salt_.assign(iv.begin(), iv.begin() + 4);
+    keys.iv_.assign(iv.begin() + 4, iv.end());
+  } else {
+    // explicit nonce is ours to pick, the record sequence number will do
+    keys.salt_ = iv;
+    for (int i = 7; i >= 0; --i)
+      keys.iv_.push_back(static_cast<unsigned char>(keys.seq_ >> (8 * i)));
+  }
+  return true;
+}
+
+auto ktls_start_tx(SSL *ssl, int fd) -> bool {
+  bool started = false;
+#ifdef __linux__
+  KtlsKeys keys;
+  if (!ktls_keys(ssl, keys))
+    return false;
+  // fails with ENOENT when the tls module is not loaded
+  if (::setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+    return false;
+
+  // with no TLS_TX, the socket passes data through as before
+  switch (keys.cipher_) {
+  case aes_gcm_128:
+    started = set_tx(fd, keys, tls12_crypto_info_aes_gcm_128{});
+    break;
+  case aes_gcm_256:
+    started = set_tx(fd, keys, tls12_crypto_info_aes_gcm_256{});
+    break;
+  case chacha20_poly1305:
+    started = set_tx(fd, keys, tls12_crypto_info_chacha20_poly1305{});
+    break;
+  }
+  if (started)
+    ktls_guard(ssl, fd);
+#endif
+  return started;
+}
+
+void ktls_guard(SSL *ssl, int fd) {
+  if (auto s = secrets(ssl))
+    s->fd = fd;
+}
+}
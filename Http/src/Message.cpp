@@ -114,6 +114,14 @@ void Message::content_type(HeaderValueType value)
     set_header({"Content-Type", value});
 }
 
+void Message::clear()
+{
+    version_major_ = 1;
+    version_minor_ = 1;
+    headers_.clear();
+    body_.clear();
+}
+
 auto operator<<(std::ostream &strm, Message::HeaderType &header) -> std::ostream &
 {
     return strm << Message::header_name(header) << ": " << Message::header_value(header) << std::endl;
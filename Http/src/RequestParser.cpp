@@ -198,7 +198,7 @@ auto RequestParser::consume(Request &request, char c) -> ParseStatus {
       return status::in_progress;
     }
     if (is_token(c)) {
-      request.headers_.emplace_back();
+      request.add_header();
       request.build_header_name(c);
       state_ = s::req_field_name;
       return status::in_progress;
@@ -255,7 +255,7 @@ auto RequestParser::consume(Request &request, char c) -> ParseStatus {
       return status::in_progress;
     }
     if (is_token(c)) {
-      request.headers_.emplace_back();
+      request.add_header();
       request.build_header_name(c);
       state_ = s::req_field_name;
       return status::in_progress;
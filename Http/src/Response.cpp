@@ -1,8 +1,14 @@
 #include "asio.hpp"
 #include "json.hpp"
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
 #include <ostream>
+#include <random>
 #include <string>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <utility>
 
 #include "Constants.h"
@@ -15,6 +21,24 @@ auto Response::to_payload() const -> std::string {
   return payloads;
 }
 
+auto Response::to_buffers() -> std::vector<asio::const_buffer> {
+  if (payload_)
+    return {asio::buffer(*payload_)};
+
+  head_ = status_line();
+  head_ += flatten_header();
+
+  std::vector<asio::const_buffer> buffers{asio::buffer(head_)};
+  if (!body_.empty())
+    buffers.push_back(asio::buffer(body_));
+  return buffers;
+}
+
+auto Response::write_payload(std::shared_ptr<const std::string> payload)
+    -> void {
+  payload_ = std::move(payload);
+}
+
 StatusCode Response::status_code() { return status_code_; }
 
 void Response::status_code(StatusCode status_code) {
@@ -67,7 +91,7 @@ auto Response::write_range(char* data, int start, int end, int total)
   content_length(content_length() + end - start);
   status_code_ = StatusCode::Partial_Content;
 
-  body_ += std::string(data, end-start);
+  body_.append(data, end - start);
 }
 
 auto Response::write_json(json_type data) -> void {
@@ -79,11 +103,124 @@ auto Response::write_json(json_type data) -> void {
   body_ += dump;
 }
 
+auto Response::write_file_ranges(const std::string &path,
+                                 const std::vector<ByteRange> &ranges,
+                                 const std::string &content_type) -> bool {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  file_ = FileRange();
+  file_.fd_ = std::shared_ptr<int>(new int(fd), [](int *fd) {
+    ::close(*fd);
+    delete fd;
+  });
+
+  struct stat st;
+  auto total = std::to_string(::fstat(fd, &st) == 0 ? st.st_size : 0);
+  auto content_range = [&total](const ByteRange &range) {
+    return "bytes " + std::to_string(range.first_) + "-" +
+           std::to_string(range.last_) + "/" + total;
+  };
+  status_code_ = StatusCode::Partial_Content;
+  body_.clear();
+
+  if (ranges.size() == 1) {
+    set_header({"Content-Range", content_range(ranges.front())});
+    set_header({"Content-Length", std::to_string(ranges.front().length())});
+    file_.offset_ = ranges.front().first_;
+    file_.length_ = ranges.front().length();
+    return true;
+  }
+
+  // parts are delimited by a boundary unlikely to occur in the file
+  static thread_local std::mt19937_64 random{std::random_device{}()};
+  char boundary[17];
+  std::snprintf(boundary, sizeof(boundary), "%016llx",
+                static_cast<unsigned long long>(random()));
+  set_header({"Content-Type",
+              std::string("multipart/byteranges; boundary=") + boundary});
+
+  std::uint64_t length = 0;
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    auto prefix = std::string(i ? "\r\n" : "") + "--" + boundary + "\r\n" +
+                  "Content-Type: " + content_type + "\r\n" +
+                  "Content-Range: " + content_range(ranges[i]) + "\r\n\r\n";
+    length += prefix.size() + ranges[i].length();
+    if (i)
+      file_.parts_.push_back(
+          {std::move(prefix), ranges[i].first_, ranges[i].length()});
+    else
+      body_ = std::move(prefix);
+  }
+  file_.offset_ = ranges.front().first_;
+  file_.length_ = ranges.front().length();
+  file_.suffix_ = std::string("\r\n--") + boundary + "--\r\n";
+  length += file_.suffix_.size();
+  set_header({"Content-Length", std::to_string(length)});
+  return true;
+}
+
+namespace {
+
+/**
+ * @brief   Media types whose bodies compression does not shrink
+ */
+bool compressed_type(const std::string &type) {
+  static const char *types[] = {
+      "application/vnd.ga4gh.bam", "application/vnd.ga4gh.cram",
+      "application/gzip",          "application/x-gzip",
+      "application/zip",           "application/zstd",
+      "image/",                    "audio/",
+      "video/"};
+  for (auto prefix : types)
+    if (type.compare(0, std::strlen(prefix), prefix) == 0)
+      return true;
+  return false;
+}
+}
+
+constexpr std::size_t Response::compress_min_size;
+
+auto Response::compress(const std::string &accept_encoding,
+                        std::size_t min_size, int level) -> bool {
+  if (body_.size() < min_size || file_ || get_header("Content-Encoding").second ||
+      get_header("Content-Range").second ||
+      compressed_type(get_header("Content-Type").first))
+    return false;
+
+  // representation depends on Accept-Encoding, whichever is picked
+  auto vary = get_header("Vary");
+  if (!vary.second)
+    set_header({"Vary", "Accept-Encoding"});
+  else if (vary.first.find("Accept-Encoding") == std::string::npos)
+    set_header({"Vary", vary.first + ", Accept-Encoding"});
+
+  auto coding = negotiate_coding(accept_encoding);
+  std::string compressed;
+  if (coding == ContentCoding::identity ||
+      !Http::compress(coding, body_, compressed, level) ||
+      compressed.size() >= body_.size())
+    return false;
+
+  body_ = std::move(compressed);
+  set_header({"Content-Encoding", coding_to_string(coding)});
+  content_length(body_.size());
+  return true;
+}
+
 auto Response::clear_body() -> void {
   body_.clear();
+  file_ = FileRange();
   content_length(0);
 }
 
+auto Response::clear() -> void {
+  Message::clear();
+  file_ = FileRange();
+  payload_.reset();
+  status_code_ = StatusCode::OK;
+}
+
 std::ostream &operator<<(std::ostream &strm, const Response &response) {
   strm << "< " << response.status_line();
   for (auto &header : response.headers_) {
@@ -0,0 +1,190 @@
+#include <cassert>
+#include <utility>
+
+#include "TimerWheel.h"
+
+namespace Http {
+
+asio::io_service::id TimerWheel::id;
+
+constexpr std::chrono::milliseconds TimerWheel::tick;
+
+TimerWheel::TimerWheel(asio::io_service &io_service)
+    : asio::io_service::service(io_service), driver_(io_service) {}
+
+void TimerWheel::arm(Timer &timer, ClockType::time_point deadline,
+                     Callback callback) {
+  Callback replaced;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (timer.slot_)
+      unlink(timer);
+    if (size_ == 0)
+      // nothing armed, skip ticks that have gone by
+      current_tick_ = std::max(current_tick_, to_tick(ClockType::now()));
+
+    // round up, so as never to fire early
+    auto expiry_tick = to_tick(deadline);
+    if (start_ + expiry_tick * tick < deadline)
+      ++expiry_tick;
+
+    timer.wheel_ = this;
+    timer.expires_at_ = deadline;
+    timer.expiry_tick_ = std::max(expiry_tick, current_tick_ + 1);
+    replaced = std::move(timer.callback_);
+    timer.callback_ = std::move(callback);
+    link(timer);
+    if (!scheduled_ || timer.expiry_tick_ < scheduled_tick_)
+      schedule();
+  }
+}
+
+void TimerWheel::cancel(Timer &timer) {
+  Callback dropped;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timer.expires_at_ = ClockType::time_point::max();
+    if (!timer.slot_)
+      return;
+    unlink(timer);
+    dropped = std::move(timer.callback_);
+  }
+}
+
+void TimerWheel::advance(ClockType::time_point now) {
+  std::vector<Callback> expired;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto target = to_tick(now);
+
+    while (current_tick_ < target && size_ > 0) {
+      auto t = ++current_tick_;
+      if ((t & (slot_count - 1)) == 0) {
+        if (((t >> slot_bits) & (slot_count - 1)) == 0)
+          cascade(2, (t >> (2 * slot_bits)) & (slot_count - 1));
+        cascade(1, (t >> slot_bits) & (slot_count - 1));
+      }
+
+      auto &slot = levels_[0][t & (slot_count - 1)];
+      while (slot) {
+        auto &timer = *slot;
+        assert(timer.expiry_tick_ <= t);
+        unlink(timer);
+        expired.push_back(std::move(timer.callback_));
+      }
+    }
+    current_tick_ = std::max(current_tick_, target);
+    schedule();
+  }
+
+  for (auto &callback : expired)
+    if (callback)
+      callback();
+}
+
+std::size_t TimerWheel::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_;
+}
+
+void TimerWheel::shutdown_service() {
+  std::vector<Callback> dropped;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+    for (auto &level : levels_)
+      for (auto &slot : level)
+        while (slot) {
+          dropped.push_back(std::move(slot->callback_));
+          unlink(*slot);
+        }
+  }
+}
+
+auto TimerWheel::to_tick(ClockType::time_point time) const -> std::uint64_t {
+  if (time <= start_)
+    return 0;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(time - start_) /
+         tick;
+}
+
+void TimerWheel::link(Timer &timer) {
+  const auto mask = slot_count - 1;
+  auto expiry = timer.expiry_tick_;
+  auto delta = expiry - std::min(expiry, current_tick_);
+
+  Slot *slot;
+  if (delta < slot_count) {
+    slot = &levels_[0][expiry & mask];
+  } else if (delta < slot_count << slot_bits) {
+    slot = &levels_[1][(expiry >> slot_bits) & mask];
+  } else {
+    // beyond the last level, park in its furthest slot
+    auto furthest = current_tick_ + (slot_count << (2 * slot_bits)) - 1;
+    slot = &levels_[2][(std::min(expiry, furthest) >> (2 * slot_bits)) & mask];
+  }
+
+  timer.prev_ = nullptr;
+  timer.next_ = *slot;
+  if (*slot)
+    (*slot)->prev_ = &timer;
+  *slot = &timer;
+  timer.slot_ = slot;
+  ++size_;
+}
+
+void TimerWheel::unlink(Timer &timer) {
+  if (timer.prev_)
+    timer.prev_->next_ = timer.next_;
+  else
+    *timer.slot_ = timer.next_;
+  if (timer.next_)
+    timer.next_->prev_ = timer.prev_;
+  timer.prev_ = timer.next_ = nullptr;
+  timer.slot_ = nullptr;
+  --size_;
+}
+
+void TimerWheel::cascade(std::size_t level, std::size_t slot) {
+  auto head = levels_[level][slot];
+  levels_[level][slot] = nullptr;
+  while (head) {
+    auto &timer = *head;
+    head = timer.next_;
+    --size_;
+    link(timer);
+  }
+}
+
+auto TimerWheel::next_tick() const -> std::uint64_t {
+  const auto mask = slot_count - 1;
+  // timers on upper levels are due no earlier than the next cascade
+  auto cascade_tick = (current_tick_ | mask) + 1;
+  for (auto t = current_tick_ + 1; t < cascade_tick; ++t)
+    if (levels_[0][t & mask])
+      return t;
+  return cascade_tick;
+}
+
+void TimerWheel::schedule() {
+  if (shutdown_ || size_ == 0)
+    return;
+  auto next = next_tick();
+  if (scheduled_ && scheduled_tick_ <= next)
+    return;
+  scheduled_ = true;
+  scheduled_tick_ = next;
+
+  // cancels a later wait, if any
+  driver_.expires_at(start_ + next * tick);
+  driver_.async_wait([this](const asio::error_code &ec) {
+    if (ec == asio::error::operation_aborted)
+      return; // moved earlier, or shut down
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      scheduled_ = false;
+    }
+    advance(ClockType::now());
+  });
+}
+}
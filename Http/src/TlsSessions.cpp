@@ -0,0 +1,171 @@
+#include <cstring>
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+#include "TlsSessions.h"
+
+namespace Http {
+
+namespace {
+
+auto sessions_index() -> int {
+  static int index =
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+const unsigned char session_id_context[] = "Http";
+}
+
+/**
+ * @brief   Encrypts and decrypts session tickets with TlsSessions' keys
+ */
+struct TicketKeyCallback {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  static int call(SSL *ssl, unsigned char *name, unsigned char *iv,
+                  EVP_CIPHER_CTX *cipher_ctx, EVP_MAC_CTX *mac_ctx, int enc) {
+#else
+  static int call(SSL *ssl, unsigned char *name, unsigned char *iv,
+                  EVP_CIPHER_CTX *cipher_ctx, HMAC_CTX *mac_ctx, int enc) {
+#endif
+    auto sessions = TlsSessions::from(ssl);
+    TlsSessions::TicketKey key;
+    int found = sessions ? sessions->ticket_key(name, enc, key) : 0;
+    if (!found)
+      return 0; // full handshake, a new ticket is issued
+
+    if (enc) {
+      std::memcpy(name, key.name_, sizeof(key.name_));
+      if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) <= 0)
+        return -1;
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    char digest[] = "SHA256";
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key_,
+                                          sizeof(key.hmac_key_)),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+        OSSL_PARAM_construct_end()};
+    if (!EVP_MAC_CTX_set_params(mac_ctx, params))
+      return -1;
+#else
+    if (!HMAC_Init_ex(mac_ctx, key.hmac_key_, sizeof(key.hmac_key_),
+                      EVP_sha256(), nullptr))
+      return -1;
+#endif
+    int ok = enc ? EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr,
+                                      key.aes_key_, iv)
+                 : EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr,
+                                      key.aes_key_, iv);
+    return ok ? found : -1;
+  }
+};
+
+void TlsSessions::attach(SSL_CTX *ctx) {
+  ctx_ = ctx;
+  SSL_CTX_set_ex_data(ctx, sessions_index(), this);
+
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_set_session_id_context(ctx, session_id_context,
+                                 sizeof(session_id_context));
+  lifetime(std::chrono::hours(1));
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rotate(ClockType::now());
+    has_previous_ = false;
+  }
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, TicketKeyCallback::call);
+#else
+  SSL_CTX_set_tlsext_ticket_key_cb(ctx, TicketKeyCallback::call);
+#endif
+}
+
+auto TlsSessions::cache_size() -> std::size_t {
+  return SSL_CTX_sess_get_cache_size(ctx_);
+}
+
+void TlsSessions::cache_size(std::size_t size) {
+  SSL_CTX_sess_set_cache_size(ctx_, static_cast<long>(size));
+}
+
+auto TlsSessions::lifetime() -> std::chrono::seconds {
+  return std::chrono::seconds(SSL_CTX_get_timeout(ctx_));
+}
+
+void TlsSessions::lifetime(std::chrono::seconds lifetime) {
+  SSL_CTX_set_timeout(ctx_, static_cast<long>(lifetime.count()));
+}
+
+auto TlsSessions::ticket_key_rotation() -> std::chrono::seconds {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return rotation_;
+}
+
+void TlsSessions::ticket_key_rotation(std::chrono::seconds interval) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  rotation_ = interval;
+}
+
+void TlsSessions::rotate_ticket_keys() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  rotate(ClockType::now());
+}
+
+auto TlsSessions::cached() -> std::size_t {
+  return SSL_CTX_sess_number(ctx_);
+}
+
+void TlsSessions::record_handshake(SSL *ssl, bool ok) {
+  auto sessions = from(ssl);
+  if (!sessions)
+    return;
+  if (!ok)
+    ++sessions->failed_handshakes_;
+  else if (SSL_session_reused(ssl))
+    ++sessions->resumed_handshakes_;
+  else
+    ++sessions->full_handshakes_;
+}
+
+auto TlsSessions::ticket_key(const unsigned char *name, bool encrypt,
+                             TicketKey &key) -> int {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = ClockType::now();
+  if (now - rotated_at_ >= rotation_)
+    rotate(now);
+
+  if (encrypt || !std::memcmp(name, current_.name_, sizeof(current_.name_))) {
+    key = current_;
+    return 1;
+  }
+  if (has_previous_ &&
+      !std::memcmp(name, previous_.name_, sizeof(previous_.name_))) {
+    key = previous_;
+    return 2;
+  }
+  return 0;
+}
+
+void TlsSessions::rotate(ClockType::time_point now) {
+  previous_ = current_;
+  has_previous_ = true;
+  RAND_bytes(current_.name_, sizeof(current_.name_));
+  RAND_bytes(current_.aes_key_, sizeof(current_.aes_key_));
+  RAND_bytes(current_.hmac_key_, sizeof(current_.hmac_key_));
+  rotated_at_ = now;
+}
+
+auto TlsSessions::from(SSL *ssl) -> TlsSessions * {
+  return static_cast<TlsSessions *>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), sessions_index()));
+}
+}
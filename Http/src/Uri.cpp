@@ -13,12 +13,30 @@ auto ctohex(unsigned int c) -> std::string {
   return os.str();
 }
 
+namespace {
+
+auto decode_field(std::string &field) -> void {
+  if (field.find('%') != std::string::npos)
+    field = Uri::urldecode(field);
+}
+}
+
+auto Uri::clear() -> void {
+  scheme_.clear();
+  host_.clear();
+  port_.clear();
+  abs_path_.clear();
+  query_.clear();
+  fragment_.clear();
+  state_ = UriState::uri_start;
+}
+
 auto Uri::decode() -> void {
-  scheme_ = urldecode(scheme_);
-  host_ = urldecode(host_);
-  abs_path_ = urldecode(abs_path_);
-  query_ = urldecode(query_);
-  fragment_ = urldecode(fragment_);
+  decode_field(scheme_);
+  decode_field(host_);
+  decode_field(abs_path_);
+  decode_field(query_);
+  decode_field(fragment_);
 }
 
 auto Uri::urlencode(const std::string &url) -> std::string {
@@ -58,6 +76,12 @@ auto Uri::urldecode(const std::string &url) -> std::string {
 }
 
 auto Uri::make_query(const std::string &qstr) -> ssmap {
+  ssmap query_map;
+  make_query(qstr, query_map);
+  return query_map;
+}
+
+auto Uri::make_query(const std::string &qstr, ssmap &query_map) -> void {
   constexpr char tok_and = '&';
   constexpr char tok_equal = '=';
 
@@ -66,7 +90,6 @@ auto Uri::make_query(const std::string &qstr) -> ssmap {
 
   std::size_t pos = 0;
   std::string token, key, value;
-  ssmap query_map;
 
   while ((pos = query.find(tok_and)) != std::string::npos) {
     token = query.substr(0, pos);
@@ -74,7 +97,6 @@ auto Uri::make_query(const std::string &qstr) -> ssmap {
     query_map.insert({key, value});
     query.erase(0, pos + 1);
   }
-  return query_map;
 }
 
 /*
@@ -0,0 +1,166 @@
+#include "catch.hpp"
+#include "asio.hpp"
+#include <cstdint>
+#include <string>
+
+#include "Arena.h"
+#include "ConnectionPool.h"
+#include "Request.h"
+#include "RequestParser.h"
+
+using namespace Http;
+
+TEST_CASE("Arena", "[Arena]")
+{
+    Arena arena(256);
+
+    SECTION("allocates aligned, in order, within a block")
+    {
+        auto a = static_cast<char *>(arena.allocate(3, 1));
+        auto b = static_cast<char *>(arena.allocate(8, 8));
+        REQUIRE(b - a >= 3);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(b) % 8 == 0);
+        REQUIRE(arena.block_count() == 1);
+    }
+
+    SECTION("grows by blocks, keeps them across reset")
+    {
+        auto first = arena.allocate(200);
+        arena.allocate(200);
+        arena.allocate(1000);
+        REQUIRE(arena.block_count() == 3);
+        auto capacity = arena.capacity();
+
+        arena.reset();
+        REQUIRE(arena.allocate(200) == first);
+        arena.allocate(200);
+        arena.allocate(1000);
+        REQUIRE(arena.block_count() == 3);
+        REQUIRE(arena.capacity() == capacity);
+    }
+
+    SECTION("map in arena, copies on the heap")
+    {
+        auto fill = [&arena] {
+            ssmap map{ssmap::allocator_type(&arena)};
+            map["format"] = "BAM";
+            map["referenceName"] = "1";
+            return map;
+        };
+        auto map = fill();
+        auto blocks = arena.block_count();
+
+        ssmap copy = map;
+        REQUIRE(copy.get_allocator() == ssmap::allocator_type());
+        REQUIRE(copy["format"] == "BAM");
+
+        ssmap moved = std::move(map);
+        REQUIRE(moved.get_allocator() == ssmap::allocator_type(&arena));
+
+        // node sizes differ between standard libraries, block count does not
+        // grow once the arena is reset and filled alike
+        moved.clear();
+        arena.reset();
+        fill();
+        REQUIRE(arena.block_count() == blocks);
+    }
+}
+
+TEST_CASE("Request reuses storage", "[Arena]")
+{
+    Arena arena;
+    Request request;
+    RequestParser parser;
+    request.use_arena(arena);
+
+    std::string raw = "GET /reads/bamtest?format=BAM&referenceName=1 HTTP/1.1\r\n"
+                      "User-Agent: a-client-with-a-rather-long-user-agent-string\r\n"
+                      "Host: 127.0.0.1\r\n\r\n";
+
+    for (int i = 0; i < 3; ++i) {
+        ParseStatus status;
+        std::tie(std::ignore, status) = parser.parse(request, raw.begin(), raw.end());
+        REQUIRE(status == ParseStatus::accept);
+        Uri::make_query(request.uri_.query_, request.query_);
+
+        REQUIRE(request.uri_.abs_path_ == "/reads/bamtest");
+        REQUIRE(request.query_["format"] == "BAM");
+        REQUIRE(request.query_["referenceName"] == "1");
+        REQUIRE(request.get_header("User-Agent").first ==
+                "a-client-with-a-rather-long-user-agent-string");
+        REQUIRE(request.headers_.size() == 2);
+        REQUIRE(request.query_.get_allocator() == ssmap::allocator_type(&arena));
+
+        request.clear();
+        arena.reset();
+        parser.reset();
+        REQUIRE(request.headers_.empty());
+        REQUIRE(request.query_.empty());
+        REQUIRE(request.uri_.abs_path_.empty());
+    }
+    REQUIRE(arena.block_count() == 1);
+
+    // strings of cleared headers are handed out last first, capacity kept
+    request.add_header();
+    auto &user_agent = request.add_header();
+    REQUIRE(user_agent.second.empty());
+    REQUIRE(user_agent.second.capacity() >= 45);
+}
+
+TEST_CASE("Connection pool", "[Arena]")
+{
+    asio::io_service io_service;
+    Router<Handler> router;
+    ThreadPool blocking_executor(1);
+    ConnectionOptions options;
+    AdmissionControl admission;
+    auto &pool = asio::use_service<ConnectionPool<TcpSocket>>(io_service);
+
+    auto acquire = [&] {
+        return pool.acquire(io_service, router, blocking_executor, options,
+                            admission);
+    };
+
+    SECTION("released connection is handed out again")
+    {
+        auto connection = acquire();
+        auto address = connection.get();
+        connection.reset();
+        REQUIRE(pool.size() == 1);
+
+        auto again = acquire();
+        REQUIRE(again.get() == address);
+        REQUIRE(pool.recycled() == 1);
+        REQUIRE(pool.size() == 0);
+        REQUIRE(again->shared_from_this() == again);
+    }
+
+    SECTION("no more than connection_pool_size parked")
+    {
+        options.connection_pool_size = 1;
+        auto a = acquire(), b = acquire();
+        a.reset();
+        b.reset();
+        REQUIRE(pool.size() == 1);
+    }
+
+    SECTION("pooling off")
+    {
+        options.connection_pool_size = 0;
+        acquire().reset();
+        REQUIRE(pool.size() == 0);
+    }
+
+    SECTION("Unix socket connections, in a pool of their own")
+    {
+        auto &unix_pool = asio::use_service<ConnectionPool<UnixSocket>>(io_service);
+        auto connection = unix_pool.acquire(io_service, router, blocking_executor,
+                                            options, admission);
+        auto address = connection.get();
+        connection.reset();
+        REQUIRE(unix_pool.size() == 1);
+        REQUIRE(pool.size() == 0);
+        REQUIRE(unix_pool.acquire(io_service, router, blocking_executor, options,
+                                  admission).get() == address);
+    }
+}
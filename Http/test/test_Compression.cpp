@@ -0,0 +1,124 @@
+#include "catch.hpp"
+#include <string>
+
+#include <zlib.h>
+
+#include "Compression.h"
+#include "Response.h"
+
+using namespace Http;
+
+namespace {
+
+auto inflate_body(const std::string &in, int window_bits) -> std::string {
+    z_stream stream = z_stream();
+    REQUIRE(inflateInit2(&stream, window_bits) == Z_OK);
+    std::string out(1 << 20, '\0');
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    stream.avail_in = in.size();
+    stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    stream.avail_out = out.size();
+    REQUIRE(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+    out.resize(stream.total_out);
+    inflateEnd(&stream);
+    return out;
+}
+
+auto ticket_json(int urls) -> std::string {
+    std::string json = "{\"format\":\"BAM\",\"urls\":[";
+    for (int i = 0; i < urls; ++i)
+        json += "{\"headers\":{\"Range\":\"bytes=" + std::to_string(i << 20) +
+                "-" + std::to_string(((i + 1) << 20) - 1) +
+                "\"},\"url\":\"https://127.0.0.1:8888/data/9f86d081884c7d65\"},";
+    json.back() = ']';
+    return json + "}";
+}
+}
+
+TEST_CASE("Negotiate content coding", "[Compression]")
+{
+    auto preferred = coding_available(ContentCoding::zstd) ? ContentCoding::zstd
+                                                           : ContentCoding::gzip;
+
+    REQUIRE(negotiate_coding("") == ContentCoding::identity);
+    REQUIRE(negotiate_coding("identity") == ContentCoding::identity);
+    REQUIRE(negotiate_coding("gzip") == ContentCoding::gzip);
+    REQUIRE(negotiate_coding("x-gzip") == ContentCoding::gzip);
+    REQUIRE(negotiate_coding("deflate") == ContentCoding::deflate);
+    REQUIRE(negotiate_coding("gzip, deflate, br") == ContentCoding::gzip);
+    REQUIRE(negotiate_coding("deflate, GZIP") == ContentCoding::gzip);
+    REQUIRE(negotiate_coding("gzip;q=0.5, deflate") == ContentCoding::deflate);
+    REQUIRE(negotiate_coding("gzip; q=0, deflate;q=0") == ContentCoding::identity);
+    REQUIRE(negotiate_coding("br") == ContentCoding::identity);
+    REQUIRE(negotiate_coding("*") == preferred);
+    REQUIRE(negotiate_coding("*;q=0.1, gzip;q=0.5") == ContentCoding::gzip);
+    REQUIRE(negotiate_coding("*, zstd;q=0") == ContentCoding::gzip);
+    if (coding_available(ContentCoding::zstd))
+        REQUIRE(negotiate_coding("gzip, zstd") == ContentCoding::zstd);
+    else
+        REQUIRE(negotiate_coding("zstd") == ContentCoding::identity);
+}
+
+TEST_CASE("Compress body", "[Compression]")
+{
+    auto json = ticket_json(1000);
+
+    SECTION("gzip and deflate round trip")
+    {
+        std::string gzip, deflate;
+        REQUIRE(compress(ContentCoding::gzip, json, gzip));
+        REQUIRE(compress(ContentCoding::deflate, json, deflate));
+        REQUIRE(gzip.size() * 10 < json.size());
+        REQUIRE(inflate_body(gzip, 16 + MAX_WBITS) == json);
+        REQUIRE(inflate_body(deflate, MAX_WBITS) == json);
+
+        // codec state is reused
+        std::string again;
+        REQUIRE(compress(ContentCoding::gzip, json, again, 1));
+        REQUIRE(inflate_body(again, 16 + MAX_WBITS) == json);
+        REQUIRE(!compress(ContentCoding::identity, json, again));
+    }
+
+    SECTION("Response by Accept-Encoding")
+    {
+        Response res;
+        res.write_json(json_type::parse(json));
+        auto size = res.body_.size();
+        REQUIRE(res.compress("gzip, deflate"));
+        REQUIRE(res.get_header("Content-Encoding").first == "gzip");
+        REQUIRE(res.get_header("Vary").first == "Accept-Encoding");
+        REQUIRE(res.content_length() == static_cast<int>(res.body_.size()));
+        REQUIRE(res.body_.size() < size);
+        REQUIRE(inflate_body(res.body_, 16 + MAX_WBITS).size() == size);
+
+        // encoded once only
+        REQUIRE(!res.compress("gzip"));
+    }
+
+    SECTION("Left as is")
+    {
+        Response res;
+        res.write_text(json);
+        REQUIRE(!res.compress(""));
+        REQUIRE(res.get_header("Vary").first == "Accept-Encoding");
+        REQUIRE(!res.get_header("Content-Encoding").second);
+        REQUIRE(res.body_ == json);
+
+        Response small;
+        small.write_text(std::string(200, 'a'));
+        REQUIRE(!small.compress("gzip"));
+        REQUIRE(small.compress("gzip", 100));
+
+        // not worth it
+        Response tiny;
+        tiny.write_text("{\"htsget\":{}}");
+        REQUIRE(!tiny.compress("gzip", 0));
+        REQUIRE(!tiny.get_header("Content-Encoding").second);
+
+        Response bam;
+        bam.write_text(json);
+        bam.content_type("application/vnd.ga4gh.bam");
+        REQUIRE(!bam.compress("gzip"));
+        REQUIRE(bam.body_ == json);
+    }
+}
@@ -0,0 +1,145 @@
+#include "catch.hpp"
+#include "asio.hpp"
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "Coroutine.h"
+#include "Router.h"
+#include "ThreadPool.h"
+#include "asio/yield.hpp"
+
+using namespace Http;
+
+struct CountState {
+    int count = 0;
+};
+
+TEST_CASE("coroutine handler", "[Coroutine]")
+{
+    asio::io_service io_service;
+    Response res;
+    Request req;
+    Context ctx(req, res);
+    ctx.io_service_ = &io_service;
+
+    int completed = 0;
+    ctx.make_completion_ = [&completed] {
+        return [&completed] { ++completed; };
+    };
+
+    SECTION("completes once body runs to completion")
+    {
+        auto handler = Handler(make_coroutine<CountState>(
+            [](CoroutineFrame<CountState> &co, Context &ctx) {
+                reenter(co)
+                {
+                    while (co.state_.count < 3)
+                    {
+                        yield co.io_service().post(
+                            [resume = co.resume()]() mutable { resume(std::error_code()); });
+                        ++co.state_.count;
+                        ctx.res_.write_text(std::to_string(co.state_.count));
+                    }
+                }
+            }));
+
+        handler(ctx);
+        REQUIRE(completed == 0);
+
+        io_service.run();
+        REQUIRE(completed == 1);
+        REQUIRE(res.body_ == "123");
+    }
+
+    SECTION("completes when body returns without awaiting")
+    {
+        auto handler = Handler(make_coroutine(
+            [](CoroutineFrame<> &co, Context &ctx) {
+                reenter(co)
+                {
+                    if (ctx.req_.method_ == RequestMethod::UNDETERMINED)
+                        return ctx.res_.status_code(StatusCode::Bad_Request);
+                    yield co.io_service().post(
+                        [resume = co.resume()]() mutable { resume(std::error_code()); });
+                }
+            }));
+
+        handler(ctx);
+        REQUIRE(completed == 1);
+        REQUIRE(res.status_code() == StatusCode::Bad_Request);
+        REQUIRE(io_service.run() == 0);
+    }
+
+    SECTION("resumes with result of awaited operation")
+    {
+        auto handler = Handler(make_coroutine(
+            [](CoroutineFrame<> &co, Context &ctx) {
+                reenter(co)
+                {
+                    yield co.io_service().post(
+                        [resume = co.resume()]() mutable {
+                            resume(std::make_error_code(std::errc::broken_pipe), 42);
+                        });
+                    REQUIRE(co.ec_ == std::errc::broken_pipe);
+                    REQUIRE(co.bytes_transferred_ == 42);
+                }
+            }));
+
+        handler(ctx);
+        io_service.run();
+        REQUIRE(completed == 1);
+    }
+
+    SECTION("runs blocking tasks off the event loop, resumes on it")
+    {
+        ThreadPool executor(1);
+        auto loop = std::this_thread::get_id();
+        std::thread::id task_thread, resumed_thread;
+
+        auto handler = Handler(make_coroutine(
+            [&](CoroutineFrame<> &co, Context &ctx) {
+                reenter(co)
+                {
+                    yield co.run_blocking(executor, [&] {
+                        task_thread = std::this_thread::get_id();
+                    });
+                    REQUIRE(!co.ec_);
+                    yield co.run_blocking(executor, [] {
+                        throw std::runtime_error("pclose failed");
+                    });
+                    REQUIRE(co.ec_ == std::errc::io_error);
+                    resumed_thread = std::this_thread::get_id();
+                }
+            }));
+
+        asio::io_service::work work(io_service);
+        handler(ctx);
+        while (!completed)
+            io_service.run_one();
+        REQUIRE(task_thread != loop);
+        REQUIRE(resumed_thread == loop);
+    }
+
+    SECTION("completes with 500 when body throws, not re-entered after")
+    {
+        auto handler = Handler(make_coroutine<CountState>(
+            [](CoroutineFrame<CountState> &co, Context &ctx) {
+                reenter(co)
+                {
+                    ++co.state_.count;
+                    co.io_service().post(
+                        [resume = co.resume()]() mutable { resume(std::error_code()); });
+                    throw std::runtime_error("samtools not found");
+                }
+                REQUIRE(false);
+            }));
+
+        handler(ctx);
+        REQUIRE(completed == 1);
+        REQUIRE(res.status_code() == StatusCode::Internal_Server_Error);
+
+        io_service.run();
+        REQUIRE(completed == 1);
+    }
+}
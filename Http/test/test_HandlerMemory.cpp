@@ -0,0 +1,100 @@
+#include "catch.hpp"
+#include "asio.hpp"
+#include "asio/basic_waitable_timer.hpp"
+#include <chrono>
+#include <functional>
+#include <string>
+
+#include "HandlerMemory.h"
+
+using namespace Http;
+
+TEST_CASE("Slots", "[HandlerMemory]")
+{
+    HandlerMemory memory;
+
+    SECTION("freed slot is reused")
+    {
+        auto p = memory.allocate(100);
+        memory.deallocate(p);
+        REQUIRE(memory.allocate(200) == p);
+        REQUIRE(memory.heap_allocations() == 0);
+    }
+
+    SECTION("heap once every slot is taken, or too large")
+    {
+        void *taken[HandlerMemory::slot_count];
+        for (auto &p : taken)
+            p = memory.allocate(HandlerMemory::slot_size);
+        REQUIRE(memory.heap_allocations() == 0);
+
+        auto overflow = memory.allocate(16);
+        REQUIRE(memory.heap_allocations() == 1);
+        memory.deallocate(overflow);
+
+        memory.deallocate(taken[0]);
+        auto large = memory.allocate(HandlerMemory::slot_size + 1);
+        REQUIRE(memory.heap_allocations() == 2);
+        memory.deallocate(large);
+        REQUIRE(memory.allocate(16) == taken[0]);
+        REQUIRE(memory.allocations() == HandlerMemory::slot_count + 3);
+    }
+}
+
+TEST_CASE("Operations draw from handler memory", "[HandlerMemory]")
+{
+    asio::io_service io_service;
+    asio::io_service::strand strand(io_service);
+    HandlerMemory memory;
+    const int rounds = 1000;
+
+    SECTION("timer waits and strand posts")
+    {
+        asio::basic_waitable_timer<std::chrono::steady_clock> timer(io_service);
+        int waits = 0, posts = 0;
+        std::function<void()> wait = [&] {
+            timer.expires_from_now(std::chrono::seconds(0));
+            timer.async_wait(strand.wrap(bind_memory(memory, [&](const asio::error_code &) {
+                strand.post(bind_memory(memory, [&] { ++posts; }));
+                if (++waits < rounds)
+                    wait();
+            })));
+        };
+        wait();
+        io_service.run();
+
+        REQUIRE(waits == rounds);
+        REQUIRE(posts == rounds);
+        REQUIRE(memory.allocations() >= 2 * rounds);
+        REQUIRE(memory.heap_allocations() == 0);
+    }
+
+    SECTION("composed reads and writes")
+    {
+        asio::local::stream_protocol::socket client(io_service), server(io_service);
+        asio::local::connect_pair(client, server);
+        std::string out(512, 'A'), in(512, '\0');
+        int echoed = 0;
+
+        std::function<void()> round = [&] {
+            asio::async_write(client, asio::buffer(out),
+                strand.wrap(bind_memory(memory, [&](const asio::error_code &ec, std::size_t) {
+                    REQUIRE(!ec);
+                })));
+            asio::async_read(server, asio::buffer(&in[0], in.size()),
+                strand.wrap(bind_memory(memory, [&](const asio::error_code &ec, std::size_t n) {
+                    REQUIRE(!ec);
+                    REQUIRE(n == out.size());
+                    if (++echoed < rounds)
+                        round();
+                })));
+        };
+        round();
+        io_service.run();
+
+        REQUIRE(echoed == rounds);
+        REQUIRE(in == out);
+        REQUIRE(memory.allocations() >= 2 * rounds);
+        REQUIRE(memory.heap_allocations() == 0);
+    }
+}
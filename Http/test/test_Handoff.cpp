@@ -0,0 +1,62 @@
+#include "catch.hpp"
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Handoff.h"
+
+using namespace Http;
+
+TEST_CASE("pass descriptors", "[Handoff]")
+{
+    int sockets[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+
+    SECTION("received descriptors refer to the same files")
+    {
+        int first[2], second[2];
+        REQUIRE(::pipe(first) == 0);
+        REQUIRE(::pipe(second) == 0);
+
+        REQUIRE(send_descriptors(sockets[0], {first[1], second[1]}));
+        auto fds = receive_descriptors(sockets[1]);
+        REQUIRE(fds.size() == 2);
+        REQUIRE(fds[0] != first[1]);
+
+        char c;
+        REQUIRE(::write(fds[0], "a", 1) == 1);
+        REQUIRE(::write(fds[1], "b", 1) == 1);
+        REQUIRE(::read(first[0], &c, 1) == 1);
+        REQUIRE(c == 'a');
+        REQUIRE(::read(second[0], &c, 1) == 1);
+        REQUIRE(c == 'b');
+
+        for (auto fd : {first[0], first[1], second[0], second[1], fds[0], fds[1]})
+            ::close(fd);
+    }
+
+    SECTION("nothing received once peer closed")
+    {
+        REQUIRE(!send_descriptors(sockets[0], {}));
+        ::close(sockets[0]);
+        sockets[0] = -1;
+        REQUIRE(receive_descriptors(sockets[1]).empty());
+    }
+
+    SECTION("peer runs as this user")
+    {
+        REQUIRE(peer_is_same_user(sockets[0]));
+        REQUIRE(peer_is_same_user(sockets[1]));
+        // not a Unix domain socket, no credentials
+        int pipe_fds[2];
+        REQUIRE(::pipe(pipe_fds) == 0);
+        REQUIRE(!peer_is_same_user(pipe_fds[0]));
+        ::close(pipe_fds[0]);
+        ::close(pipe_fds[1]);
+    }
+
+    for (auto fd : sockets)
+        if (fd >= 0)
+            ::close(fd);
+}
@@ -0,0 +1,199 @@
+#include "catch.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Hpack.h"
+#include "Http2.h"
+
+using namespace Http;
+
+namespace {
+
+auto bytes(const std::string &hex) -> std::vector<std::uint8_t> {
+    std::vector<std::uint8_t> out;
+    for (std::size_t i = 0; i + 1 < hex.size(); i += 2)
+        out.push_back(std::stoi(hex.substr(i, 2), nullptr, 16));
+    return out;
+}
+
+using Headers = std::vector<Message::HeaderType>;
+
+auto decode(HpackDecoder &decoder, const std::string &hex) -> Headers {
+    auto block = bytes(hex);
+    Headers headers;
+    REQUIRE(decoder.decode(block.data(), block.size(), headers));
+    return headers;
+}
+}
+
+TEST_CASE("Decode requests, RFC 7541 C.3 and C.4", "[Hpack]")
+{
+    Headers first{{":method", "GET"},
+                  {":scheme", "http"},
+                  {":path", "/"},
+                  {":authority", "www.example.com"}};
+    Headers second = first;
+    second.push_back({"cache-control", "no-cache"});
+    Headers third{{":method", "GET"},
+                  {":scheme", "https"},
+                  {":path", "/index.html"},
+                  {":authority", "www.example.com"},
+                  {"custom-key", "custom-value"}};
+
+    SECTION("Without Huffman coding")
+    {
+        HpackDecoder decoder;
+        REQUIRE(decode(decoder, "828684410f7777772e6578616d706c652e636f6d") == first);
+        REQUIRE(decode(decoder, "828684be58086e6f2d6361636865") == second);
+        REQUIRE(decode(decoder, "828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565") == third);
+    }
+
+    SECTION("With Huffman coding")
+    {
+        HpackDecoder decoder;
+        REQUIRE(decode(decoder, "828684418cf1e3c2e5f23a6ba0ab90f4ff") == first);
+        REQUIRE(decode(decoder, "828684be5886a8eb10649cbf") == second);
+        REQUIRE(decode(decoder, "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf") == third);
+    }
+
+    SECTION("Errors")
+    {
+        HpackDecoder decoder;
+        Headers headers;
+        // index beyond table
+        auto block = bytes("be");
+        REQUIRE(!decoder.decode(block.data(), block.size(), headers));
+        // size update above what the decoder allows
+        HpackDecoder small(256);
+        block = bytes("3fe11f");
+        REQUIRE(!small.decode(block.data(), block.size(), headers));
+        // string cut short
+        HpackDecoder truncated;
+        block = bytes("410f7777");
+        REQUIRE(!truncated.decode(block.data(), block.size(), headers));
+        REQUIRE(!truncated.too_large());
+    }
+
+    SECTION("Header list size")
+    {
+        // 42 + 43 + 38 + 57 bytes, as counted in the table
+        auto block = bytes("828684410f7777772e6578616d706c652e636f6d");
+        Headers headers;
+        HpackDecoder bounded(4096, 180);
+        REQUIRE(bounded.decode(block.data(), block.size(), headers));
+        REQUIRE(headers == first);
+        REQUIRE(!bounded.too_large());
+
+        HpackDecoder smaller(4096, 179);
+        REQUIRE(!smaller.decode(block.data(), block.size(), headers));
+        REQUIRE(smaller.too_large());
+    }
+}
+
+TEST_CASE("Encode, then decode", "[Hpack]")
+{
+    HpackEncoder encoder;
+    HpackDecoder decoder;
+    Headers headers{{":status", "200"},
+                    {"Content-Type", "application/json"},
+                    {"content-length", "1234"},
+                    {"x-custom", std::string(300, 'z')}};
+    Headers lower = headers;
+    lower[1].first = "content-type";
+
+    std::string first, second;
+    encoder.encode(headers, first);
+    encoder.encode(headers, second);
+    // indexed the second time round
+    REQUIRE(second.size() < first.size());
+
+    for (auto block : {first, second}) {
+        Headers decoded;
+        REQUIRE(decoder.decode(reinterpret_cast<const std::uint8_t *>(block.data()),
+                               block.size(), decoded));
+        REQUIRE(decoded == lower);
+    }
+
+    SECTION("Table size lowered by peer")
+    {
+        encoder.max_table_size(0);
+        std::string block;
+        encoder.encode(headers, block);
+        // starts with a size update to 0
+        REQUIRE(static_cast<std::uint8_t>(block[0]) == 0x20);
+        Headers decoded;
+        REQUIRE(decoder.decode(reinterpret_cast<const std::uint8_t *>(block.data()),
+                               block.size(), decoded));
+        REQUIRE(decoded == lower);
+    }
+}
+
+TEST_CASE("Header table", "[Hpack]")
+{
+    HpackTable table(100);
+    REQUIRE(table.at(2)->first == ":method");
+    REQUIRE(table.at(2)->second == "GET");
+    REQUIRE(table.at(62) == nullptr);
+
+    table.insert({"a", std::string(30, 'x')}); // 63 bytes
+    REQUIRE(table.size() == 63);
+    REQUIRE(table.at(62)->first == "a");
+
+    // evicts the older entry
+    table.insert({"b", "y"});
+    table.insert({"c", std::string(30, 'x')});
+    REQUIRE(table.size() == 34 + 63);
+    REQUIRE(table.at(62)->first == "c");
+    REQUIRE(table.at(63)->first == "b");
+    REQUIRE(table.at(64) == nullptr);
+
+    bool name_only = false;
+    REQUIRE(table.find({"b", "y"}, name_only) == 63);
+    REQUIRE(!name_only);
+    REQUIRE(table.find({"b", "z"}, name_only) == 63);
+    REQUIRE(name_only);
+    REQUIRE(table.find({":path", "/"}, name_only) == 4);
+    REQUIRE(!name_only);
+
+    // larger than the table, empties it
+    table.insert({"d", std::string(100, 'x')});
+    REQUIRE(table.size() == 0);
+    REQUIRE(table.at(62) == nullptr);
+}
+
+TEST_CASE("Huffman code", "[Hpack]")
+{
+    std::string encoded;
+    huffman_encode("www.example.com", encoded);
+    REQUIRE(encoded == std::string("\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff", 12));
+    REQUIRE(huffman_encoded_size("www.example.com") == 12);
+
+    std::string all;
+    for (int c = 0; c < 256; ++c)
+        all += static_cast<char>(c);
+    encoded.clear();
+    huffman_encode(all, encoded);
+    REQUIRE(encoded.size() == huffman_encoded_size(all));
+    std::string decoded;
+    REQUIRE(huffman_decode(reinterpret_cast<const std::uint8_t *>(encoded.data()),
+                           encoded.size(), decoded));
+    REQUIRE(decoded == all);
+
+    // padding longer than 7 bits, or not of ones
+    decoded.clear();
+    auto padded = bytes("f1e3c2e5f23a6ba0ab90f4ffff");
+    REQUIRE(!huffman_decode(padded.data(), padded.size(), decoded));
+    auto zeros = bytes("f1e3c2e5f23a6ba0ab90f400");
+    REQUIRE(!huffman_decode(zeros.data(), zeros.size(), decoded));
+}
+
+TEST_CASE("Client preface", "[Hpack]")
+{
+    std::string preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+    REQUIRE(preface.size() == http2_preface_size);
+    REQUIRE(http2_preface(preface.data(), preface.size()));
+    REQUIRE(http2_preface(preface.data(), 5));
+    REQUIRE(!http2_preface("GET / HTTP/1.1\r\n", 16));
+    REQUIRE(!http2_preface("PRI * HTTP/1.1", 14));
+}
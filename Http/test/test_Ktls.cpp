@@ -0,0 +1,285 @@
+#include "catch.hpp"
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "Ktls.h"
+
+using namespace Http;
+
+namespace {
+
+auto make_context(int version, const std::string &ciphers) -> SSL_CTX * {
+    auto pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    EVP_PKEY *pkey = nullptr;
+    EVP_PKEY_keygen_init(pctx);
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(pctx, &pkey);
+    EVP_PKEY_CTX_free(pctx);
+
+    auto cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, pkey);
+    X509_sign(cert, pkey, EVP_sha256());
+
+    auto ctx = SSL_CTX_new(TLS_method());
+    SSL_CTX_use_certificate(ctx, cert);
+    SSL_CTX_use_PrivateKey(ctx, pkey);
+    SSL_CTX_set_min_proto_version(ctx, version);
+    SSL_CTX_set_max_proto_version(ctx, version);
+    if (version == TLS1_3_VERSION)
+        SSL_CTX_set_ciphersuites(ctx, ciphers.c_str());
+    else
+        SSL_CTX_set_cipher_list(ctx, ciphers.c_str());
+    X509_free(cert);
+    EVP_PKEY_free(pkey);
+    return ctx;
+}
+
+void shuttle(BIO *from, BIO *to) {
+    char buf[4096];
+    int n;
+    while ((n = BIO_read(from, buf, sizeof(buf))) > 0)
+        BIO_write(to, buf, n);
+}
+
+/**
+ * @brief   Handshakes in memory, server marked for kTLS
+ */
+void handshake(SSL *server, SSL *client) {
+    ktls_session(server);
+
+    auto server_in = BIO_new(BIO_s_mem()), server_out = BIO_new(BIO_s_mem());
+    auto client_in = BIO_new(BIO_s_mem()), client_out = BIO_new(BIO_s_mem());
+    SSL_set_bio(server, server_in, server_out);
+    SSL_set_bio(client, client_in, client_out);
+    SSL_set_accept_state(server);
+    SSL_set_connect_state(client);
+
+    int server_done = 0, client_done = 0;
+    for (int i = 0; i < 10 && (server_done != 1 || client_done != 1); ++i) {
+        client_done = SSL_do_handshake(client);
+        shuttle(client_out, server_in);
+        server_done = SSL_do_handshake(server);
+        shuttle(server_out, client_in);
+    }
+    REQUIRE(server_done == 1);
+    REQUIRE(client_done == 1);
+}
+
+/**
+ * @brief   Encrypts one application data record as kernel would, from keys
+ */
+auto seal(const KtlsKeys &keys, std::uint64_t seq, const std::string &plaintext)
+    -> std::string {
+    bool tls13 = keys.version_ == TLS1_3_VERSION;
+    bool chacha = keys.salt_.empty();
+
+    std::vector<unsigned char> seq_bytes;
+    for (int i = 7; i >= 0; --i)
+        seq_bytes.push_back(static_cast<unsigned char>(seq >> (8 * i)));
+
+    std::vector<unsigned char> nonce(keys.salt_);
+    if (tls13 || chacha) {
+        nonce.insert(nonce.end(), keys.iv_.begin(), keys.iv_.end());
+        for (int i = 0; i < 8; ++i)
+            nonce[4 + i] ^= seq_bytes[i];
+    } else {
+        nonce.insert(nonce.end(), seq_bytes.begin(), seq_bytes.end());
+    }
+
+    std::string inner = plaintext;
+    if (tls13)
+        inner.push_back(23); // application_data
+    std::string explicit_nonce = (tls13 || chacha) ? "" :
+        std::string(seq_bytes.begin(), seq_bytes.end());
+    auto length = explicit_nonce.size() + inner.size() + 16;
+    std::string header{23, 3, 3, static_cast<char>(length >> 8),
+                       static_cast<char>(length)};
+
+    std::string aad;
+    if (tls13) {
+        aad = header;
+    } else {
+        aad.assign(seq_bytes.begin(), seq_bytes.end());
+        aad += std::string{23, 3, 3, static_cast<char>(inner.size() >> 8),
+                           static_cast<char>(inner.size())};
+    }
+
+    auto cipher = chacha ? EVP_chacha20_poly1305() :
+        keys.key_.size() == 16 ? EVP_aes_128_gcm() : EVP_aes_256_gcm();
+    std::string sealed(inner.size() + 16, '\0');
+    auto out = reinterpret_cast<unsigned char *>(&sealed[0]);
+    int n;
+    auto ctx = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex(ctx, cipher, nullptr, keys.key_.data(), nonce.data());
+    EVP_EncryptUpdate(ctx, nullptr, &n,
+                      reinterpret_cast<const unsigned char *>(aad.data()), aad.size());
+    EVP_EncryptUpdate(ctx, out, &n,
+                      reinterpret_cast<const unsigned char *>(inner.data()), inner.size());
+    EVP_EncryptFinal_ex(ctx, out + n, &n);
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, 16, out + inner.size());
+    EVP_CIPHER_CTX_free(ctx);
+
+    return header + explicit_nonce + sealed;
+}
+
+/**
+ * @brief   Has client send what server would answer with a record of its
+ *          own, checks that the guarded socket is shut down for it
+ */
+template <typename Provoke>
+void check_guard(int version, const std::string &ciphers, Provoke provoke) {
+    auto ctx = make_context(version, ciphers);
+    auto client_ctx = make_context(version, ciphers);
+    ktls_context(ctx);
+    auto server = SSL_new(ctx);
+    auto client = SSL_new(client_ctx);
+    handshake(server, client);
+
+    int sockets[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    ktls_guard(server, sockets[0]);
+
+    // reading application data alone writes nothing
+    char buf[64];
+    REQUIRE(SSL_write(client, "data", 4) == 4);
+    shuttle(SSL_get_wbio(client), SSL_get_rbio(server));
+    REQUIRE(SSL_read(server, buf, sizeof(buf)) == 4);
+    REQUIRE(::send(sockets[0], "a", 1, MSG_NOSIGNAL) == 1);
+    REQUIRE(::read(sockets[1], buf, sizeof(buf)) == 1);
+
+    provoke(client);
+    shuttle(SSL_get_wbio(client), SSL_get_rbio(server));
+    SSL_read(server, buf, sizeof(buf));
+    REQUIRE(::send(sockets[0], "a", 1, MSG_NOSIGNAL) == -1);
+    REQUIRE(::read(sockets[1], buf, sizeof(buf)) == 0);
+
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+    SSL_free(client);
+    SSL_free(server);
+    SSL_CTX_free(client_ctx);
+    SSL_CTX_free(ctx);
+}
+
+/**
+ * @brief   Handshakes in memory, then checks client reads records sealed
+ *          with keys derived for server
+ */
+void check_keys(int version, const std::string &ciphers) {
+    auto ctx = make_context(version, ciphers);
+    ktls_context(ctx);
+    auto server = SSL_new(ctx);
+    auto client = SSL_new(ctx);
+    handshake(server, client);
+    auto client_in = SSL_get_rbio(client);
+
+    KtlsKeys keys;
+    REQUIRE(ktls_keys(server, keys));
+    REQUIRE(keys.version_ == version);
+
+    for (auto text : {"first record", "second record"}) {
+        auto record = seal(keys, keys.seq_++, text);
+        BIO_write(client_in, record.data(), record.size());
+
+        char buf[64];
+        int n = SSL_read(client, buf, sizeof(buf));
+        REQUIRE(n > 0);
+        REQUIRE(std::string(buf, n) == text);
+    }
+
+    SSL_free(client);
+    SSL_free(server);
+    SSL_CTX_free(ctx);
+}
+}
+
+TEST_CASE("Keys for kernel TLS", "[Ktls]")
+{
+    SECTION("TLS 1.2 AES-128-GCM")
+    {
+        check_keys(TLS1_2_VERSION, "ECDHE-ECDSA-AES128-GCM-SHA256");
+    }
+
+    SECTION("TLS 1.2 AES-256-GCM")
+    {
+        check_keys(TLS1_2_VERSION, "ECDHE-ECDSA-AES256-GCM-SHA384");
+    }
+
+    SECTION("TLS 1.2 ChaCha20-Poly1305")
+    {
+        check_keys(TLS1_2_VERSION, "ECDHE-ECDSA-CHACHA20-POLY1305");
+    }
+
+    SECTION("TLS 1.3 AES-128-GCM, after session tickets")
+    {
+        check_keys(TLS1_3_VERSION, "TLS_AES_128_GCM_SHA256");
+    }
+
+    SECTION("TLS 1.3 AES-256-GCM")
+    {
+        check_keys(TLS1_3_VERSION, "TLS_AES_256_GCM_SHA384");
+    }
+
+    SECTION("TLS 1.3 ChaCha20-Poly1305")
+    {
+        check_keys(TLS1_3_VERSION, "TLS_CHACHA20_POLY1305_SHA256");
+    }
+}
+
+TEST_CASE("Records written by OpenSSL under kernel TLS", "[Ktls]")
+{
+    SECTION("TLS 1.3 KeyUpdate requesting ours")
+    {
+        check_guard(TLS1_3_VERSION, "TLS_AES_128_GCM_SHA256", [](SSL *client) {
+            REQUIRE(SSL_key_update(client, SSL_KEY_UPDATE_REQUESTED) == 1);
+            REQUIRE(SSL_do_handshake(client) == 1);
+        });
+    }
+
+    SECTION("TLS 1.2 renegotiation refused with an alert")
+    {
+        check_guard(TLS1_2_VERSION, "ECDHE-ECDSA-AES128-GCM-SHA256",
+                    [](SSL *client) {
+            REQUIRE(SSL_renegotiate(client) == 1);
+            SSL_do_handshake(client);
+        });
+    }
+}
+
+TEST_CASE("Kernel TLS unavailable", "[Ktls]")
+{
+    auto ctx = SSL_CTX_new(TLS_method());
+    auto ssl = SSL_new(ctx);
+
+    SECTION("no keys for unmarked or unfinished sessions")
+    {
+        KtlsKeys keys;
+        REQUIRE(!ktls_keys(ssl, keys));
+        ktls_session(ssl);
+        REQUIRE(!ktls_keys(ssl, keys));
+    }
+
+    SECTION("socket left as is")
+    {
+        int sockets[2];
+        REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+        ktls_session(ssl);
+        REQUIRE(!ktls_start_tx(ssl, sockets[0]));
+        REQUIRE(::write(sockets[0], "a", 1) == 1);
+        ::close(sockets[0]);
+        ::close(sockets[1]);
+    }
+
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+}
@@ -123,4 +123,132 @@ TEST_CASE("Method", "[RequestParser]")
         REQUIRE(req.method_ == RequestMethod::CONNECT);
         REQUIRE(req.version_minor_ == 0);
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Keep-alive", "[RequestParser]")
+{
+    RequestParser parser;
+    Request req;
+    std::string payload;
+
+    SECTION("version defaults")
+    {
+        payload = "GET /hi HTTP/1.1\r\n\r\n";
+        parser.parse(req, std::begin(payload), std::end(payload));
+        REQUIRE(req.keep_alive());
+
+        req.version_minor_ = 0;
+        REQUIRE_FALSE(req.keep_alive());
+    }
+    SECTION("connection header overrides default")
+    {
+        payload = "GET /hi HTTP/1.1\r\n"
+                  "connection: Close\r\n"
+                  "\r\n";
+        parser.parse(req, std::begin(payload), std::end(payload));
+        REQUIRE_FALSE(req.keep_alive());
+
+        req.headers_ = {{"Connection", "Keep-Alive"}};
+        req.version_minor_ = 0;
+        REQUIRE(req.keep_alive());
+    }
+    SECTION("body")
+    {
+        REQUIRE_FALSE(req.has_body());
+        req.headers_ = {{"Content-Length", "0"}};
+        REQUIRE_FALSE(req.has_body());
+        req.headers_ = {{"Content-Length", "12"}};
+        REQUIRE(req.has_body());
+    }
+    SECTION("reset for next request")
+    {
+        payload = "GET /hi?a=b HTTP/1.0\r\n"
+                  "Host: 127.0.0.1\r\n"
+                  "\r\n";
+        parser.parse(req, std::begin(payload), std::end(payload));
+
+        parser.reset();
+        req.clear();
+        REQUIRE(parser.state_ == RequestParser::State::req_start);
+        REQUIRE(req.method_ == RequestMethod::UNDETERMINED);
+        REQUIRE(req.uri_.state_ == UriState::uri_start);
+        REQUIRE(req.headers_.size() == 0);
+
+        payload = "POST /bye HTTP/1.1\r\n\r\n";
+        auto result = parser.parse(req, std::begin(payload), std::end(payload));
+        REQUIRE(std::get<1>(result) == ParseStatus::accept);
+        REQUIRE(req.method_ == RequestMethod::POST);
+        REQUIRE(req.uri_.abs_path_ == "/bye");
+        REQUIRE(req.uri_.query_ == "");
+        REQUIRE(req.version_minor_ == 1);
+    }
+}
+TEST_CASE("Byte ranges", "[RequestParser]")
+{
+    Request req;
+    auto ranges = [&req](std::string value, std::uint64_t size) {
+        req.headers_ = {{"Range", value}};
+        return req.byte_ranges(size);
+    };
+
+    SECTION("closed, open-ended and suffix ranges, ends inclusive")
+    {
+        auto r = ranges("bytes=0-9, 20-,-5", 100);
+        REQUIRE(r.size() == 2);
+        REQUIRE(r[0].first_ == 0);
+        REQUIRE(r[0].last_ == 9);
+        REQUIRE(r[0].length() == 10);
+        REQUIRE(r[1].first_ == 20);
+        REQUIRE(r[1].last_ == 99);
+    }
+    SECTION("sorted, overlapping and adjacent ranges merged")
+    {
+        auto r = ranges("bytes=50-59,0-4,5-9,8-12,30-40", 100);
+        REQUIRE(r.size() == 3);
+        REQUIRE(r[0].first_ == 0);
+        REQUIRE(r[0].last_ == 12);
+        REQUIRE(r[1].first_ == 30);
+        REQUIRE(r[2].last_ == 59);
+    }
+    SECTION("more than max_ranges coalesced into one")
+    {
+        std::string many = "bytes=0-0";
+        for (int i = 1; i < 100; ++i)
+            many += "," + std::to_string(2 * i) + "-" + std::to_string(2 * i);
+        req.headers_ = {{"Range", many}};
+        REQUIRE(req.byte_ranges(1000).size() == 100);
+        REQUIRE(req.byte_ranges(1000, 100).size() == 100);
+        auto r = req.byte_ranges(1000, 99);
+        REQUIRE(r.size() == 1);
+        REQUIRE(r[0].first_ == 0);
+        REQUIRE(r[0].last_ == 198);
+    }
+    SECTION("64-bit offsets, ends clamped to size")
+    {
+        std::uint64_t size = 6000000000ULL;
+        auto r = ranges("bytes=5000000000-99999999999999999999999", size);
+        REQUIRE(r.size() == 1);
+        REQUIRE(r[0].first_ == 5000000000ULL);
+        REQUIRE(r[0].last_ == size - 1);
+
+        r = ranges("bytes=-7000000000", size);
+        REQUIRE(r[0].first_ == 0);
+    }
+    SECTION("unsatisfiable ranges dropped")
+    {
+        REQUIRE(ranges("bytes=100-200", 100).empty());
+        REQUIRE(ranges("bytes=-0", 100).empty());
+        REQUIRE(ranges("bytes=-10", 0).empty());
+        REQUIRE(ranges("bytes=100-,0-0", 100).size() == 1);
+    }
+    SECTION("malformed")
+    {
+        REQUIRE_THROWS_AS(ranges("bytes=9-0", 100), std::invalid_argument);
+        REQUIRE_THROWS_AS(ranges("bytes=a-b", 100), std::invalid_argument);
+        REQUIRE_THROWS_AS(ranges("bytes=5", 100), std::invalid_argument);
+        REQUIRE_THROWS_AS(ranges("bytes=-", 100), std::invalid_argument);
+        REQUIRE_THROWS_AS(ranges("bytes= , ", 100), std::invalid_argument);
+        REQUIRE_THROWS_AS(ranges("lines=0-9", 100), std::invalid_argument);
+        req.headers_.clear();
+        REQUIRE_THROWS_AS(req.byte_ranges(100), std::invalid_argument);
+    }
+}
@@ -2,6 +2,7 @@
 #include <algorithm>
 #include <map>
 #include <string>
+#include <unistd.h>
 #include "catch.hpp"
 
 #include "Response.h"
@@ -27,3 +28,112 @@ TEST_CASE("Enum StatusCode", "[Response]")
         REQUIRE(Bad_Request == "Bad Request");
     }
 }
+
+TEST_CASE("Serialize", "[Response]")
+{
+    Response res;
+    res.write_text("hello world");
+
+    SECTION("buffers match payload, body not copied")
+    {
+        auto buffers = res.to_buffers();
+        REQUIRE(buffers.size() == 2);
+        REQUIRE(asio::buffer_cast<const char *>(buffers[1]) == res.body_.data());
+
+        std::string gathered;
+        for (auto &buffer : buffers)
+            gathered.append(asio::buffer_cast<const char *>(buffer),
+                            asio::buffer_size(buffer));
+        REQUIRE(gathered == res.to_payload());
+    }
+
+    SECTION("empty body")
+    {
+        res.clear_body();
+        auto buffers = res.to_buffers();
+        REQUIRE(buffers.size() == 1);
+        REQUIRE(asio::buffer_size(buffers[0]) == res.to_payload().size());
+    }
+}
+
+TEST_CASE("File range", "[Response]")
+{
+    char path[] = "/tmp/test_ResponseXXXXXX";
+    int fd = ::mkstemp(path);
+    REQUIRE(fd >= 0);
+    REQUIRE(::write(fd, "0123456789", 10) == 10);
+    ::close(fd);
+
+    Response res;
+
+    SECTION("headers describe range, file left out of buffers")
+    {
+        REQUIRE(res.write_file_ranges(path, {{2, 5}}));
+        REQUIRE(res.status_code() == StatusCode::Partial_Content);
+        REQUIRE(res.get_header("Content-Range").first == "bytes 2-5/10");
+        REQUIRE(res.content_length() == 4);
+        REQUIRE(res.file_);
+        REQUIRE(res.file_.offset_ == 2);
+        REQUIRE(res.file_.length_ == 4);
+        REQUIRE(res.to_buffers().size() == 1);
+
+        res.clear();
+        REQUIRE(!res.file_);
+    }
+
+    SECTION("missing file")
+    {
+        REQUIRE(!res.write_file_ranges(std::string(path) + ".missing", {{0, 0}}));
+        REQUIRE(!res.file_);
+    }
+
+    SECTION("one of byte ranges")
+    {
+        REQUIRE(res.write_file_ranges(path, {{2, 5}}));
+        REQUIRE(res.status_code() == StatusCode::Partial_Content);
+        REQUIRE(res.get_header("Content-Range").first == "bytes 2-5/10");
+        REQUIRE(res.get_header("Content-Length").first == "4");
+        REQUIRE(res.file_.offset_ == 2);
+        REQUIRE(res.file_.length_ == 4);
+        REQUIRE(res.file_.parts_.empty());
+    }
+
+    SECTION("byte ranges as multipart/byteranges parts")
+    {
+        REQUIRE(res.write_file_ranges(path, {{0, 1}, {4, 4}, {8, 9}}, "text/plain"));
+        auto content_type = res.get_header("Content-Type").first;
+        auto prefix = std::string("multipart/byteranges; boundary=");
+        REQUIRE(content_type.substr(0, prefix.size()) == prefix);
+        auto boundary = content_type.substr(prefix.size());
+
+        // body as the connection sends it
+        std::string body = res.body_;
+        auto send = [&body](std::size_t offset, std::size_t length) {
+            body += std::string("0123456789").substr(offset, length);
+        };
+        send(res.file_.offset_, res.file_.length_);
+        for (auto &part : res.file_.parts_) {
+            body += part.prefix_;
+            send(part.offset_, part.length_);
+        }
+        body += res.file_.suffix_;
+
+        REQUIRE(body ==
+                "--" + boundary + "\r\n"
+                "Content-Type: text/plain\r\n"
+                "Content-Range: bytes 0-1/10\r\n\r\n"
+                "01\r\n"
+                "--" + boundary + "\r\n"
+                "Content-Type: text/plain\r\n"
+                "Content-Range: bytes 4-4/10\r\n\r\n"
+                "4\r\n"
+                "--" + boundary + "\r\n"
+                "Content-Type: text/plain\r\n"
+                "Content-Range: bytes 8-9/10\r\n\r\n"
+                "89\r\n"
+                "--" + boundary + "--\r\n");
+        REQUIRE(res.get_header("Content-Length").first == std::to_string(body.size()));
+    }
+
+    ::unlink(path);
+}
@@ -1,10 +1,18 @@
 #include "catch.hpp"
+#include "asio.hpp"
+#include <array>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
 #include <utility>
 #include <stdexcept>
 
 #include "Trie.h"
 #include "Router.h"
 #include "Constants.h"
+#include "ConnectionPool.h"
+#include "ThreadPool.h"
 
 using namespace Http;
 
@@ -70,6 +78,36 @@ TEST_CASE("handle, resolves", "[Router]")
             REQUIRE(handles.size() == 0);
         }
 
+        SECTION("blocking handlers")
+        {
+            r.handle(RequestMethod::GET, "/home/slow", Handler([](Context &ctx) {
+                         std::cout << "Handler: GET/home/slow" << std::endl;
+                     }).blocking());
+
+            auto handles = r.resolve(RequestMethod::GET, "/home/slow");
+            REQUIRE(handles.size() == 2);
+            REQUIRE(!handles.front().blocking_);
+            REQUIRE(handles.back().blocking_);
+        }
+
+        SECTION("max in flight")
+        {
+            r.handle(RequestMethod::GET, "/home/big", Handler([](Context &ctx) {
+                         std::cout << "Handler: GET/home/big" << std::endl;
+                     }).max_in_flight(2));
+
+            auto handles = r.resolve(RequestMethod::GET, "/home/big");
+            REQUIRE(handles.size() == 2);
+            REQUIRE(handles.front().max_in_flight_ == 0);
+            REQUIRE(handles.back().max_in_flight_ == 2);
+
+            // copies, e.g. in each shard's router, share one count
+            Router<Handler> copy(r);
+            auto copied = copy.resolve(RequestMethod::GET, "/home/big");
+            ++*handles.back().in_flight_;
+            REQUIRE(*copied.back().in_flight_ == 1);
+        }
+
         SECTION("resolve url with parameter")
         {
             r.handle(RequestMethod::GET, "/home/<id>", Handler([](Context &ctx) {
@@ -87,4 +125,228 @@ TEST_CASE("handle, resolves", "[Router]")
             REQUIRE(req.param_["id"] == "102938");
         }
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Context defer", "[Router]")
+{
+    Response res;
+    Request req;
+    Context ctx(req, res);
+
+    SECTION("without owner, completion is a no-op")
+    {
+        auto done = ctx.defer();
+        REQUIRE(done);
+        REQUIRE_NOTHROW(done());
+    }
+
+    SECTION("completion is made by owner")
+    {
+        int completed = 0;
+        ctx.make_completion_ = [&completed] {
+            return [&completed] { ++completed; };
+        };
+
+        auto done = ctx.defer();
+        REQUIRE(completed == 0);
+        done();
+        REQUIRE(completed == 1);
+    }
+}
+
+TEST_CASE("Context stream", "[Router]")
+{
+    Response res;
+    Request req;
+    Context ctx(req, res);
+
+    SECTION("without owner, chunks are buffered into body")
+    {
+        res.write_text("head ");
+        auto stream = ctx.stream();
+        std::size_t written = 0;
+        stream->write("first ", [&written](std::error_code ec, std::size_t n) {
+            REQUIRE(!ec);
+            written += n;
+        });
+        stream->write("second");
+        stream->trailer({"Checksum", "abc"});
+
+        REQUIRE(written == 6);
+        REQUIRE(res.body_ == "head first second");
+        REQUIRE(res.get_header("Checksum").first == "abc");
+    }
+
+    SECTION("without owner, always writable")
+    {
+        auto stream = ctx.stream();
+        int resumed = 0;
+        stream->when_writable([&resumed] { ++resumed; });
+        REQUIRE(resumed == 1);
+        stream->wait_writable();
+    }
+}
+
+TEST_CASE("Stream send window", "[Router]")
+{
+    asio::io_service io_service;
+    asio::io_service::work work(io_service);
+    Router<Handler> router;
+    ThreadPool blocking_executor(1);
+    ConnectionOptions options;
+    options.send_window = 1 << 20;
+    options.min_send_rate = 0;
+    options.write_timeout = std::chrono::milliseconds(500);
+    AdmissionControl admission;
+    admission.prepare(options);
+    auto &pool = asio::use_service<ConnectionPool<TcpSocket>>(io_service);
+
+    Context::StreamPtr stream;
+    Context::Completion done;
+    router.get("/body", Handler([&](Context &ctx) {
+                   stream = ctx.stream();
+                   done = ctx.defer();
+               }));
+
+    // runs the event loop until ready, or for timeout at most
+    auto run_until = [&](std::function<bool()> ready,
+                         std::chrono::milliseconds timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!ready() && std::chrono::steady_clock::now() < deadline) {
+            io_service.poll();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return ready();
+    };
+
+    // client reads only when asked, small buffers on both ends keep
+    // unsent bytes in the connection rather than in the kernel
+    asio::ip::tcp::acceptor acceptor(
+        io_service, {asio::ip::address::from_string("127.0.0.1"), 0});
+    asio::ip::tcp::socket client(io_service);
+    client.open(asio::ip::tcp::v4());
+    client.set_option(asio::socket_base::receive_buffer_size(4096));
+    client.connect(acceptor.local_endpoint());
+    {
+        auto connection = pool.acquire(io_service, router, blocking_executor,
+                                       options, admission);
+        acceptor.accept(connection->socket_);
+        connection->socket_.set_option(asio::socket_base::send_buffer_size(4096));
+        connection->start();
+    }
+    asio::write(client, asio::buffer(std::string("GET /body HTTP/1.1\r\n"
+                                                 "Host: 127.0.0.1\r\n\r\n")));
+    client.non_blocking(true);
+    std::string received;
+    auto read_available = [&] {
+        std::array<char, 65536> buf;
+        asio::error_code ec;
+        auto n = client.read_some(asio::buffer(buf), ec);
+        received.append(buf.data(), n);
+    };
+
+    REQUIRE(run_until([&] { return bool(stream); }, std::chrono::seconds(1)));
+    std::string chunk(options.send_window, 'a');
+
+    SECTION("producer parks while send_window is full, resumes once written")
+    {
+        int resumed = 0;
+        stream->write(chunk);
+        stream->when_writable([&resumed] { ++resumed; });
+        run_until([] { return false; }, std::chrono::milliseconds(100));
+        REQUIRE(resumed == 0);
+        REQUIRE(admission.unsent_bytes_ == chunk.size());
+
+        REQUIRE(run_until([&] { read_available(); return resumed == 1; },
+                          std::chrono::seconds(5)));
+        done();
+        REQUIRE(run_until([&] {
+                    read_available();
+                    return received.find("\r\n0\r\n\r\n") != std::string::npos;
+                }, std::chrono::seconds(5)));
+        REQUIRE(admission.unsent_bytes_ == 0);
+    }
+
+    SECTION("stalled reader is closed below min_send_rate")
+    {
+        options.min_send_rate = 1024;
+        bool aborted = false;
+        auto start = std::chrono::steady_clock::now();
+        stream->write(chunk, [&aborted](std::error_code ec, std::size_t) {
+            aborted = bool(ec);
+        });
+        REQUIRE(run_until([&] { return aborted; }, std::chrono::seconds(5)));
+        REQUIRE(std::chrono::steady_clock::now() - start >= options.write_timeout);
+        REQUIRE(admission.unsent_bytes_ == 0);
+        done();
+    }
+
+    SECTION("reader keeping min_send_rate is not closed, however large the window")
+    {
+        // a write of send_window would take 25s at this pace
+        options.min_send_rate = 16 * 1024;
+        bool aborted = false;
+        stream->write(chunk, [&aborted](std::error_code ec, std::size_t) {
+            aborted = bool(ec);
+        });
+        auto next_read = std::chrono::steady_clock::now();
+        run_until([&] {
+            if (std::chrono::steady_clock::now() >= next_read) {
+                std::array<char, 2048> buf;
+                asio::error_code ec;
+                received.append(buf.data(), client.read_some(asio::buffer(buf), ec));
+                next_read += std::chrono::milliseconds(50);
+            }
+            return aborted;
+        }, std::chrono::milliseconds(1500));
+        REQUIRE(!aborted);
+        REQUIRE(received.size() > 32 * 1024);
+        done();
+    }
+
+    // released, the connection is recycled into the pool
+    stream.reset();
+    done = nullptr;
+    client.close();
+    REQUIRE(run_until([&] { return pool.size() == 1; }, std::chrono::seconds(5)));
+    REQUIRE(admission.unsent_bytes_ == 0);
+}
+
+TEST_CASE("Body within send_window goes out in one write", "[Router]")
+{
+    asio::io_service io_service;
+    Router<Handler> router;
+    ThreadPool blocking_executor(1);
+    ConnectionOptions options; // defaults, min_send_rate included
+    AdmissionControl admission;
+    admission.prepare(options);
+    auto &pool = asio::use_service<ConnectionPool<TcpSocket>>(io_service);
+
+    std::string body(options.send_window - 4096, 'a');
+    router.get("/body", Handler([&body](Context &ctx) { ctx.res_.write_text(body); }));
+
+    asio::ip::tcp::acceptor acceptor(
+        io_service, {asio::ip::address::from_string("127.0.0.1"), 0});
+    asio::ip::tcp::socket client(io_service);
+    client.connect(acceptor.local_endpoint());
+    auto connection = pool.acquire(io_service, router, blocking_executor,
+                                   options, admission);
+    acceptor.accept(connection->socket_);
+    connection->start();
+    asio::write(client, asio::buffer(std::string("GET /body HTTP/1.1\r\n"
+                                                 "Host: 127.0.0.1\r\n"
+                                                 "Connection: close\r\n\r\n")));
+
+    std::string received;
+    client.non_blocking(true);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    asio::error_code ec;
+    while (ec != asio::error::eof && std::chrono::steady_clock::now() < deadline) {
+        io_service.poll();
+        std::array<char, 65536> buf;
+        ec.clear();
+        received.append(buf.data(), client.read_some(asio::buffer(buf), ec));
+    }
+    REQUIRE(received.size() > body.size());
+    REQUIRE(received.compare(received.size() - body.size(), body.size(), body) == 0);
+    REQUIRE(connection->write_count() == 1);
+}
@@ -1,9 +1,18 @@
 #include "catch.hpp"
 #include "asio.hpp"
+#include "asio/ssl.hpp"
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 #include <utility>
 #include <stdexcept>
 
 #include "Constants.h"
+#include "Http2.h"
 #include "Server.h"
 
 using namespace std;
@@ -63,4 +72,306 @@ TEST_CASE("Construct routes", "[Server]")
 
         // app->run();
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Admission control", "[Server]")
+{
+    ConnectionOptions options;
+    options.retry_after = std::chrono::seconds(7);
+
+    AdmissionControl admission;
+    admission.prepare(options);
+
+    auto overloaded = admission.overloaded_.to_payload();
+    REQUIRE(overloaded.find("HTTP/1.1 503") == 0);
+    REQUIRE(overloaded.find("Retry-After: 7\r\n") != string::npos);
+    REQUIRE(overloaded.find("Content-Length: 0\r\n") != string::npos);
+    REQUIRE(overloaded.find("Connection: close\r\n") != string::npos);
+    REQUIRE(admission.open_connections_ == 0);
+
+    // serialized once, sent as is by every connection shed
+    REQUIRE(*admission.overloaded_payload_ == overloaded);
+    Response shed;
+    shed.write_payload(admission.overloaded_payload_);
+    auto buffers = shed.to_buffers();
+    REQUIRE(buffers.size() == 1);
+    REQUIRE(asio::buffer_cast<const char *>(buffers[0]) ==
+            admission.overloaded_payload_->data());
+    shed.clear();
+    REQUIRE(shed.to_payload().find("HTTP/1.1 200") == 0);
+}
+
+TEST_CASE("Listeners", "[Server]")
+{
+    HttpServer app(make_pair("127.0.0.1", 8888));
+
+    auto listeners = app.listeners();
+    REQUIRE(listeners.size() == 1);
+    REQUIRE(listeners[0].scheme_ == "http");
+    REQUIRE(listeners[0].port_ == 8888);
+}
+
+/**
+ * @brief   Status line of a GET / on stream, connected
+ */
+template <typename Stream>
+auto status_line(Stream &stream) -> string {
+    asio::write(stream, buffer(string("GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n")));
+    asio::streambuf response;
+    asio::read_until(stream, response, "\r\n");
+    string head(buffers_begin(response.data()), buffers_end(response.data()));
+    return head.substr(0, head.find("\r\n"));
+}
+
+TEST_CASE("HTTP and HTTPS listeners on one pool", "[Server]")
+{
+    // run from repository root, for Http/ssl
+    MultiServer app(make_pair("127.0.0.1", 9883));
+    app.add_listener("https", 9884);
+    app.thread_count(2);
+    app.router_.get("/", Handler([](Context &ctx) { ctx.res_.write_text("ok"); }));
+    std::thread server([&app] { app.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    // for the next run(), listeners served now are left as they are
+    app.add_listener("http", 9885);
+
+    io_service io;
+    ip::tcp::endpoint http(ip::address::from_string("127.0.0.1"), 9883);
+    ip::tcp::endpoint https(ip::address::from_string("127.0.0.1"), 9884);
+
+    ip::tcp::socket plain(io);
+    plain.connect(http);
+    REQUIRE(status_line(plain) == "HTTP/1.1 200 OK");
+
+    ssl::context context(ssl::context::sslv23);
+    ssl::stream<ip::tcp::socket> tls(io, context);
+    tls.lowest_layer().connect(https);
+    tls.handshake(ssl::stream_base::client);
+    REQUIRE(status_line(tls) == "HTTP/1.1 200 OK");
+
+    app.stop();
+    server.join();
+}
+
+TEST_CASE("Unix socket listener", "[Server]")
+{
+    std::string path = "/tmp/test_Server.sock";
+    std::string handoff = "/tmp/test_Server.handoff";
+    ::unlink(path.c_str());
+
+    SECTION("file other than a socket is left alone")
+    {
+        std::ofstream(path) << "data";
+        HttpServer app(make_pair("127.0.0.1", 9881));
+        app.unix_path(path);
+        REQUIRE_THROWS_AS(app.run(), std::runtime_error);
+
+        struct stat st;
+        REQUIRE(::stat(path.c_str(), &st) == 0);
+        REQUIRE(S_ISREG(st.st_mode));
+    }
+
+    SECTION("handed off on hot restart, never unbound")
+    {
+        auto serve = [&](HttpServer &app) {
+            app.unix_path(path);
+            app.handoff_path(handoff);
+            app.drain_timeout(std::chrono::seconds(1));
+            app.router_.get("/", Handler([](Context &ctx) { ctx.res_.write_text("ok"); }));
+            return std::thread([&app] { app.run(); });
+        };
+
+        HttpServer predecessor(make_pair("127.0.0.1", 9882));
+        auto first = serve(predecessor);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        struct stat before;
+        REQUIRE(::stat(path.c_str(), &before) == 0);
+
+        HttpServer successor(make_pair("127.0.0.1", 9882));
+        auto second = serve(successor);
+        first.join();
+
+        struct stat after;
+        REQUIRE(::stat(path.c_str(), &after) == 0);
+        REQUIRE(after.st_ino == before.st_ino);
+
+        io_service io;
+        local::stream_protocol::socket socket(io);
+        socket.connect(local::stream_protocol::endpoint(path));
+        asio::write(socket, buffer(string("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+        asio::streambuf response;
+        asio::read_until(socket, response, "\r\n\r\n");
+        string head(buffers_begin(response.data()), buffers_end(response.data()));
+        REQUIRE(head.find("HTTP/1.1 200") == 0);
+
+        successor.stop();
+        second.join();
+        ::unlink(handoff.c_str());
+    }
+
+    ::unlink(path.c_str());
+}
+
+TEST_CASE("TLS connections over max_connections", "[Server]")
+{
+    // run from repository root, for Http/ssl
+    HttpsServer app(make_pair("127.0.0.1", 9886));
+    app.connection_options_.max_connections = 1;
+    app.router_.get("/", Handler([](Context &ctx) { ctx.res_.write_text("ok"); }));
+
+    SECTION("sent 503 after the handshake")
+    {
+    }
+
+    SECTION("closed before the handshake, if so configured")
+    {
+        app.connection_options_.shed_tls_before_handshake = true;
+    }
+
+    std::thread server([&app] { app.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    io_service io;
+    ip::tcp::endpoint endpoint(ip::address::from_string("127.0.0.1"), 9886);
+    ssl::context context(ssl::context::sslv23);
+
+    ssl::stream<ip::tcp::socket> admitted(io, context);
+    admitted.lowest_layer().connect(endpoint);
+    admitted.handshake(ssl::stream_base::client);
+
+    ssl::stream<ip::tcp::socket> shed(io, context);
+    shed.lowest_layer().connect(endpoint);
+    asio::error_code ec;
+    shed.handshake(ssl::stream_base::client, ec);
+    if (app.connection_options_.shed_tls_before_handshake) {
+        REQUIRE(ec);
+    } else {
+        REQUIRE(!ec);
+        REQUIRE(status_line(shed) == "HTTP/1.1 503 Service Unavailable");
+    }
+    REQUIRE(app.admission_.shed_connections_ == 1);
+
+    REQUIRE(status_line(admitted) == "HTTP/1.1 200 OK");
+
+    app.stop();
+    server.join();
+}
+
+namespace {
+
+struct Frame {
+    std::uint8_t type = 0;
+    std::uint8_t flags = 0;
+    std::uint32_t id = 0;
+    string payload;
+};
+
+void write_frame(ip::tcp::socket &socket, std::uint8_t type,
+                 std::uint8_t flags, std::uint32_t id, const string &payload) {
+    string frame{char(payload.size() >> 16), char(payload.size() >> 8),
+                 char(payload.size()), char(type), char(flags),
+                 char(id >> 24), char(id >> 16), char(id >> 8), char(id)};
+    asio::write(socket, buffer(frame + payload));
+}
+
+auto read_frame(ip::tcp::socket &socket) -> Frame {
+    unsigned char header[9];
+    asio::read(socket, buffer(header));
+    Frame frame;
+    frame.type = header[3];
+    frame.flags = header[4];
+    frame.id = (std::uint32_t(header[5] & 0x7f) << 24) | (header[6] << 16) |
+               (header[7] << 8) | header[8];
+    frame.payload.resize((header[0] << 16) | (header[1] << 8) | header[2]);
+    if (!frame.payload.empty())
+        asio::read(socket, buffer(&frame.payload[0], frame.payload.size()));
+    return frame;
+}
+
+auto get_u32(const string &s, std::size_t pos) -> std::uint32_t {
+    return (std::uint32_t(std::uint8_t(s[pos])) << 24) |
+           (std::uint8_t(s[pos + 1]) << 16) | (std::uint8_t(s[pos + 2]) << 8) |
+           std::uint8_t(s[pos + 3]);
+}
+
+/**
+ * @brief   Frames from server up to the first of type, which is returned
+ */
+auto read_until_frame(ip::tcp::socket &socket, std::uint8_t type) -> Frame {
+    for (;;) {
+        auto frame = read_frame(socket);
+        if (frame.type == type)
+            return frame;
+    }
+}
+}
+
+TEST_CASE("HTTP/2 limits", "[Server]")
+{
+    using Session = Http2Session<TcpSocket>;
+    HttpServer app(make_pair("127.0.0.1", 9887));
+    app.connection_options_.read_timeout = std::chrono::milliseconds(200);
+    app.router_.get("/", Handler([](Context &ctx) { ctx.res_.write_text("ok"); }));
+    std::thread server([&app] { app.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    io_service io;
+    ip::tcp::socket socket(io);
+    socket.connect({ip::address::from_string("127.0.0.1"), 9887});
+    asio::write(socket, buffer(string("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n")));
+    write_frame(socket, 0x4, 0, 0, "");
+
+    // max_header_list_size is advertised
+    auto settings = read_until_frame(socket, 0x4);
+    bool advertised = false;
+    for (std::size_t pos = 0; pos + 6 <= settings.payload.size(); pos += 6)
+        if (settings.payload[pos + 1] == 0x6)
+            advertised = get_u32(settings.payload, pos + 2) ==
+                         Session::max_header_list_size;
+    REQUIRE(advertised);
+
+    // GET / of RFC 7541 C.3.1
+    string block("\x82\x86\x84\x41\x0f" "www.example.com");
+
+    SECTION("header block grown past max_header_list_size")
+    {
+        write_frame(socket, 0x1, 0, 1, block);
+        string fragment(16384, 'a');
+        for (std::size_t sent = block.size();
+             sent <= Session::max_header_list_size; sent += fragment.size())
+            write_frame(socket, 0x9, 0, 1, fragment);
+
+        auto goaway = read_until_frame(socket, 0x7);
+        REQUIRE(get_u32(goaway.payload, 4) ==
+                std::uint32_t(Session::ErrorCode::enhance_your_calm));
+    }
+
+    SECTION("stream awaiting its body past read_timeout")
+    {
+        auto start = std::chrono::steady_clock::now();
+        // END_HEADERS, no END_STREAM
+        write_frame(socket, 0x1, 0x4, 1, block);
+
+        auto reset = read_until_frame(socket, 0x3);
+        REQUIRE(reset.id == 1);
+        REQUIRE(get_u32(reset.payload, 0) ==
+                std::uint32_t(Session::ErrorCode::cancel));
+        REQUIRE(std::chrono::steady_clock::now() - start >=
+                std::chrono::milliseconds(200));
+        read_until_frame(socket, 0x7);
+    }
+
+    SECTION("complete request is not timed out")
+    {
+        // END_HEADERS, END_STREAM
+        write_frame(socket, 0x1, 0x5, 1, block);
+        auto data = read_until_frame(socket, 0x0);
+        REQUIRE(data.payload == "ok");
+        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+        write_frame(socket, 0x6, 0, 0, string(8, 'p'));
+        REQUIRE(read_until_frame(socket, 0x6).flags == 0x1);
+    }
+
+    app.stop();
+    server.join();
+}
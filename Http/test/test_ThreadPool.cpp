@@ -0,0 +1,68 @@
+#include "catch.hpp"
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "ThreadPool.h"
+
+using namespace Http;
+
+TEST_CASE("post tasks", "[ThreadPool]")
+{
+    std::atomic<int> count{0};
+
+    SECTION("runs all queued tasks before destruction")
+    {
+        {
+            ThreadPool pool(4);
+            REQUIRE(pool.thread_count() == 4);
+            for (int i = 0; i < 1000; ++i)
+                pool.post([&count] { ++count; });
+        }
+        REQUIRE(count == 1000);
+    }
+
+    SECTION("runs tasks off the calling thread")
+    {
+        std::mutex mutex;
+        std::set<std::thread::id> ids;
+        {
+            ThreadPool pool(2);
+            for (int i = 0; i < 100; ++i)
+                pool.post([&] {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ids.insert(std::this_thread::get_id());
+                });
+        }
+        REQUIRE(!ids.empty());
+        REQUIRE(ids.count(std::this_thread::get_id()) == 0);
+    }
+
+    SECTION("counts tasks not yet started")
+    {
+        std::mutex mutex;
+        {
+            ThreadPool pool(1);
+            std::unique_lock<std::mutex> hold(mutex);
+            pool.post([&] { std::lock_guard<std::mutex> lock(mutex); });
+            while (pool.queue_size() != 0)
+                std::this_thread::yield();
+
+            for (int i = 0; i < 10; ++i)
+                pool.post([&count] { ++count; });
+            REQUIRE(pool.queue_size() == 10);
+        }
+        REQUIRE(count == 10);
+    }
+
+    SECTION("survives a throwing task")
+    {
+        {
+            ThreadPool pool(1);
+            pool.post([] { throw std::runtime_error("task failed"); });
+            pool.post([&count] { ++count; });
+        }
+        REQUIRE(count == 1);
+    }
+}
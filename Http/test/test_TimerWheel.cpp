@@ -0,0 +1,118 @@
+#include "catch.hpp"
+#include "asio.hpp"
+#include <chrono>
+#include <vector>
+
+#include "TimerWheel.h"
+
+using namespace Http;
+using namespace std::chrono;
+
+TEST_CASE("arm and cancel", "[TimerWheel]")
+{
+    asio::io_service io;
+    auto &wheel = asio::use_service<TimerWheel>(io);
+    REQUIRE(wheel.size() == 0);
+
+    std::vector<int> fired;
+    TimerWheel::Timer a, b;
+    auto t0 = TimerWheel::ClockType::now();
+
+    SECTION("fires no earlier than deadline, in deadline order")
+    {
+        wheel.arm(a, milliseconds(200), [&] { fired.push_back(1); });
+        wheel.arm(b, milliseconds(100), [&] { fired.push_back(2); });
+        REQUIRE(wheel.size() == 2);
+
+        wheel.advance(t0 + milliseconds(100) - TimerWheel::tick);
+        REQUIRE(fired.empty());
+
+        wheel.advance(TimerWheel::ClockType::now() + milliseconds(200) +
+                      TimerWheel::tick);
+        REQUIRE(fired == std::vector<int>{2, 1});
+        REQUIRE(wheel.size() == 0);
+    }
+
+    SECTION("cancel drops callback")
+    {
+        wheel.arm(a, milliseconds(100), [&] { fired.push_back(1); });
+        wheel.cancel(a);
+        REQUIRE(wheel.size() == 0);
+        REQUIRE(a.expires_at() == TimerWheel::ClockType::time_point::max());
+
+        wheel.advance(TimerWheel::ClockType::now() + seconds(1));
+        REQUIRE(fired.empty());
+    }
+
+    SECTION("re-arm replaces deadline")
+    {
+        wheel.arm(a, milliseconds(100), [&] { fired.push_back(1); });
+        wheel.arm(a, seconds(10), [&] { fired.push_back(2); });
+        REQUIRE(wheel.size() == 1);
+
+        wheel.advance(t0 + seconds(5));
+        REQUIRE(fired.empty());
+        wheel.advance(TimerWheel::ClockType::now() + seconds(11));
+        REQUIRE(fired == std::vector<int>{2});
+    }
+
+    SECTION("destroyed timer is cancelled")
+    {
+        {
+            TimerWheel::Timer c;
+            wheel.arm(c, milliseconds(100), [&] { fired.push_back(1); });
+            REQUIRE(wheel.size() == 1);
+        }
+        REQUIRE(wheel.size() == 0);
+    }
+
+    SECTION("deadlines on upper levels cascade")
+    {
+        wheel.arm(a, minutes(3), [&] { fired.push_back(1); });
+        wheel.arm(b, hours(2), [&] { fired.push_back(2); });
+
+        wheel.advance(t0 + minutes(3) - TimerWheel::tick);
+        REQUIRE(fired.empty());
+        wheel.advance(TimerWheel::ClockType::now() + minutes(3) +
+                      TimerWheel::tick);
+        REQUIRE(fired == std::vector<int>{1});
+
+        wheel.advance(t0 + hours(2) - TimerWheel::tick);
+        REQUIRE(fired == std::vector<int>{1});
+        wheel.advance(TimerWheel::ClockType::now() + hours(2) +
+                      TimerWheel::tick);
+        REQUIRE(fired == std::vector<int>{1, 2});
+    }
+
+    SECTION("driven by io_service")
+    {
+        wheel.arm(a, milliseconds(30), [&] { fired.push_back(1); });
+        io.run();
+        REQUIRE(fired == std::vector<int>{1});
+        REQUIRE(TimerWheel::ClockType::now() >= t0 + milliseconds(30));
+    }
+
+    SECTION("driver skips idle ticks")
+    {
+        wheel.arm(a, seconds(1), [&] { fired.push_back(1); });
+        std::size_t handlers = 0;
+        while (TimerWheel::ClockType::now() < t0 + milliseconds(300))
+            handlers += io.poll();
+        REQUIRE(handlers == 0);
+        REQUIRE(fired.empty());
+        wheel.cancel(a);
+    }
+
+    SECTION("earlier deadline moves driver earlier")
+    {
+        auto fired_at = TimerWheel::ClockType::time_point::max();
+        wheel.arm(a, seconds(1), [&] { fired.push_back(1); });
+        wheel.arm(b, milliseconds(30), [&] {
+            fired.push_back(2);
+            fired_at = TimerWheel::ClockType::now();
+        });
+        io.run();
+        REQUIRE(fired == std::vector<int>{2, 1});
+        REQUIRE(fired_at < t0 + milliseconds(500));
+    }
+}
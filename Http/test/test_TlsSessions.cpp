@@ -0,0 +1,164 @@
+#include "catch.hpp"
+
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "TlsSessions.h"
+
+using namespace Http;
+
+namespace {
+
+auto make_server_context(int version) -> SSL_CTX * {
+    auto pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    EVP_PKEY *pkey = nullptr;
+    EVP_PKEY_keygen_init(pctx);
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(pctx, &pkey);
+    EVP_PKEY_CTX_free(pctx);
+
+    auto cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, pkey);
+    X509_sign(cert, pkey, EVP_sha256());
+
+    auto ctx = SSL_CTX_new(TLS_method());
+    SSL_CTX_use_certificate(ctx, cert);
+    SSL_CTX_use_PrivateKey(ctx, pkey);
+    SSL_CTX_set_min_proto_version(ctx, version);
+    SSL_CTX_set_max_proto_version(ctx, version);
+    X509_free(cert);
+    EVP_PKEY_free(pkey);
+    return ctx;
+}
+
+void shuttle(BIO *from, BIO *to) {
+    char buf[4096];
+    int n;
+    while ((n = BIO_read(from, buf, sizeof(buf))) > 0)
+        BIO_write(to, buf, n);
+}
+
+/**
+ * @brief   Handshakes in memory, offering session if any,
+ *          returns client's session afterwards, for resumption
+ */
+auto connect(SSL_CTX *server_ctx, SSL_CTX *client_ctx, SSL_SESSION *session)
+    -> SSL_SESSION * {
+    auto server = SSL_new(server_ctx);
+    auto client = SSL_new(client_ctx);
+    if (session)
+        SSL_set_session(client, session);
+
+    auto server_in = BIO_new(BIO_s_mem()), server_out = BIO_new(BIO_s_mem());
+    auto client_in = BIO_new(BIO_s_mem()), client_out = BIO_new(BIO_s_mem());
+    SSL_set_bio(server, server_in, server_out);
+    SSL_set_bio(client, client_in, client_out);
+    SSL_set_accept_state(server);
+    SSL_set_connect_state(client);
+
+    int server_done = 0, client_done = 0;
+    for (int i = 0; i < 10 && (server_done != 1 || client_done != 1); ++i) {
+        client_done = SSL_do_handshake(client);
+        shuttle(client_out, server_in);
+        server_done = SSL_do_handshake(server);
+        shuttle(server_out, client_in);
+    }
+    TlsSessions::record_handshake(server, server_done == 1);
+
+    // TLS 1.3 tickets arrive after the handshake
+    char buf[1];
+    SSL_read(client, buf, sizeof(buf));
+    auto resumable = SSL_get1_session(client);
+
+    // closed cleanly, otherwise OpenSSL drops the session
+    SSL_set_shutdown(client, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    SSL_set_shutdown(server, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    SSL_free(client);
+    SSL_free(server);
+    return resumable;
+}
+
+void check_resumption(int version)
+{
+    TlsSessions sessions;
+    auto server_ctx = make_server_context(version);
+    sessions.attach(server_ctx);
+    auto client_ctx = SSL_CTX_new(TLS_method());
+    SSL_CTX_set_session_cache_mode(client_ctx, SSL_SESS_CACHE_CLIENT);
+
+    SECTION("ticket")
+    {
+        auto session = connect(server_ctx, client_ctx, nullptr);
+        REQUIRE(sessions.full_handshakes_ == 1);
+
+        SSL_SESSION_free(connect(server_ctx, client_ctx, session));
+        REQUIRE(sessions.resumed_handshakes_ == 1);
+        REQUIRE(sessions.full_handshakes_ == 1);
+        SSL_SESSION_free(session);
+    }
+
+    SECTION("ticket under previous key, not older ones")
+    {
+        auto session = connect(server_ctx, client_ctx, nullptr);
+
+        sessions.rotate_ticket_keys();
+        auto renewed = connect(server_ctx, client_ctx, session);
+        REQUIRE(sessions.resumed_handshakes_ == 1);
+
+        sessions.rotate_ticket_keys();
+        sessions.rotate_ticket_keys();
+        SSL_SESSION_free(connect(server_ctx, client_ctx, session));
+        REQUIRE(sessions.resumed_handshakes_ == 1);
+        REQUIRE(sessions.full_handshakes_ == 2);
+        SSL_SESSION_free(session);
+        SSL_SESSION_free(renewed);
+    }
+
+    SECTION("cache, for clients without tickets")
+    {
+        SSL_CTX_set_options(client_ctx, SSL_OP_NO_TICKET);
+        SSL_CTX_set_options(server_ctx, SSL_OP_NO_TICKET);
+        sessions.cache_size(1);
+
+        auto first = connect(server_ctx, client_ctx, nullptr);
+        auto second = connect(server_ctx, client_ctx, nullptr);
+        REQUIRE(sessions.cached() == 1);
+
+        SSL_SESSION_free(connect(server_ctx, client_ctx, second));
+        REQUIRE(sessions.resumed_handshakes_ == 1);
+
+        // evicted to bound cache
+        SSL_SESSION_free(connect(server_ctx, client_ctx, first));
+        REQUIRE(sessions.resumed_handshakes_ == 1);
+        REQUIRE(sessions.full_handshakes_ == 3);
+        SSL_SESSION_free(first);
+        SSL_SESSION_free(second);
+    }
+
+    SECTION("settings")
+    {
+        sessions.lifetime(std::chrono::seconds(60));
+        REQUIRE(sessions.lifetime() == std::chrono::seconds(60));
+        sessions.ticket_key_rotation(std::chrono::seconds(30));
+        REQUIRE(sessions.ticket_key_rotation() == std::chrono::seconds(30));
+    }
+
+    SSL_CTX_free(client_ctx);
+    SSL_CTX_free(server_ctx);
+}
+}
+
+TEST_CASE("Session resumption, TLS 1.2", "[TlsSessions]")
+{
+    check_resumption(TLS1_2_VERSION);
+}
+
+TEST_CASE("Session resumption, TLS 1.3", "[TlsSessions]")
+{
+    check_resumption(TLS1_3_VERSION);
+}
@@ -94,6 +94,22 @@ TEST_CASE("Trie Full example", "[Trie]")
         REQUIRE(found.node_ == smiling);
         REQUIRE(*found == "smiling");
     }
+
+    SECTION("copy")
+    {
+        Trie<std::string> copy = t;
+        REQUIRE(copy.size_ == t.size_);
+        REQUIRE(copy.root_ != t.root_);
+
+        auto smile = copy.find("smile");
+        REQUIRE(*smile == "smile");
+        REQUIRE(smile.node_ != t.find("smile").node_);
+        REQUIRE(copy.prefix_of(smile) == "smile");
+
+        copy.insert({"smirk", "smirk"});
+        REQUIRE(*copy.find("smirk") == "smirk");
+        REQUIRE(t.find("smirk") == t.end());
+    }
 }
 
 TEST_CASE("Trie::{find_to_insert, insert}", "[Trie]")
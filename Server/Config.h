@@ -2,6 +2,7 @@
 #define CONFIG_H
 
 #include <string>
+#include <thread>
 
 namespace HtsgetServer {
 
@@ -12,6 +13,39 @@ public:
   std::string CRAM_FILE_DIRECTORY = "data/";
   std::string VCF_FILE_DIRECTORY = "data/";
   std::string TEMP_FILE_DIRECTORY = "data/";
+  unsigned int THREAD_COUNT = std::thread::hardware_concurrency();
+  bool SHARDED = false; // one event loop + acceptor per thread
+  unsigned int BLOCKING_THREAD_COUNT = 8; // runs handlers marked blocking
+  unsigned int IDLE_TIMEOUT_SECONDS = 15;  // keep-alive between /data requests
+  unsigned int MAX_REQUESTS_PER_CONNECTION = 1000;
+  unsigned int MAX_CONNECTIONS = 10000;    // beyond which clients are sent 503
+  bool SHED_TLS_BEFORE_HANDSHAKE = false;  // close TLS clients over MAX_CONNECTIONS instead, sparing the handshake
+  unsigned int MAX_READS_IN_FLIGHT = 64;   // /reads/<id> each runs samtools
+  unsigned int RETRY_AFTER_SECONDS = 2;
+  unsigned int WRITE_TIMEOUT_SECONDS = 30;   // without progress, before closing
+  unsigned int SEND_WINDOW_BYTES = 262144;   // unsent /data bytes per connection
+  unsigned int MIN_SEND_RATE = 1024;         // bytes/s, slower readers are closed
+  std::string HANDOFF_PATH = ""; // hot restart, a socket in a directory private to the server's user (0700), empty to disable
+  std::string UNIX_PATH = ""; // plain HTTP for a reverse proxy on this host, empty to disable
+  unsigned int DRAIN_TIMEOUT_SECONDS = 60; // for in-flight /data transfers
+  bool KTLS = true; // /data sent by sendfile over kernel TLS, when loaded
+  bool COMPRESSION = true; // tickets by Accept-Encoding, gzip, deflate or zstd
+  unsigned int COMPRESS_MIN_BYTES = 1024; // smaller tickets are sent as is
+  bool HTTP2 = true; // h2 offered by ALPN, ticket urls fetched on one connection
+  unsigned int HTTP2_MAX_STREAMS = 100; // concurrent requests per HTTP/2 connection
+  int LISTEN_BACKLOG = 1024;
+  unsigned int DEFER_ACCEPT_SECONDS = 5; // accept once request bytes arrive, 0 to disable
+  int TCP_FASTOPEN_QUEUE = 256; // ticket request in the SYN, 0 to disable
+  int SEND_BUFFER_BYTES = 0;    // 0 for kernel default, autotuned
+  int RECEIVE_BUFFER_BYTES = 0;
+  bool CORK_RESPONSES = true; // TCP_CORK, ticket head and body in one segment
+  unsigned int TLS_SESSION_CACHE_SIZE = 20480;
+  unsigned int TLS_SESSION_LIFETIME_SECONDS = 3600; // spans fetching a ticket's urls
+  unsigned int TICKET_KEY_ROTATION_SECONDS = 3600;
+  std::string TLS_CIPHERS = "";      // TLS 1.2, OpenSSL format, empty for server default
+  std::string TLS_CIPHERSUITES = ""; // TLS 1.3
+  std::string TLS_GROUPS = "";       // ECDHE, e.g. X25519:P-256
+  // parts of a multipart /data response, more are sent as one spanning range
   static constexpr int MAX_BYTE_RANGE = 1024;
 };
 }
@@ -1,6 +1,7 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include "Config.h"
 #include "Response.h"
 #include "Utilities.h"
 #include "json.hpp"
@@ -44,10 +45,14 @@ auto res_error(ResErrorType error, std::string message) -> json_type {
   return err_msg;
 }
 
-auto send_error(Context &ctx, ResErrorType error, std::string message) -> void {
+auto send_error(Context &ctx, const ServerConfig &config, ResErrorType error,
+                std::string message) -> void {
   ctx.res_.clear_body();
   auto error_res = res_error(error, message);
   ctx.res_.write_json(error_res);
+  if (config.COMPRESSION)
+    ctx.res_.compress(ctx.req_.get_header("Accept-Encoding").first,
+                      config.COMPRESS_MIN_BYTES);
   auto status_code = Response::to_status_code(errtoint(ResErrorType::NotFound));
   ctx.res_.status_code(status_code);
 }
@@ -25,6 +25,11 @@ public:
   }
 
 public:
+  /**
+   * @brief   File descriptor of the pipe, for asynchronous reads
+   */
+  auto native_handle() -> int { return fileno(fp_); }
+
   auto read() -> std::string {
     bytes_read_ = std::fread(buf_, 1, BUF_SIZE, fp_);
     return std::string(buf_, buf_ + bytes_read_);
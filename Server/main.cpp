@@ -1,9 +1,13 @@
 #include "json.hpp"
 
+#include <cerrno>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <system_error>
 #include <utility>
 #include <vector>
 
@@ -25,11 +29,36 @@
 #include "Ticket.h"
 #include "Wrapper.h"
 
+#include <sys/stat.h> // stat
+#include <unistd.h>   // dup, close
+#include "Coroutine.h"
+#include "asio/yield.hpp"
+
 using namespace asio;
 using namespace Http;
 using namespace HtsgetServer;
 using nlohmann::json;
 
+/**
+ * @brief   State of a /reads/<id> request, lives across yields
+ */
+struct ReadsState {
+  std::string command;
+  std::string f_relpath;  // temporary file, named by query
+  std::string temp_path; // written to, then renamed to f_relpath,
+                         // a template until mkstemp(3)
+  std::unique_ptr<Popen> proc_pipe;
+  std::unique_ptr<asio::posix::stream_descriptor> pipe;
+  std::vector<char> buf = std::vector<char>(1 << 20); // 1MB per url
+  std::size_t chunk_size = 0;                         // read into buf
+  std::error_code read_ec;
+  std::fstream queryout;
+  SHA256Codec checksum;
+  std::unique_ptr<Ticket> ticket;
+  std::string url_abspath;
+  std::size_t slice_size = 0;
+};
+
 void log(Context &ctx) {
   json_type urlparse = {
       {"query", ctx.query_}, {"param", ctx.param_},
@@ -52,172 +81,287 @@ int main() {
        curl -v -X GET
        'https://127.0.0.1:8888/reads/bamtest?format=BAM&referenceName=1&start=10145&end=10150'
 
+       curl -v --compressed -X GET
+       'https://127.0.0.1:8888/reads/bamtest?format=BAM&referenceName=1'
+
        curl --http1.1 -v -X GET
        '127.0.0.1:8888/reads/vcftest?format=VCF&referenceName=Y&start=2690000&end=2800000'
+
+       a coroutine, output of samtools/tabix is read from its pipe
+       asynchronously so the event loop is never blocked waiting on it
     */
     app->router_.get("/reads/");
     app->router_.get(
-        "/reads/<id>", Handler([&](Context &ctx) {
-
-          log(ctx);
-
-          auto format = ctx.query_["format"];
-          if (!format.empty() && format != "BAM" && format != "CRAM" &&
-              format != "VCF")
-            return send_error(ctx, ResErrorType::UnsupportedFormat,
-                              "The requested file format " + format +
-                                  " is not supported by the server");
-
-          if (format.empty())
-            format = "BAM";
-
-          auto referenceName = ctx.query_["referenceName"];
-          auto start = ctx.query_["start"];
-          auto end = ctx.query_["end"];
-
-          if (referenceName.empty() && (!start.empty() || !end.empty()))
-            return send_error(ctx, ResErrorType::InvalidInput,
-                              "Request parameter: start/end specified but "
-                              "referenceName unspecified");
-
-          if ((start.empty() && !end.empty()) ||
-              (!start.empty() && end.empty()))
-            return send_error(
-                ctx, ResErrorType::InvalidInput,
-                "Request parameter: both start and end must be present/absent");
-
-          unsigned long int startul = 0;
-          unsigned long int endul = 0;
-
-          if (!start.empty() && !end.empty()) {
-            startul = strtoul(start.c_str(), NULL, 10);
-            endul = strtoul(end.c_str(), NULL, 10);
-            if (startul > endul)
-              return send_error(ctx, ResErrorType::InvalidRange,
-                                "Request parameter: start is greater than end");
-          }
-
-          std::string region;
-          if (start.empty() && end.empty())
-            region = referenceName;
-          else
-            region = referenceName + ":" + start + "-" + end;
-
-          std::string command;
-
-          switch (format.front()) {
-          case 'B': {
-            command = "samtools view -b -h " + config.BAM_FILE_DIRECTORY +
-                      ctx.param_["id"] + ".bam " + "chr" + region;
-            break;
+        "/reads/<id>",
+        Handler(make_coroutine<ReadsState>([&](CoroutineFrame<ReadsState> &co,
+                                          Context &ctx) {
+          auto &q = co.state_;
+
+          reenter(co) {
+            {
+              log(ctx);
+
+              auto format = ctx.query_["format"];
+              if (!format.empty() && format != "BAM" && format != "CRAM" &&
+                  format != "VCF")
+                return send_error(ctx, config, ResErrorType::UnsupportedFormat,
+                                  "The requested file format " + format +
+                                      " is not supported by the server");
+
+              if (format.empty())
+                format = "BAM";
+
+              auto referenceName = ctx.query_["referenceName"];
+              auto start = ctx.query_["start"];
+              auto end = ctx.query_["end"];
+
+              if (referenceName.empty() && (!start.empty() || !end.empty()))
+                return send_error(ctx, config, ResErrorType::InvalidInput,
+                                  "Request parameter: start/end specified but "
+                                  "referenceName unspecified");
+
+              if ((start.empty() && !end.empty()) ||
+                  (!start.empty() && end.empty()))
+                return send_error(ctx, config, ResErrorType::InvalidInput,
+                                  "Request parameter: both start and end must "
+                                  "be present/absent");
+
+              unsigned long int startul = 0;
+              unsigned long int endul = 0;
+
+              if (!start.empty() && !end.empty()) {
+                startul = strtoul(start.c_str(), NULL, 10);
+                endul = strtoul(end.c_str(), NULL, 10);
+                if (startul > endul)
+                  return send_error(
+                      ctx, config, ResErrorType::InvalidRange,
+                      "Request parameter: start is greater than end");
+              }
+
+              std::string region;
+              if (start.empty() && end.empty())
+                region = referenceName;
+              else
+                region = referenceName + ":" + start + "-" + end;
+
+              std::string command;
+
+              switch (format.front()) {
+              case 'B': {
+                command = "samtools view -b -h " + config.BAM_FILE_DIRECTORY +
+                          ctx.param_["id"] + ".bam " + "chr" + region;
+                break;
+              }
+              case 'C': {
+                command = "samtools view -C -h " +
+                          config.CRAM_FILE_DIRECTORY + ctx.param_["id"] +
+                          ".cram " + "chr" + region;
+                break;
+              }
+              case 'V': {
+                command = "tabix " + config.VCF_FILE_DIRECTORY +
+                          ctx.param_["id"] + ".vcf.gz " + region;
+                break;
+              }
+              }
+
+              std::cout << command << std::endl;
+              /**
+               * -#   Outputs requested file to temporary file,
+               * -#   Splits file into chunks
+               * -#   Returns a list of tickets, containing urls with byte
+               * range to temp file
+               *
+               * named by id, format and region, so that repeated queries
+               * reuse one file. Each is written to a name of its own, made
+               * unique by mkstemp(3), then renamed into place once complete
+               */
+              q.command = command;
+              q.f_relpath = config.TEMP_FILE_DIRECTORY +
+                            SHA256Codec().digest(ctx.param_["id"] + format +
+                                                 region);
+              q.temp_path = q.f_relpath + ".XXXXXX";
+              q.ticket = std::make_unique<Ticket>(format);
+            }
+
+            /* file and process calls block, run off the event loop */
+            yield co.run_blocking(app->blocking_executor(), [&q] {
+              int fd = ::mkstemp(&q.temp_path[0]);
+              if (fd < 0)
+                throw std::system_error(errno, std::generic_category(),
+                                        "mkstemp " + q.temp_path);
+              ::close(fd);
+              try {
+                q.queryout.open(q.temp_path, std::ios::out | std::ios::trunc);
+                if (!q.queryout)
+                  throw std::runtime_error("open " + q.temp_path);
+                q.proc_pipe = std::make_unique<Popen>(q.command, "r");
+              } catch (...) {
+                q.queryout.close();
+                ::unlink(q.temp_path.c_str());
+                throw;
+              }
+            });
+            if (co.ec_)
+              return ctx.res_.status_code(StatusCode::Internal_Server_Error);
+
+            q.url_abspath = app->base_url() + "/" + q.f_relpath;
+            q.pipe = std::make_unique<asio::posix::stream_descriptor>(
+                co.io_service(), ::dup(q.proc_pipe->native_handle()));
+
+            /* each full buffer, or what is left at EOF, is one url */
+            do {
+              yield asio::async_read(*q.pipe, asio::buffer(q.buf),
+                                     co.resume());
+              q.read_ec = co.ec_;
+              q.chunk_size = co.bytes_transferred_;
+
+              if (q.chunk_size > 0) {
+                q.checksum.update(std::string(q.buf.data(), q.chunk_size));
+                q.ticket->add_url(
+                    {q.url_abspath,
+                     {{"Range", "bytes=" + std::to_string(q.slice_size) +
+                                    "-" +
+                                    std::to_string(q.slice_size +
+                                                   q.chunk_size - 1)}}});
+                q.slice_size += q.chunk_size;
+
+                // buffer is read into again once written
+                yield co.run_blocking(app->blocking_executor(), [&q] {
+                  q.queryout.write(q.buf.data(), q.chunk_size);
+                });
+              }
+            } while (!q.read_ec && q.queryout);
+
+            q.pipe.reset();
+            // pclose(3) waits for the child
+            yield co.run_blocking(app->blocking_executor(), [&q] {
+              q.proc_pipe.reset();
+              q.queryout.close();
+              // a truncated file is never handed out
+              if (q.read_ec != asio::error::eof || !q.queryout) {
+                ::unlink(q.temp_path.c_str());
+                throw std::runtime_error("query output incomplete " +
+                                         q.temp_path);
+              }
+              if (::rename(q.temp_path.c_str(), q.f_relpath.c_str()) != 0) {
+                auto error = errno;
+                ::unlink(q.temp_path.c_str());
+                throw std::system_error(error, std::generic_category(),
+                                        "rename " + q.temp_path);
+              }
+            });
+            if (co.ec_)
+              return ctx.res_.status_code(StatusCode::Internal_Server_Error);
+
+            q.checksum.finish();
+            q.ticket->checksum(q.checksum.get_hash());
+
+            std::cout << std::setw(4) << q.ticket->to_json() << std::endl;
+
+            ctx.res_.content_type(
+                "application/vnd.ga4gh.htsget.v0.2rc+json; charset=utf-8");
+            ctx.res_.write_json(q.ticket->to_json());
+            // urls differ only in their ranges, compress well
+            if (config.COMPRESSION)
+              ctx.res_.compress(ctx.req_.get_header("Accept-Encoding").first,
+                                config.COMPRESS_MIN_BYTES);
+            std::cout << ctx.res_ << std::endl;
           }
-          case 'C': {
-            command = "samtools view -C -h " + config.CRAM_FILE_DIRECTORY +
-                      ctx.param_["id"] + ".cram " + "chr" + region;
-            break;
-          }
-          case 'V': {
-            command = "tabix " + config.VCF_FILE_DIRECTORY + ctx.param_["id"] +
-                      ".vcf.gz " + region;
-            break;
-          }
-          }
-
-          std::cout << command << std::endl;
-          /**
-           * -#   Outputs requested file to temporary file,
-           * -#   Splits file into chunks
-           * -#   Returns a list of tickets, containing urls with byte range to
-           * temp file
-           */
-
-          std::string tempfilename =
-              SHA256Codec().digest(ctx.param_["id"] + format);
-
-          std::string f_relpath = config.TEMP_FILE_DIRECTORY + tempfilename;
-          std::string url_abspath = app->base_url() + "/" + f_relpath;
-
-          std::string buf;
-          std::fstream queryout(f_relpath, std::ios::out);
-          auto proc_pipe = Popen(command, "r");
-          auto checksum = SHA256Codec();
-
-          Ticket ticket(format);
-          int slice_size = 0;
-          while (!(buf = proc_pipe.read()).empty()) {
-            queryout << buf;
-            checksum.update(buf);
-            ticket.add_url({url_abspath,
-                            {{"Range",
-                              "bytes=" + std::to_string(slice_size) + "-" +
-                                  std::to_string(slice_size + buf.size())}}});
-            slice_size += buf.size();
-          }
-
-          checksum.finish();
-          ticket.checksum(checksum.get_hash());
-
-          std::cout << std::setw(4) << ticket.to_json() << std::endl;
-
-          ctx.res_.content_type(
-              "application/vnd.ga4gh.htsget.v0.2rc+json; charset=utf-8");
-          ctx.res_.write_json(ticket.to_json());
-          std::cout << ctx.res_ << std::endl;
-
-        }));
+        })).max_in_flight(config.MAX_READS_IN_FLIGHT));
 
     /*
         curl --http1.1 -v -X GET -H "Range: bytes=0-100"
        '127.0.0.1:8888/data/9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08'
+
+        curl --http1.1 -v -X GET -H "Range: bytes=0-99,4096-,-512"
+       '127.0.0.1:8888/data/9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08'
+
+        nghttp -v -H "Range: bytes=0-100"
+       'https://127.0.0.1:8888/data/9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08'
     */
     app->router_.get("/data/");
     app->router_.get(
         "/data/<filename>", Handler([&](Context &ctx) {
-          std::string range;
-          bool range_exists;
-          std::tie(range, range_exists) = ctx.req_.get_header("Range");
-
-          int start{};
-          int end{};
-
-          if (range_exists) {
-            range = range.substr(range.find('=') + 1);
-            start = std::stoi(range.substr(0, range.find('-')));
-            end = std::stoi(range.substr(range.find('-') + 1));
-          } else {
-            return send_error(ctx, ResErrorType::InvalidInput,
-                              "Request Parameter: need to specify byte ranges");
-          }
-
-          if (start > end)
-            return send_error(ctx, ResErrorType::InvalidRange,
-                              "Request parameter: start is greater than end");
-
           std::string infp =
               config.TEMP_FILE_DIRECTORY + ctx.param_["filename"].c_str();
-          std::ifstream is(infp, std::ifstream::in);
-          if (!is)
-            return send_error(ctx, ResErrorType::NotFound,
+          struct stat st;
+          if (::stat(infp.c_str(), &st) != 0)
+            return send_error(ctx, config, ResErrorType::NotFound,
                               "Requested file " + infp + " not found");
 
-          is.seekg(0, is.end);
-          int slice_size = is.tellg();
-          is.seekg(start, is.beg);
-
-          if (start > slice_size || end > slice_size)
-            return send_error(
-                ctx, ResErrorType::InvalidRange,
-                "Request parameter: start/end is greater than size of file");
+          if (!ctx.req_.get_header("Range").second)
+            return send_error(ctx, config, ResErrorType::InvalidInput,
+                              "Request Parameter: need to specify byte ranges");
 
-          char *buffer = new char[end - start];
+          std::vector<ByteRange> ranges;
+          try {
+            ranges = ctx.req_.byte_ranges(st.st_size, config.MAX_BYTE_RANGE);
+          } catch (const std::invalid_argument &e) {
+            return send_error(ctx, config, ResErrorType::InvalidRange,
+                              std::string("Request parameter: ") + e.what());
+          }
 
-          is.read(buffer, end - start);
-          ctx.res_.write_range(buffer, start, end, slice_size);
+          if (ranges.empty()) {
+            send_error(
+                ctx, config, ResErrorType::InvalidRange,
+                "Request parameter: no range within size of file");
+            ctx.res_.status_code(StatusCode::Requested_Range_Not_Satisfiable);
+            ctx.res_.set_header(
+                {"Content-Range", "bytes */" + std::to_string(st.st_size)});
+            return;
+          }
 
-          delete[] buffer;
+          /* body is sent straight from file, by sendfile(2) over TCP,
+             several ranges as parts of one multipart/byteranges body */
+          if (!ctx.res_.write_file_ranges(infp, ranges))
+            return send_error(ctx, config, ResErrorType::NotFound,
+                              "Requested file " + infp + " not found");
         }));
 
-    std::cout << "app starts running on " << app->base_url() << std::endl;
+    app->thread_count(config.THREAD_COUNT);
+    app->sharded(config.SHARDED);
+    app->blocking_thread_count(config.BLOCKING_THREAD_COUNT);
+    app->connection_options_.idle_timeout =
+        std::chrono::seconds(config.IDLE_TIMEOUT_SECONDS);
+    app->connection_options_.max_requests = config.MAX_REQUESTS_PER_CONNECTION;
+    app->connection_options_.max_connections = config.MAX_CONNECTIONS;
+    app->connection_options_.shed_tls_before_handshake =
+        config.SHED_TLS_BEFORE_HANDSHAKE;
+    app->connection_options_.retry_after =
+        std::chrono::seconds(config.RETRY_AFTER_SECONDS);
+    app->connection_options_.write_timeout =
+        std::chrono::seconds(config.WRITE_TIMEOUT_SECONDS);
+    app->connection_options_.send_window = config.SEND_WINDOW_BYTES;
+    app->connection_options_.min_send_rate = config.MIN_SEND_RATE;
+    app->connection_options_.ktls = config.KTLS;
+    app->connection_options_.http2 = config.HTTP2;
+    app->connection_options_.http2_max_streams = config.HTTP2_MAX_STREAMS;
+    app->connection_options_.backlog = config.LISTEN_BACKLOG;
+    app->connection_options_.defer_accept =
+        std::chrono::seconds(config.DEFER_ACCEPT_SECONDS);
+    app->connection_options_.fastopen_queue = config.TCP_FASTOPEN_QUEUE;
+    app->connection_options_.send_buffer = config.SEND_BUFFER_BYTES;
+    app->connection_options_.receive_buffer = config.RECEIVE_BUFFER_BYTES;
+    app->connection_options_.cork = config.CORK_RESPONSES;
+    app->tls_sessions_.cache_size(config.TLS_SESSION_CACHE_SIZE);
+    app->tls_sessions_.lifetime(
+        std::chrono::seconds(config.TLS_SESSION_LIFETIME_SECONDS));
+    app->tls_sessions_.ticket_key_rotation(
+        std::chrono::seconds(config.TICKET_KEY_ROTATION_SECONDS));
+    if (!config.TLS_CIPHERS.empty() || !config.TLS_CIPHERSUITES.empty())
+      app->ciphers(config.TLS_CIPHERS.empty() ? app->ciphers().first
+                                              : config.TLS_CIPHERS,
+                   config.TLS_CIPHERSUITES.empty() ? app->ciphers().second
+                                                   : config.TLS_CIPHERSUITES);
+    if (!config.TLS_GROUPS.empty())
+      app->groups(config.TLS_GROUPS);
+    app->handoff_path(config.HANDOFF_PATH);
+    app->unix_path(config.UNIX_PATH);
+    app->drain_timeout(std::chrono::seconds(config.DRAIN_TIMEOUT_SECONDS));
+
+    std::cout << "app starts running on " << app->base_url() << " with "
+              << app->thread_count() << " threads" << std::endl;
     std::cout << app->router_ << std::endl;
     app->run();
   } catch (std::exception e) {